@@ -24,6 +24,8 @@
 
 namespace MediaPLayer {
 
+#define PTS_NONE           ((S64)(-0x7fffffffffffffffLL - 1)) // unknown timestamp
+
 typedef enum _DECODER_TYPE {
 	DECODER_NONE,
 	DECODER_LIBAV,
@@ -40,6 +42,7 @@ typedef enum _DISPLAY_TYPE {
 	DISPLAY_FBDEV,
 	DISPLAY_OMAPDRM,
 	DISPLAY_OMAPDRM_EGL,
+	DISPLAY_NULL,
 } DISPLAY_TYPE;
 
 typedef enum _AUDIO_TYPE {
@@ -146,6 +149,18 @@ typedef enum _FORMAT_VIDEO {
 	FMT_NV12
 } FORMAT_VIDEO;
 
+typedef enum _COLOR_SPACE {
+	COLOR_SPACE_UNKNOWN,
+	COLOR_SPACE_BT601,
+	COLOR_SPACE_BT709,
+} COLOR_SPACE;
+
+typedef enum _COLOR_RANGE {
+	COLOR_RANGE_UNKNOWN,
+	COLOR_RANGE_LIMITED,
+	COLOR_RANGE_FULL,
+} COLOR_RANGE;
+
 } // namespace
 
 #endif
@@ -0,0 +1,331 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "basetypes.h"
+#include "logs.h"
+#include "benchmark.h"
+#include "colorconvert.h"
+#include "workerpool.h"
+
+namespace MediaPLayer {
+
+static const char *stageNames[BENCHMARK_STAGE_MAX] = {
+	"readNextFrame",
+	"decodeFrame",
+	"getVideoStreamOutputFrame",
+	"putImage",
+	"flip",
+};
+
+Benchmark::Benchmark() :
+		_numFrames(0), _startTime(0), _endTime(0) {
+	memset(_stages, 0, sizeof(_stages));
+}
+
+S64 Benchmark::getTime() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (S64)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+void Benchmark::start() {
+	memset(_stages, 0, sizeof(_stages));
+	_numFrames = 0;
+	_startTime = getTime();
+	_endTime = _startTime;
+}
+
+void Benchmark::stop() {
+	_endTime = getTime();
+}
+
+U32 Benchmark::getBucket(U32 value) {
+	if (value < BENCHMARK_SUB_BUCKETS)
+		return value;
+
+	U32 msb = 31 - __builtin_clz(value);
+	U32 shift = msb - BENCHMARK_SUB_BUCKET_BITS;
+
+	return ((shift + 1) << BENCHMARK_SUB_BUCKET_BITS) + ((value >> shift) & (BENCHMARK_SUB_BUCKETS - 1));
+}
+
+U32 Benchmark::getBucketValue(U32 bucket) {
+	if (bucket < BENCHMARK_SUB_BUCKETS)
+		return bucket;
+
+	U32 shift = (bucket >> BENCHMARK_SUB_BUCKET_BITS) - 1;
+	U32 sub = bucket & (BENCHMARK_SUB_BUCKETS - 1);
+
+	// upper bound of bucket range
+	return (U32)((((U64)BENCHMARK_SUB_BUCKETS + sub + 1) << shift) - 1);
+}
+
+void Benchmark::addSample(BENCHMARK_STAGE stage, S64 time) {
+	Histogram *h = &_stages[stage];
+	U32 value = (U32)CLIP(time, 0, 0xffffffffLL);
+
+	h->buckets[getBucket(value)]++;
+	if (h->count == 0 || value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+	h->count++;
+	h->sum += value;
+}
+
+U32 Benchmark::getPercentile(BENCHMARK_STAGE stage, double percentile) {
+	Histogram *h = &_stages[stage];
+
+	if (h->count == 0)
+		return 0;
+
+	U64 rank = (U64)(percentile / 100.0 * h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	U64 seen = 0;
+	for (U32 i = 0; i < BENCHMARK_NUM_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank)
+			return CLIP(getBucketValue(i), h->min, h->max);
+	}
+
+	return h->max;
+}
+
+STATUS Benchmark::report(const char *decoder, const char *display, StreamVideoInfo *info,
+                         DecoderVideoStats *decoderStats, const char *jsonFile) {
+	double seconds = (_endTime - _startTime) / 1000000.0;
+	double fps = seconds > 0 ? _numFrames / seconds : 0;
+
+	log->printf("Benchmark: decoder: %s, display: %s, video: %dx%d\n", decoder, display, info->width, info->height);
+	log->printf("Benchmark: %llu frames in %.3fs, %.2f fps\n", _numFrames, seconds, fps);
+	log->printf("Benchmark: %-26s %8s %8s %8s %8s %8s %8s\n", "stage [us]", "count", "avg", "p50", "p95", "p99", "max");
+	for (int i = 0; i < BENCHMARK_STAGE_MAX; i++) {
+		Histogram *h = &_stages[i];
+		log->printf("Benchmark: %-26s %8llu %8llu %8u %8u %8u %8u\n", stageNames[i], h->count,
+		            h->count ? h->sum / h->count : 0,
+		            getPercentile((BENCHMARK_STAGE)i, 50), getPercentile((BENCHMARK_STAGE)i, 95),
+		            getPercentile((BENCHMARK_STAGE)i, 99), h->max);
+	}
+	if (decoderStats) {
+		log->printf("Benchmark: input buffers %u, max in flight %u, overlapped decodes %llu of %llu\n",
+		            decoderStats->inputBuffers, decoderStats->maxInputInFlight,
+		            decoderStats->overlappedDecodes, decoderStats->decodes);
+	}
+
+	if (jsonFile == nullptr)
+		return S_OK;
+
+	FILE *file = fopen(jsonFile, "w");
+	if (file == nullptr) {
+		log->printf("Benchmark::report(): Failed open %s: %s\n", jsonFile, strerror(errno));
+		return S_FAIL;
+	}
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"decoder\": \"%s\",\n", decoder);
+	fprintf(file, "  \"display\": \"%s\",\n", display);
+	fprintf(file, "  \"codec_id\": %d,\n", info->codecId);
+	fprintf(file, "  \"width\": %u,\n", info->width);
+	fprintf(file, "  \"height\": %u,\n", info->height);
+	fprintf(file, "  \"frames\": %llu,\n", _numFrames);
+	fprintf(file, "  \"seconds\": %.6f,\n", seconds);
+	fprintf(file, "  \"fps\": %.3f,\n", fps);
+	fprintf(file, "  \"stages\": {\n");
+	for (int i = 0; i < BENCHMARK_STAGE_MAX; i++) {
+		Histogram *h = &_stages[i];
+		fprintf(file, "    \"%s\": { \"count\": %llu, \"min_us\": %u, \"avg_us\": %llu, "
+		        "\"p50_us\": %u, \"p95_us\": %u, \"p99_us\": %u, \"max_us\": %u }%s\n",
+		        stageNames[i], h->count, h->min, h->count ? h->sum / h->count : 0,
+		        getPercentile((BENCHMARK_STAGE)i, 50), getPercentile((BENCHMARK_STAGE)i, 95),
+		        getPercentile((BENCHMARK_STAGE)i, 99), h->max,
+		        i + 1 < BENCHMARK_STAGE_MAX ? "," : "");
+	}
+	fprintf(file, "  }%s\n", decoderStats ? "," : "");
+	if (decoderStats) {
+		fprintf(file, "  \"decoder_input\": { \"buffers\": %u, \"max_in_flight\": %u, "
+		        "\"decodes\": %llu, \"overlapped_decodes\": %llu }\n",
+		        decoderStats->inputBuffers, decoderStats->maxInputInFlight,
+		        decoderStats->decodes, decoderStats->overlappedDecodes);
+	}
+	fprintf(file, "}\n");
+	fclose(file);
+
+	log->printf("Benchmark: results written to %s\n", jsonFile);
+
+	return S_OK;
+}
+
+STATUS Benchmark::runColorConvert(U32 width, U32 height, U32 iterations) {
+	static const char *implNames[COLOR_CONVERT_MAX] = { "best", "scalar", "neon", "sse2", "avx2" };
+	static const char *kernelNames[3] = { "yuv420p->nv12", "yuv420p->rgb32", "yuv420p->rgb565" };
+	U32 chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+	U32 srcSize = width * height + chromaWidth * chromaHeight * 2;
+	U32 nv12Size = width * height + chromaWidth * 2 * chromaHeight;
+	U32 rgbSize = width * height * 4;
+	U32 rgb16Size = width * height * 2;
+	U8 *buffers[6] = {};
+	STATUS status = S_OK;
+	double scalarTime[3] = {};
+	ColorPlanes src, nv12, rgb, rgb16, refNv12, refRgb, refRgb16;
+	U32 seed = 1;
+	U32 numThreads[3];
+	double singleTime[2] = {};
+
+	if (width == 0 || height == 0 || iterations == 0)
+		return S_FAIL;
+
+	U32 sizes[6] = { srcSize, nv12Size, nv12Size, rgbSize, rgbSize, rgb16Size };
+	for (int i = 0; i < 6; i++) {
+		if (posix_memalign((void **)&buffers[i], 64, sizes[i]) != 0) {
+			log->printf("Benchmark::runColorConvert(): out of memory!\n");
+			buffers[i] = nullptr;
+			status = S_FAIL;
+			goto end;
+		}
+	}
+
+	// full byte range also covers clipping and saturation
+	for (U32 i = 0; i < srcSize; i++) {
+		seed = seed * 1103515245 + 12345;
+		buffers[0][i] = seed >> 24;
+	}
+
+	src = { { buffers[0], buffers[0] + width * height, buffers[0] + width * height + chromaWidth * chromaHeight },
+	        { width, chromaWidth, chromaWidth } };
+	refNv12 = { { buffers[1], buffers[1] + width * height, nullptr }, { width, chromaWidth * 2, 0 } };
+	nv12 = { { buffers[2], buffers[2] + width * height, nullptr }, { width, chromaWidth * 2, 0 } };
+	refRgb = { { buffers[3], nullptr, nullptr }, { width * 4, 0, 0 } };
+	rgb = { { buffers[4], nullptr, nullptr }, { width * 4, 0, 0 } };
+	refRgb16 = { { buffers[5], nullptr, nullptr }, { width * 2, 0, 0 } };
+	rgb16 = { { buffers[4], nullptr, nullptr }, { width * 2, 0, 0 } };
+
+	log->printf("Benchmark: colour conversion %ux%u, %u iterations\n", width, height, iterations);
+	log->printf("Benchmark: %-8s %-16s %10s %8s %s\n", "impl", "kernel", "ms/frame", "speedup", "result");
+
+	for (int impl = COLOR_CONVERT_SCALAR; impl < COLOR_CONVERT_MAX; impl++) {
+		const ColorConvertKernels *kernels = GetColorConvertKernels((COLOR_CONVERT_IMPL)impl);
+		if (kernels == nullptr)
+			continue;
+
+		for (int kernel = 0; kernel < 3; kernel++) {
+			const ColorPlanes *dst = (kernel == 0) ? &nv12 : (kernel == 1) ? &rgb : &rgb16;
+			const ColorPlanes *ref = (kernel == 0) ? &refNv12 : (kernel == 1) ? &refRgb : &refRgb16;
+			U32 size = (kernel == 0) ? nv12Size : (kernel == 1) ? rgbSize : rgb16Size;
+
+			memset(dst->data[0], 0, size);
+			S64 startTime = getTime();
+			for (U32 i = 0; i < iterations; i++) {
+				if (kernel == 0)
+					ColorConvertYUV420ToNV12(kernels, &src, dst, 0, 0, width, height);
+				else if (kernel == 1)
+					ColorConvertYUV420ToRGB32(kernels, &src, dst, 0, 0, width, height);
+				else
+					ColorConvertYUV420ToRGBScaled(kernels, &src, dst, 16, 0, 0, width, height, width, height);
+			}
+			double time = (getTime() - startTime) / 1000.0 / iterations;
+
+			bool match = true;
+			if (impl == COLOR_CONVERT_SCALAR) {
+				memcpy(ref->data[0], dst->data[0], size);
+				scalarTime[kernel] = time;
+			} else {
+				match = memcmp(ref->data[0], dst->data[0], size) == 0;
+			}
+			if (!match)
+				status = S_FAIL;
+
+			log->printf("Benchmark: %-8s %-16s %10.3f %7.2fx %s\n", implNames[impl],
+			            kernelNames[kernel], time,
+			            time > 0 ? scalarTime[kernel] / time : 0, match ? "ok" : "MISMATCH");
+		}
+	}
+
+	if (width > 2 && height > 2) {
+		// crop copy does not depend on kernels, odd origin exercises rounding
+		S64 startTime = getTime();
+		for (U32 i = 0; i < iterations; i++) {
+			ColorConvertCopyNV12(&refNv12, &nv12, 1, 1, width - 2, height - 2);
+		}
+		log->printf("Benchmark: %-8s %-16s %10.3f\n", "memcpy", "nv12 crop copy",
+		            (getTime() - startTime) / 1000.0 / iterations);
+	}
+
+	// same conversions split in slices over 1, 2 and all cpus
+	numThreads[0] = 1;
+	numThreads[1] = 2;
+	numThreads[2] = MIN((U32)MAX(sysconf(_SC_NPROCESSORS_ONLN), 1), WORKER_POOL_MAX_THREADS);
+	for (int t = 0; t < 3; t++) {
+		if (t > 0 && numThreads[t] <= numThreads[t - 1])
+			continue;
+
+		WorkerPool pool;
+		char name[16];
+		pool.init(numThreads[t]);
+		snprintf(name, sizeof(name), "%u thr", pool.getNumThreads());
+
+		for (int kernel = 0; kernel < 2; kernel++) {
+			ColorConvertJob job = {};
+			job.op = (kernel == 0) ? COLOR_CONVERT_YUV420_TO_NV12 : COLOR_CONVERT_YUV420_TO_RGB32;
+			job.src = src;
+			job.dst = (kernel == 0) ? nv12 : rgb;
+			job.width = width;
+			job.height = height;
+			const ColorPlanes *ref = (kernel == 0) ? &refNv12 : &refRgb;
+			U32 size = (kernel == 0) ? nv12Size : rgbSize;
+
+			memset(job.dst.data[0], 0, size);
+			S64 startTime = getTime();
+			for (U32 i = 0; i < iterations; i++) {
+				ColorConvertRun(&pool, &job);
+			}
+			double time = (getTime() - startTime) / 1000.0 / iterations;
+			if (t == 0)
+				singleTime[kernel] = time;
+
+			bool match = memcmp(ref->data[0], job.dst.data[0], size) == 0;
+			if (!match)
+				status = S_FAIL;
+
+			log->printf("Benchmark: %-8s %-16s %10.3f %7.2fx %s\n", name, kernelNames[kernel], time,
+			            time > 0 ? singleTime[kernel] / time : 0, match ? "ok" : "MISMATCH");
+		}
+	}
+
+end:
+	for (int i = 0; i < 6; i++) {
+		free(buffers[i]);
+	}
+
+	return status;
+}
+
+} // namespace
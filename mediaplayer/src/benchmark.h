@@ -0,0 +1,90 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "basetypes.h"
+#include "demuxer_base.h"
+#include "decoder_video_base.h"
+
+namespace MediaPLayer {
+
+#define BENCHMARK_SUB_BUCKET_BITS   4
+#define BENCHMARK_SUB_BUCKETS       (1 << BENCHMARK_SUB_BUCKET_BITS)
+#define BENCHMARK_NUM_BUCKETS       ((32 - BENCHMARK_SUB_BUCKET_BITS + 1) * BENCHMARK_SUB_BUCKETS)
+#define BENCHMARK_DEFAULT_JSON      "benchmark.json"
+#define BENCHMARK_COLOR_CONVERT_ITERATIONS 100
+
+typedef enum _BENCHMARK_STAGE {
+	BENCHMARK_STAGE_DEMUX,
+	BENCHMARK_STAGE_DECODE,
+	BENCHMARK_STAGE_OUTPUT_FRAME,
+	BENCHMARK_STAGE_PUT_IMAGE,
+	BENCHMARK_STAGE_FLIP,
+	BENCHMARK_STAGE_MAX
+} BENCHMARK_STAGE;
+
+// Latency histograms per player stage.
+// Samples in microseconds go to log-linear buckets, 16 per power of two,
+// so percentiles are within ~6% and memory does not grow with stream length.
+// Each stage must be recorded from single thread only.
+class Benchmark {
+private:
+
+	typedef struct {
+		U32 buckets[BENCHMARK_NUM_BUCKETS];
+		U64 count;
+		U64 sum;
+		U32 min;
+		U32 max;
+	} Histogram;
+
+	Histogram       _stages[BENCHMARK_STAGE_MAX];
+	U64             _numFrames;
+	S64             _startTime;
+	S64             _endTime;
+
+public:
+
+	Benchmark();
+
+	void start();
+	void stop();
+	void addSample(BENCHMARK_STAGE stage, S64 time);
+	void frameDone() { _numFrames++; }
+	STATUS report(const char *decoder, const char *display, StreamVideoInfo *info,
+	              DecoderVideoStats *decoderStats, const char *jsonFile);
+
+	static S64 getTime();
+	// times colour conversion kernels on synthetic frame and checks them against scalar ones
+	static STATUS runColorConvert(U32 width, U32 height, U32 iterations);
+
+private:
+
+	static U32 getBucket(U32 value);
+	static U32 getBucketValue(U32 bucket);
+	U32 getPercentile(BENCHMARK_STAGE stage, double percentile);
+};
+
+} // namespace
+
+#endif
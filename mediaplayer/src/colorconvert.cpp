@@ -0,0 +1,295 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include "basetypes.h"
+#include "colorconvert.h"
+#include "colorconvert_kernels.h"
+#include "workerpool.h"
+
+namespace MediaPLayer {
+
+static void yuvToRgb32RowC(const U8 *y, const U8 *u, const U8 *v, U8 *dst, U32 count) {
+	yuvToRgb32RowScalar(y, u, v, dst, 0, count);
+}
+
+static void yuvToRgb16RowC(const U8 *y, const U8 *u, const U8 *v, U8 *dst, U32 count) {
+	yuvToRgb16RowScalar(y, u, v, dst, 0, count);
+}
+
+static void interleaveUVRowC(const U8 *u, const U8 *v, U8 *dst, U32 count) {
+	interleaveUVRowScalar(u, v, dst, 0, count);
+}
+
+static const ColorConvertKernels colorConvertKernelsScalar = {
+	"scalar",
+	yuvToRgb32RowC,
+	yuvToRgb16RowC,
+	interleaveUVRowC,
+};
+
+const ColorConvertKernels *GetColorConvertKernels(COLOR_CONVERT_IMPL impl) {
+	switch (impl) {
+	case COLOR_CONVERT_BEST:
+		for (int i = COLOR_CONVERT_MAX - 1; i > COLOR_CONVERT_BEST; i--) {
+			const ColorConvertKernels *kernels = GetColorConvertKernels((COLOR_CONVERT_IMPL)i);
+			if (kernels)
+				return kernels;
+		}
+		return &colorConvertKernelsScalar;
+	case COLOR_CONVERT_SCALAR:
+		return &colorConvertKernelsScalar;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	case COLOR_CONVERT_NEON:
+		// build targets neon fpu, so every cpu running it has neon
+		return &ColorConvertKernelsNeon;
+#endif
+#if defined(__SSE2__)
+	case COLOR_CONVERT_SSE2:
+		return &ColorConvertKernelsSse2;
+	case COLOR_CONVERT_AVX2:
+		return __builtin_cpu_supports("avx2") ? &ColorConvertKernelsAvx2 : nullptr;
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+static const ColorConvertKernels *bestKernels;
+static pthread_once_t bestKernelsOnce = PTHREAD_ONCE_INIT;
+
+static void selectBestKernels() {
+	bestKernels = GetColorConvertKernels(COLOR_CONVERT_BEST);
+}
+
+static const ColorConvertKernels *getKernels(const ColorConvertKernels *kernels) {
+	if (kernels)
+		return kernels;
+
+	// slices of one job may ask for it from several workers at once
+	pthread_once(&bestKernelsOnce, selectBestKernels);
+
+	return bestKernels;
+}
+
+void ColorConvertYUV420ToNV12(const ColorConvertKernels *kernels, const ColorPlanes *src, const ColorPlanes *dst,
+                              U32 x, U32 y, U32 width, U32 height) {
+	kernels = getKernels(kernels);
+	x &= ~1;
+	y &= ~1;
+
+	for (U32 row = 0; row < height; row++) {
+		memcpy(dst->data[0] + row * dst->stride[0], src->data[0] + (y + row) * src->stride[0] + x, width);
+	}
+
+	for (U32 row = 0; row < (height + 1) / 2; row++) {
+		kernels->interleaveUVRow(src->data[1] + (y / 2 + row) * src->stride[1] + x / 2,
+		                         src->data[2] + (y / 2 + row) * src->stride[2] + x / 2,
+		                         dst->data[1] + row * dst->stride[1], (width + 1) / 2);
+	}
+}
+
+void ColorConvertYUV420ToRGB32(const ColorConvertKernels *kernels, const ColorPlanes *src, const ColorPlanes *dst,
+                               U32 x, U32 y, U32 width, U32 height) {
+	kernels = getKernels(kernels);
+	x &= ~1;
+	y &= ~1;
+
+	for (U32 row = 0; row < height; row++) {
+		U32 chromaRow = (y + row) / 2;
+		kernels->yuvToRgb32Row(src->data[0] + (y + row) * src->stride[0] + x,
+		                       src->data[1] + chromaRow * src->stride[1] + x / 2,
+		                       src->data[2] + chromaRow * src->stride[2] + x / 2,
+		                       dst->data[0] + row * dst->stride[0], width);
+	}
+}
+
+static void convertScaledRows(const ColorConvertKernels *kernels, const ColorPlanes *src, const ColorPlanes *dst,
+                              U32 bpp, U32 x, U32 y, U32 width, U32 height, U32 dstWidth, U32 dstHeight,
+                              U32 firstRow, U32 lastRow) {
+	kernels = getKernels(kernels);
+	x &= ~1;
+	y &= ~1;
+
+	if (width == 0 || height == 0 || dstWidth == 0 || dstHeight == 0)
+		return;
+
+	void (*convertRow)(const U8 *, const U8 *, const U8 *, U8 *, U32) =
+		(bpp == 16) ? kernels->yuvToRgb16Row : kernels->yuvToRgb32Row;
+	U32 chromaWidth = (dstWidth + 1) / 2;
+	U32 xStep = (width << 16) / dstWidth;
+	U32 yStep = (height << 16) / dstHeight;
+	U32 xMap[dstWidth];
+	U8 scratch[dstWidth + chromaWidth * 2];
+	U8 *lumaRow = scratch, *uRow = scratch + dstWidth, *vRow = uRow + chromaWidth;
+
+	// sample centres, so both edges of source are reached when downscaling
+	for (U32 i = 0; i < dstWidth; i++) {
+		xMap[i] = x + ((i * xStep + xStep / 2) >> 16);
+	}
+
+	for (U32 row = firstRow; row < lastRow; row++) {
+		U32 srcRow = y + ((row * yStep + yStep / 2) >> 16);
+		const U8 *srcY = src->data[0] + srcRow * src->stride[0];
+		const U8 *srcU = src->data[1] + (srcRow / 2) * src->stride[1];
+		const U8 *srcV = src->data[2] + (srcRow / 2) * src->stride[2];
+		U8 *dstRow = dst->data[0] + row * dst->stride[0];
+
+		if (width == dstWidth) {
+			convertRow(srcY + x, srcU + x / 2, srcV + x / 2, dstRow, dstWidth);
+			continue;
+		}
+
+		for (U32 i = 0; i < dstWidth; i++) {
+			lumaRow[i] = srcY[xMap[i]];
+		}
+		for (U32 i = 0; i < chromaWidth; i++) {
+			U32 chroma = xMap[i * 2] / 2;
+			uRow[i] = srcU[chroma];
+			vRow[i] = srcV[chroma];
+		}
+		convertRow(lumaRow, uRow, vRow, dstRow, dstWidth);
+	}
+}
+
+void ColorConvertYUV420ToRGBScaled(const ColorConvertKernels *kernels, const ColorPlanes *src, const ColorPlanes *dst,
+                                   U32 bpp, U32 x, U32 y, U32 width, U32 height, U32 dstWidth, U32 dstHeight) {
+	convertScaledRows(kernels, src, dst, bpp, x, y, width, height, dstWidth, dstHeight, 0, dstHeight);
+}
+
+static void runSlice(void *arg, U32 slice, U32 numSlices) {
+	const ColorConvertJob *job = (const ColorConvertJob *)arg;
+	bool scaled = job->op == COLOR_CONVERT_YUV420_TO_RGB_SCALED;
+	U32 rows = scaled ? job->dstHeight : job->height;
+	// whole multiple of 16 rows keeps slices on separate cache lines for any stride
+	// multiple of 4, even first row keeps chroma rows whole
+	U32 sliceRows = ALIGN2((rows + numSlices - 1) / numSlices, 4);
+	U32 first = MIN(slice * sliceRows, rows);
+	U32 last = MIN(first + sliceRows, rows);
+
+	if (first == last)
+		return;
+
+	if (scaled) {
+		convertScaledRows(job->kernels, &job->src, &job->dst, job->bpp, job->x, job->y,
+		                  job->width, job->height, job->dstWidth, job->dstHeight, first, last);
+		return;
+	}
+
+	ColorPlanes dst = job->dst;
+	dst.data[0] += first * dst.stride[0];
+	if (dst.data[1])
+		dst.data[1] += first / 2 * dst.stride[1];
+	if (dst.data[2])
+		dst.data[2] += first / 2 * dst.stride[2];
+
+	switch (job->op) {
+	case COLOR_CONVERT_YUV420_TO_NV12:
+		ColorConvertYUV420ToNV12(job->kernels, &job->src, &dst, job->x, (job->y & ~1) + first, job->width, last - first);
+		break;
+	case COLOR_CONVERT_YUV420_TO_RGB32:
+		ColorConvertYUV420ToRGB32(job->kernels, &job->src, &dst, job->x, (job->y & ~1) + first, job->width, last - first);
+		break;
+	case COLOR_CONVERT_COPY_NV12:
+		ColorConvertCopyNV12(&job->src, &dst, job->x, (job->y & ~1) + first, job->width, last - first);
+		break;
+	case COLOR_CONVERT_COPY_YUV420:
+		ColorConvertCopyYUV420(&job->src, &dst, job->x, (job->y & ~1) + first, job->width, last - first);
+		break;
+	default:
+		break;
+	}
+}
+
+void ColorConvertRun(WorkerPool *pool, const ColorConvertJob *job) {
+	U32 rows = (job->op == COLOR_CONVERT_YUV420_TO_RGB_SCALED) ? job->dstHeight : job->height;
+
+	if (pool == nullptr)
+		pool = GetWorkerPool();
+
+	// thread handoff costs more than converting few rows
+	U32 numSlices = MIN(pool->getNumThreads(), MAX(rows / 64, 1));
+	pool->run(runSlice, (void *)job, numSlices);
+}
+
+void ColorConvertGetYUVMatrix(COLOR_SPACE space, COLOR_RANGE range, U32 height, float matrix[9], float offset[3]) {
+	if (space == COLOR_SPACE_UNKNOWN)
+		space = height >= 720 ? COLOR_SPACE_BT709 : COLOR_SPACE_BT601;
+
+	float kr = space == COLOR_SPACE_BT709 ? 0.2126f : 0.299f;
+	float kb = space == COLOR_SPACE_BT709 ? 0.0722f : 0.114f;
+	float kg = 1.0f - kr - kb;
+	float lumaScale = 1.0f, chromaScale = 1.0f;
+
+	offset[0] = 0.0f;
+	offset[1] = offset[2] = 128.0f / 255.0f;
+	if (range != COLOR_RANGE_FULL) {
+		lumaScale = 255.0f / 219.0f;
+		chromaScale = 255.0f / 224.0f;
+		offset[0] = 16.0f / 255.0f;
+	}
+
+	// Y column
+	matrix[0] = matrix[1] = matrix[2] = lumaScale;
+	// Cb column
+	matrix[3] = 0.0f;
+	matrix[4] = -chromaScale * (2.0f - 2.0f * kb) * kb / kg;
+	matrix[5] = chromaScale * (2.0f - 2.0f * kb);
+	// Cr column
+	matrix[6] = chromaScale * (2.0f - 2.0f * kr);
+	matrix[7] = -chromaScale * (2.0f - 2.0f * kr) * kr / kg;
+	matrix[8] = 0.0f;
+}
+
+void ColorConvertCopyNV12(const ColorPlanes *src, const ColorPlanes *dst, U32 x, U32 y, U32 width, U32 height) {
+	x &= ~1;
+	y &= ~1;
+
+	// plain row copies, libc memcpy is already vectorized
+	for (U32 row = 0; row < height; row++) {
+		memcpy(dst->data[0] + row * dst->stride[0], src->data[0] + (y + row) * src->stride[0] + x, width);
+	}
+
+	for (U32 row = 0; row < (height + 1) / 2; row++) {
+		memcpy(dst->data[1] + row * dst->stride[1], src->data[1] + (y / 2 + row) * src->stride[1] + x,
+		       ALIGN2(width, 1));
+	}
+}
+
+void ColorConvertCopyYUV420(const ColorPlanes *src, const ColorPlanes *dst, U32 x, U32 y, U32 width, U32 height) {
+	x &= ~1;
+	y &= ~1;
+
+	for (U32 row = 0; row < height; row++) {
+		memcpy(dst->data[0] + row * dst->stride[0], src->data[0] + (y + row) * src->stride[0] + x, width);
+	}
+
+	for (U32 row = 0; row < (height + 1) / 2; row++) {
+		memcpy(dst->data[1] + row * dst->stride[1], src->data[1] + (y / 2 + row) * src->stride[1] + x / 2,
+		       (width + 1) / 2);
+		memcpy(dst->data[2] + row * dst->stride[2], src->data[2] + (y / 2 + row) * src->stride[2] + x / 2,
+		       (width + 1) / 2);
+	}
+}
+
+} // namespace
@@ -0,0 +1,103 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef COLORCONVERT_H
+#define COLORCONVERT_H
+
+#include "basetypes.h"
+#include "avtypes.h"
+
+namespace MediaPLayer {
+
+class WorkerPool;
+
+typedef enum _COLOR_CONVERT_IMPL {
+	COLOR_CONVERT_BEST,
+	COLOR_CONVERT_SCALAR,
+	COLOR_CONVERT_NEON,
+	COLOR_CONVERT_SSE2,
+	COLOR_CONVERT_AVX2,
+	COLOR_CONVERT_MAX
+} COLOR_CONVERT_IMPL;
+
+typedef struct {
+	U8      *data[3];
+	U32     stride[3];
+} ColorPlanes;
+
+// Row kernels, every implementation gives bit exact same output as scalar one.
+typedef struct {
+	const char *name;
+	// count pixels of BT.601 limited range YUV to B,G,R,A bytes (AV_PIX_FMT_RGB32 on little endian),
+	// u and v are at half horizontal resolution
+	void (*yuvToRgb32Row)(const U8 *y, const U8 *u, const U8 *v, U8 *dst, U32 count);
+	// same conversion to RGB565 pixels, red in top bits
+	void (*yuvToRgb16Row)(const U8 *y, const U8 *u, const U8 *v, U8 *dst, U32 count);
+	// count u and v samples to interleaved UV
+	void (*interleaveUVRow)(const U8 *u, const U8 *v, U8 *dst, U32 count);
+} ColorConvertKernels;
+
+// Returns nullptr if implementation is not built in or cpu lacks it.
+const ColorConvertKernels *GetColorConvertKernels(COLOR_CONVERT_IMPL impl);
+
+// Source rectangle starts at x, y (rounded down to even), destination at its planes origin.
+// Null kernels selects fastest implementation.
+void ColorConvertYUV420ToNV12(const ColorConvertKernels *kernels, const ColorPlanes *src, const ColorPlanes *dst,
+                              U32 x, U32 y, U32 width, U32 height);
+void ColorConvertYUV420ToRGB32(const ColorConvertKernels *kernels, const ColorPlanes *src, const ColorPlanes *dst,
+                               U32 x, U32 y, U32 width, U32 height);
+// Nearest neighbour scale of source rectangle to dstWidth x dstHeight while converting,
+// rows are scaled into cache resident scratch and converted straight into destination.
+// bpp is 32 for RGB32 or 16 for RGB565.
+void ColorConvertYUV420ToRGBScaled(const ColorConvertKernels *kernels, const ColorPlanes *src, const ColorPlanes *dst,
+                                   U32 bpp, U32 x, U32 y, U32 width, U32 height, U32 dstWidth, U32 dstHeight);
+void ColorConvertCopyNV12(const ColorPlanes *src, const ColorPlanes *dst, U32 x, U32 y, U32 width, U32 height);
+void ColorConvertCopyYUV420(const ColorPlanes *src, const ColorPlanes *dst, U32 x, U32 y, U32 width, U32 height);
+
+typedef enum _COLOR_CONVERT_OP {
+	COLOR_CONVERT_YUV420_TO_NV12,
+	COLOR_CONVERT_YUV420_TO_RGB32,
+	COLOR_CONVERT_YUV420_TO_RGB_SCALED,
+	COLOR_CONVERT_COPY_NV12,
+	COLOR_CONVERT_COPY_YUV420,
+} COLOR_CONVERT_OP;
+
+// Arguments of one of functions above, dstWidth, dstHeight and bpp only for scaled one.
+typedef struct {
+	COLOR_CONVERT_OP            op;
+	const ColorConvertKernels   *kernels;
+	ColorPlanes                 src;
+	ColorPlanes                 dst;
+	U32                         bpp;
+	U32                         x, y, width, height;
+	U32                         dstWidth, dstHeight;
+} ColorConvertJob;
+
+// Runs job in horizontal slices of destination on pool threads, null pool is shared one.
+void ColorConvertRun(WorkerPool *pool, const ColorConvertJob *job);
+
+// YUV to RGB as rgb = matrix * (yuv - offset), all in 0..1, matrix is column major
+// like GL uniforms. Unknown space is guessed from height, unknown range is limited.
+void ColorConvertGetYUVMatrix(COLOR_SPACE space, COLOR_RANGE range, U32 height, float matrix[9], float offset[3]);
+
+} // namespace
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef COLORCONVERT_KERNELS_H
+#define COLORCONVERT_KERNELS_H
+
+#include "basetypes.h"
+#include "colorconvert.h"
+
+namespace MediaPLayer {
+
+// Fixed point BT.601 limited range, 6 fractional bits:
+//   Y' = ((max(Y, 16) - 16) * 149 >> 1) + 32   (unsigned 16 bit product)
+//   R = (Y' + 102 * Cr) >> 6
+//   G = (Y' - 25 * Cb - 52 * Cr) >> 6
+//   B = (Y' + 129 * Cb) >> 6
+// Each sum saturates to 16 bits like SIMD saturating add, this only clips values
+// which end up as 255 anyway and keeps scalar and SIMD results equal.
+#define COLOR_Y_OFFSET      16
+#define COLOR_Y_MUL         149
+#define COLOR_ROUND         32
+#define COLOR_SHIFT         6
+#define COLOR_CR_R          102
+#define COLOR_CB_G          25
+#define COLOR_CR_G          52
+#define COLOR_CB_B          129
+
+static inline S32 colorSat16(S32 value) {
+	return CLIP(value, -32768, 32767);
+}
+
+static inline U8 colorPixel(S32 value) {
+	return (U8)CLIP(value >> COLOR_SHIFT, 0, 255);
+}
+
+// Scalar rows are also used for tails of SIMD rows, start must be even.
+static inline void yuvToRgb32RowScalar(const U8 *y, const U8 *u, const U8 *v, U8 *dst, U32 start, U32 count) {
+	for (U32 i = start; i < count; i++) {
+		S32 luma = (((MAX(y[i], COLOR_Y_OFFSET) - COLOR_Y_OFFSET) * COLOR_Y_MUL) >> 1) + COLOR_ROUND;
+		S32 cb = u[i / 2] - 128;
+		S32 cr = v[i / 2] - 128;
+		dst[i * 4 + 0] = colorPixel(colorSat16(luma + cb * COLOR_CB_B));
+		dst[i * 4 + 1] = colorPixel(colorSat16(colorSat16(luma - cb * COLOR_CB_G) - cr * COLOR_CR_G));
+		dst[i * 4 + 2] = colorPixel(colorSat16(luma + cr * COLOR_CR_R));
+		dst[i * 4 + 3] = 255;
+	}
+}
+
+static inline void yuvToRgb16RowScalar(const U8 *y, const U8 *u, const U8 *v, U8 *dst, U32 start, U32 count) {
+	U16 *pixels = (U16 *)dst;
+
+	for (U32 i = start; i < count; i++) {
+		S32 luma = (((MAX(y[i], COLOR_Y_OFFSET) - COLOR_Y_OFFSET) * COLOR_Y_MUL) >> 1) + COLOR_ROUND;
+		S32 cb = u[i / 2] - 128;
+		S32 cr = v[i / 2] - 128;
+		U8 b = colorPixel(colorSat16(luma + cb * COLOR_CB_B));
+		U8 g = colorPixel(colorSat16(colorSat16(luma - cb * COLOR_CB_G) - cr * COLOR_CR_G));
+		U8 r = colorPixel(colorSat16(luma + cr * COLOR_CR_R));
+		pixels[i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+	}
+}
+
+static inline void interleaveUVRowScalar(const U8 *u, const U8 *v, U8 *dst, U32 start, U32 count) {
+	for (U32 i = start; i < count; i++) {
+		dst[i * 2 + 0] = u[i];
+		dst[i * 2 + 1] = v[i];
+	}
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+extern const ColorConvertKernels ColorConvertKernelsNeon;
+#endif
+#if defined(__SSE2__)
+extern const ColorConvertKernels ColorConvertKernelsSse2;
+extern const ColorConvertKernels ColorConvertKernelsAvx2;
+#endif
+
+} // namespace
+
+#endif
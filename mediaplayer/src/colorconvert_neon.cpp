@@ -0,0 +1,119 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+#include "basetypes.h"
+#include "colorconvert.h"
+#include "colorconvert_kernels.h"
+
+namespace MediaPLayer {
+
+// 8 pixels of 16 bit luma and chroma to 8 B, G, R bytes
+static inline void yuvToRgbNeon(uint16x8_t y, int16x8_t cb, int16x8_t cr, uint8x8x4_t &pixels) {
+	uint16x8_t offset = vdupq_n_u16(COLOR_Y_OFFSET);
+	uint16x8_t scaled = vmulq_n_u16(vsubq_u16(vmaxq_u16(y, offset), offset), COLOR_Y_MUL);
+	int16x8_t luma = vaddq_s16(vreinterpretq_s16_u16(vshrq_n_u16(scaled, 1)), vdupq_n_s16(COLOR_ROUND));
+	int16x8_t b = vqaddq_s16(luma, vmulq_n_s16(cb, COLOR_CB_B));
+	int16x8_t g = vqsubq_s16(vqsubq_s16(luma, vmulq_n_s16(cb, COLOR_CB_G)), vmulq_n_s16(cr, COLOR_CR_G));
+	int16x8_t r = vqaddq_s16(luma, vmulq_n_s16(cr, COLOR_CR_R));
+
+	// narrowing shift saturates negative values to 0 and large ones to 255
+	pixels.val[0] = vqshrun_n_s16(b, COLOR_SHIFT);
+	pixels.val[1] = vqshrun_n_s16(g, COLOR_SHIFT);
+	pixels.val[2] = vqshrun_n_s16(r, COLOR_SHIFT);
+}
+
+static void yuvToRgb32RowNeon(const U8 *y, const U8 *u, const U8 *v, U8 *dst, U32 count) {
+	uint8x8_t bias = vdup_n_u8(128);
+	uint8x8x4_t pixels;
+	U32 i = 0;
+
+	pixels.val[3] = vdup_n_u8(255);
+
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t luma = vld1q_u8(y + i);
+		// wrapped unsigned difference reinterpreted as signed is u - 128
+		int16x8_t cb = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(u + i / 2), bias));
+		int16x8_t cr = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(v + i / 2), bias));
+		// each chroma sample covers two pixels
+		int16x8x2_t cb2 = vzipq_s16(cb, cb);
+		int16x8x2_t cr2 = vzipq_s16(cr, cr);
+
+		yuvToRgbNeon(vmovl_u8(vget_low_u8(luma)), cb2.val[0], cr2.val[0], pixels);
+		vst4_u8(dst + i * 4, pixels);
+		yuvToRgbNeon(vmovl_u8(vget_high_u8(luma)), cb2.val[1], cr2.val[1], pixels);
+		vst4_u8(dst + i * 4 + 32, pixels);
+	}
+
+	yuvToRgb32RowScalar(y, u, v, dst, i, count);
+}
+
+static void yuvToRgb16RowNeon(const U8 *y, const U8 *u, const U8 *v, U8 *dst, U32 count) {
+	uint8x8_t bias = vdup_n_u8(128);
+	uint8x8x4_t pixels;
+	U32 i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t luma = vld1q_u8(y + i);
+		int16x8_t cb = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(u + i / 2), bias));
+		int16x8_t cr = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(v + i / 2), bias));
+		int16x8x2_t cb2 = vzipq_s16(cb, cb);
+		int16x8x2_t cr2 = vzipq_s16(cr, cr);
+
+		for (int half = 0; half < 2; half++) {
+			yuvToRgbNeon(vmovl_u8(half ? vget_high_u8(luma) : vget_low_u8(luma)), cb2.val[half], cr2.val[half], pixels);
+			// shift right and insert keeps top 5, 6 and 5 bits of r, g, b
+			uint16x8_t rgb = vshll_n_u8(pixels.val[2], 8);
+			rgb = vsriq_n_u16(rgb, vshll_n_u8(pixels.val[1], 8), 5);
+			rgb = vsriq_n_u16(rgb, vshll_n_u8(pixels.val[0], 8), 11);
+			vst1q_u16((uint16_t *)(dst + (i + half * 8) * 2), rgb);
+		}
+	}
+
+	yuvToRgb16RowScalar(y, u, v, dst, i, count);
+}
+
+static void interleaveUVRowNeon(const U8 *u, const U8 *v, U8 *dst, U32 count) {
+	uint8x16x2_t uv;
+	U32 i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		uv.val[0] = vld1q_u8(u + i);
+		uv.val[1] = vld1q_u8(v + i);
+		vst2q_u8(dst + i * 2, uv);
+	}
+
+	interleaveUVRowScalar(u, v, dst, i, count);
+}
+
+const ColorConvertKernels ColorConvertKernelsNeon = {
+	"neon",
+	yuvToRgb32RowNeon,
+	yuvToRgb16RowNeon,
+	interleaveUVRowNeon,
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,194 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+// SSE2 and AVX2 kernels, only for testing and benchmarking on x86 hosts.
+
+#if defined(__SSE2__)
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include "basetypes.h"
+#include "colorconvert.h"
+#include "colorconvert_kernels.h"
+
+namespace MediaPLayer {
+
+// 8 pixels of 16 bit luma and chroma to 16 bit B, G, R before shift
+static inline void yuvToRgbSse2(__m128i y, __m128i cb, __m128i cr, __m128i &b, __m128i &g, __m128i &r) {
+	__m128i offset = _mm_set1_epi16(COLOR_Y_OFFSET);
+	__m128i luma = _mm_mullo_epi16(_mm_sub_epi16(_mm_max_epi16(y, offset), offset), _mm_set1_epi16(COLOR_Y_MUL));
+	luma = _mm_add_epi16(_mm_srli_epi16(luma, 1), _mm_set1_epi16(COLOR_ROUND));
+	b = _mm_adds_epi16(luma, _mm_mullo_epi16(cb, _mm_set1_epi16(COLOR_CB_B)));
+	g = _mm_subs_epi16(_mm_subs_epi16(luma, _mm_mullo_epi16(cb, _mm_set1_epi16(COLOR_CB_G))),
+	                   _mm_mullo_epi16(cr, _mm_set1_epi16(COLOR_CR_G)));
+	r = _mm_adds_epi16(luma, _mm_mullo_epi16(cr, _mm_set1_epi16(COLOR_CR_R)));
+}
+
+// 16 B, G, R bytes to 64 bytes of B,G,R,A
+static inline void storeRgb32Sse2(U8 *dst, __m128i b, __m128i g, __m128i r) {
+	__m128i a = _mm_set1_epi8((char)0xff);
+	__m128i bgLo = _mm_unpacklo_epi8(b, g);
+	__m128i bgHi = _mm_unpackhi_epi8(b, g);
+	__m128i raLo = _mm_unpacklo_epi8(r, a);
+	__m128i raHi = _mm_unpackhi_epi8(r, a);
+	_mm_storeu_si128((__m128i *)(dst + 0), _mm_unpacklo_epi16(bgLo, raLo));
+	_mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi16(bgLo, raLo));
+	_mm_storeu_si128((__m128i *)(dst + 32), _mm_unpacklo_epi16(bgHi, raHi));
+	_mm_storeu_si128((__m128i *)(dst + 48), _mm_unpackhi_epi16(bgHi, raHi));
+}
+
+static void yuvToRgb32RowSse2(const U8 *y, const U8 *u, const U8 *v, U8 *dst, U32 count) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i bias = _mm_set1_epi16(128);
+	U32 i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128i luma = _mm_loadu_si128((const __m128i *)(y + i));
+		__m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + i / 2)), zero), bias);
+		__m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(v + i / 2)), zero), bias);
+		__m128i bLo, gLo, rLo, bHi, gHi, rHi;
+
+		// each chroma sample covers two pixels
+		yuvToRgbSse2(_mm_unpacklo_epi8(luma, zero), _mm_unpacklo_epi16(cb, cb), _mm_unpacklo_epi16(cr, cr),
+		             bLo, gLo, rLo);
+		yuvToRgbSse2(_mm_unpackhi_epi8(luma, zero), _mm_unpackhi_epi16(cb, cb), _mm_unpackhi_epi16(cr, cr),
+		             bHi, gHi, rHi);
+
+		storeRgb32Sse2(dst + i * 4,
+		               _mm_packus_epi16(_mm_srai_epi16(bLo, COLOR_SHIFT), _mm_srai_epi16(bHi, COLOR_SHIFT)),
+		               _mm_packus_epi16(_mm_srai_epi16(gLo, COLOR_SHIFT), _mm_srai_epi16(gHi, COLOR_SHIFT)),
+		               _mm_packus_epi16(_mm_srai_epi16(rLo, COLOR_SHIFT), _mm_srai_epi16(rHi, COLOR_SHIFT)));
+	}
+
+	yuvToRgb32RowScalar(y, u, v, dst, i, count);
+}
+
+// 8 B, G, R values before shift to 8 RGB565 pixels
+static inline __m128i packRgb16Sse2(__m128i b, __m128i g, __m128i r) {
+	__m128i zero = _mm_setzero_si128();
+	// pack and unpack clamps to 0..255 like 8 bit output does
+	b = _mm_unpacklo_epi8(_mm_packus_epi16(_mm_srai_epi16(b, COLOR_SHIFT), zero), zero);
+	g = _mm_unpacklo_epi8(_mm_packus_epi16(_mm_srai_epi16(g, COLOR_SHIFT), zero), zero);
+	r = _mm_unpacklo_epi8(_mm_packus_epi16(_mm_srai_epi16(r, COLOR_SHIFT), zero), zero);
+	return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(_mm_srli_epi16(r, 3), 11),
+	                                 _mm_slli_epi16(_mm_srli_epi16(g, 2), 5)),
+	                    _mm_srli_epi16(b, 3));
+}
+
+static void yuvToRgb16RowSse2(const U8 *y, const U8 *u, const U8 *v, U8 *dst, U32 count) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i bias = _mm_set1_epi16(128);
+	U32 i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128i luma = _mm_loadu_si128((const __m128i *)(y + i));
+		__m128i cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(u + i / 2)), zero), bias);
+		__m128i cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(v + i / 2)), zero), bias);
+		__m128i b, g, r;
+
+		yuvToRgbSse2(_mm_unpacklo_epi8(luma, zero), _mm_unpacklo_epi16(cb, cb), _mm_unpacklo_epi16(cr, cr), b, g, r);
+		_mm_storeu_si128((__m128i *)(dst + i * 2), packRgb16Sse2(b, g, r));
+		yuvToRgbSse2(_mm_unpackhi_epi8(luma, zero), _mm_unpackhi_epi16(cb, cb), _mm_unpackhi_epi16(cr, cr), b, g, r);
+		_mm_storeu_si128((__m128i *)(dst + i * 2 + 16), packRgb16Sse2(b, g, r));
+	}
+
+	yuvToRgb16RowScalar(y, u, v, dst, i, count);
+}
+
+static void interleaveUVRowSse2(const U8 *u, const U8 *v, U8 *dst, U32 count) {
+	U32 i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128i cb = _mm_loadu_si128((const __m128i *)(u + i));
+		__m128i cr = _mm_loadu_si128((const __m128i *)(v + i));
+		_mm_storeu_si128((__m128i *)(dst + i * 2), _mm_unpacklo_epi8(cb, cr));
+		_mm_storeu_si128((__m128i *)(dst + i * 2 + 16), _mm_unpackhi_epi8(cb, cr));
+	}
+
+	interleaveUVRowScalar(u, v, dst, i, count);
+}
+
+const ColorConvertKernels ColorConvertKernelsSse2 = {
+	"sse2",
+	yuvToRgb32RowSse2,
+	yuvToRgb16RowSse2,
+	interleaveUVRowSse2,
+};
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+AVX2_TARGET static inline __m128i packPixelsAvx2(__m256i value) {
+	value = _mm256_srai_epi16(value, COLOR_SHIFT);
+	return _mm_packus_epi16(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+}
+
+AVX2_TARGET static void yuvToRgb32RowAvx2(const U8 *y, const U8 *u, const U8 *v, U8 *dst, U32 count) {
+	__m256i offset = _mm256_set1_epi16(COLOR_Y_OFFSET);
+	__m256i mul = _mm256_set1_epi16(COLOR_Y_MUL);
+	__m256i round = _mm256_set1_epi16(COLOR_ROUND);
+	__m256i bias = _mm256_set1_epi16(128);
+	U32 i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128i cb8 = _mm_loadl_epi64((const __m128i *)(u + i / 2));
+		__m128i cr8 = _mm_loadl_epi64((const __m128i *)(v + i / 2));
+		__m256i luma = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + i)));
+		// each chroma sample covers two pixels
+		__m256i cb = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cb8, cb8)), bias);
+		__m256i cr = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(cr8, cr8)), bias);
+
+		luma = _mm256_mullo_epi16(_mm256_sub_epi16(_mm256_max_epi16(luma, offset), offset), mul);
+		luma = _mm256_add_epi16(_mm256_srli_epi16(luma, 1), round);
+		__m256i b = _mm256_adds_epi16(luma, _mm256_mullo_epi16(cb, _mm256_set1_epi16(COLOR_CB_B)));
+		__m256i g = _mm256_subs_epi16(_mm256_subs_epi16(luma, _mm256_mullo_epi16(cb, _mm256_set1_epi16(COLOR_CB_G))),
+		                              _mm256_mullo_epi16(cr, _mm256_set1_epi16(COLOR_CR_G)));
+		__m256i r = _mm256_adds_epi16(luma, _mm256_mullo_epi16(cr, _mm256_set1_epi16(COLOR_CR_R)));
+
+		storeRgb32Sse2(dst + i * 4, packPixelsAvx2(b), packPixelsAvx2(g), packPixelsAvx2(r));
+	}
+
+	yuvToRgb32RowScalar(y, u, v, dst, i, count);
+}
+
+AVX2_TARGET static void interleaveUVRowAvx2(const U8 *u, const U8 *v, U8 *dst, U32 count) {
+	U32 i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m256i cb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(u + i)));
+		__m256i cr = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(v + i)));
+		_mm256_storeu_si256((__m256i *)(dst + i * 2), _mm256_or_si256(cb, _mm256_slli_epi16(cr, 8)));
+	}
+
+	interleaveUVRowScalar(u, v, dst, i, count);
+}
+
+const ColorConvertKernels ColorConvertKernelsAvx2 = {
+	"avx2",
+	yuvToRgb32RowAvx2,
+	// bandwidth bound, sse2 version is as fast
+	yuvToRgb16RowSse2,
+	interleaveUVRowAvx2,
+};
+
+} // namespace
+
+#endif
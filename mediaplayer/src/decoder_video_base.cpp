@@ -30,7 +30,10 @@
 namespace MediaPLayer {
 
 DecoderVideo::DecoderVideo() :
-		_initialized(false), _bpp(0) {
+		_initialized(false), _bpp(0), _outputQueueDepth(0) {
+	_threadConfig.threads = 0;
+	_threadConfig.types = DECODER_THREAD_FRAME | DECODER_THREAD_SLICE;
+	_threadConfig.cpuMask = 0;
 };
 
 DecoderVideo *CreateDecoderVideo(DECODER_TYPE decoderType) {
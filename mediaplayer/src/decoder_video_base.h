@@ -28,6 +28,10 @@
 
 namespace MediaPLayer {
 
+#define DECODER_THREAD_FRAME  (1 << 0)
+#define DECODER_THREAD_SLICE  (1 << 1)
+#define DECODER_MAX_THREADS   16
+
 #pragma pack(1)
 
 typedef struct {
@@ -36,10 +40,27 @@ typedef struct {
 	FORMAT_VIDEO pixelfmt; // pixel format of decoded video frame
 	U32 width, height; // target aligned width and height
 	U32 dx, dy, dw, dh; // border of decoded frame data
+	S64 pts; // presentation timestamp in microseconds or PTS_NONE
+	void *displayBuffer; // DisplayVideoBuffer software decoder rendered into, nullptr if none
+	COLOR_SPACE colorSpace; // YUV matrix signalled by stream, unknown leaves choice to display
+	COLOR_RANGE colorRange;
 	bool interlaced;
 	bool anistropicDVD;
 } VideoFrame;
 
+typedef struct {
+	U32 inputBuffers;      // demuxer buffers in ring
+	U32 maxInputInFlight;  // most buffers filled ahead of decoder, including one in decode
+	U64 decodes;
+	U64 overlappedDecodes; // decodes started with next buffer already filled
+} DecoderVideoStats;
+
+typedef struct {
+	U32 threads;  // 0 uses all online cores, 1 disables threading
+	U32 types;    // allowed DECODER_THREAD_* methods
+	U32 cpuMask;  // cpus for decoder threads, 0 leaves placement to kernel
+} DecoderVideoThreadConfig;
+
 #pragma pack()
 
 class Display;
@@ -49,6 +70,8 @@ protected:
 
 	bool _initialized;
 	U32 _bpp;
+	U32 _outputQueueDepth;
+	DecoderVideoThreadConfig _threadConfig;
 
 public:
 
@@ -59,10 +82,19 @@ public:
 	virtual STATUS init(Demuxer *demuxer, Display *display) = 0;
 	virtual STATUS deinit() = 0;
 	virtual void getDemuxerBuffer(StreamFrame *streamFrame) = 0;
+	virtual void commitDemuxerBuffer(StreamFrame * /*streamFrame*/) {}
+	virtual U32 getNumDemuxerBuffers() { return 0; }
 	virtual STATUS decodeFrame(bool &frameReady, StreamFrame *streamFrame) = 0;
 	virtual STATUS getVideoStreamOutputFrame(Demuxer *demuxer, VideoFrame *videoFrame) = 0;
 	virtual STATUS flush() = 0;
+	// at end of stream: returns frames decoder still holds, frameReady false once empty
+	virtual STATUS drain(bool &frameReady) { frameReady = false; return S_OK; }
+	// more frames ready after getVideoStreamOutputFrame()
+	virtual bool hasPendingFrame() { return false; }
+	virtual STATUS getStats(DecoderVideoStats * /*stats*/) { return S_FAIL; }
 	U32 getBPP() { return _bpp; }
+	void setOutputQueueDepth(U32 depth) { _outputQueueDepth = depth; }
+	void setThreadConfig(DecoderVideoThreadConfig *config) { _threadConfig = *config; }
 	virtual FORMAT_VIDEO getVideoFmt(Demuxer *demuxer) = 0;
 	virtual int getVideoWidth(Demuxer *demuxer) = 0;
 	virtual int getVideoHeight(Demuxer *demuxer) = 0;
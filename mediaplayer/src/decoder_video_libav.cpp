@@ -19,21 +19,39 @@
  *
  */
 
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <string.h>
+
 #include "basetypes.h"
 #include "logs.h"
 #include "decoder_video_base.h"
 #include "decoder_video_libav.h"
 #include "demuxer_libav.h"
+#include "display_base.h"
+#include "h264_sps.h"
+
+extern "C" {
+#include <libavutil/cpu.h>
+}
 
 namespace MediaPLayer {
 
 DecoderVideoLibAV::DecoderVideoLibAV() :
-		_avc(nullptr), _avcodec(nullptr), _avframe(nullptr), _bsfc(nullptr) {
+		_avc(nullptr), _avcodec(nullptr), _avframe(nullptr), _bsfc(nullptr), _outputDelay(0),
+		_numQueued(0), _draining(false), _display(nullptr), _numDirectBuffers(0),
+		_directWidth(0), _directHeight(0), _directFormat(AV_PIX_FMT_NONE),
+		_directFrames(0), _fallbackFrames(0) {
 	_avframe = av_frame_alloc();
+	memset(_frameQueue, 0, sizeof(_frameQueue));
+	memset((void *)_directBuffers, 0, sizeof(_directBuffers));
+	pthread_mutex_init(&_directLock, nullptr);
 }
 
 DecoderVideoLibAV::~DecoderVideoLibAV() {
 	deinit();
+	pthread_mutex_destroy(&_directLock);
 }
 
 bool DecoderVideoLibAV::isCapable(Demuxer *demuxer) {
@@ -122,20 +140,73 @@ STATUS DecoderVideoLibAV::init(Demuxer *demuxer, Display *display) {
 		goto fail;
 	}
 
+	for (int i = 0; i < DECODER_LIBAV_FRAME_QUEUE_SIZE; i++) {
+		_frameQueue[i] = av_frame_alloc();
+		if (_frameQueue[i] == nullptr) {
+			log->printf("DecoderVideoLibAV::init(): av_frame_alloc() failed\n");
+			goto fail;
+		}
+	}
+	_numQueued = 0;
+	_draining = false;
+
+	setupThreads();
+
+	// display buffers are allocated here, display may not allow it from codec threads
+	_display = display;
+	initDirectBuffers(&info);
+	if (_numDirectBuffers > 0) {
+		_avc->opaque = this;
+		_avc->get_buffer2 = getBuffer2;
+	}
+
+	// codec threads are spawned in avcodec_open2() and inherit its affinity
+	cpu_set_t oldCpus;
+	if (_threadConfig.cpuMask) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		for (int i = 0; i < 32; i++) {
+			if (_threadConfig.cpuMask & (1U << i))
+				CPU_SET(i, &cpus);
+		}
+		if (pthread_getaffinity_np(pthread_self(), sizeof(oldCpus), &oldCpus) != 0 ||
+		    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+			log->printf("DecoderVideoLibAV::init(): failed set cpu mask 0x%x\n", _threadConfig.cpuMask);
+			_threadConfig.cpuMask = 0;
+		}
+	}
+
 	err = avcodec_open2(_avc, _avcodec, nullptr);
+
+	if (_threadConfig.cpuMask) {
+		pthread_setaffinity_np(pthread_self(), sizeof(oldCpus), &oldCpus);
+	}
+
 	if (err != 0) {
 		log->printf("DecoderVideoLibAV::init(): avcodec_open2() failed: %d\n", err);
 		goto fail;
 	}
 
+	// frame threading holds one frame per extra thread before first output
+	_outputDelay = (_avc->active_thread_type & FF_THREAD_FRAME) ? _avc->thread_count - 1 : 0;
+	log->printf("DecoderVideoLibAV::init(): %d threads, %s threading, output delay %d frames\n",
+	            _avc->thread_count,
+	            (_avc->active_thread_type & FF_THREAD_FRAME) ? "frame" :
+	            (_avc->active_thread_type & FF_THREAD_SLICE) ? "slice" : "no",
+	            _outputDelay);
+
 	_initialized = true;
 
 	return S_OK;
 fail:
+	for (int i = 0; i < DECODER_LIBAV_FRAME_QUEUE_SIZE; i++) {
+		av_frame_free(&_frameQueue[i]);
+	}
 	if (_avc) {
 	    avcodec_free_context(&_avc);
 		_avc = nullptr;
 	}
+	freeDirectBuffers();
 	return S_FAIL;
 }
 
@@ -145,6 +216,10 @@ STATUS DecoderVideoLibAV::deinit() {
 	}
 	av_frame_free(&_avframe);
 	_avframe = nullptr;
+	for (int i = 0; i < DECODER_LIBAV_FRAME_QUEUE_SIZE; i++) {
+		av_frame_free(&_frameQueue[i]);
+	}
+	_numQueued = 0;
 
 	if (_bsfc) {
 		 av_bsf_free(&_bsfc);
@@ -154,6 +229,13 @@ STATUS DecoderVideoLibAV::deinit() {
     avcodec_free_context(&_avc);
 	_avc = nullptr;
 
+	// all frames referencing display buffers are gone with codec context
+	if (_numDirectBuffers > 0) {
+		log->printf("DecoderVideoLibAV::deinit(): direct rendered frames: %llu, fallback frames: %llu\n",
+		            _directFrames, _fallbackFrames);
+	}
+	freeDirectBuffers();
+
 	return S_OK;
 }
 
@@ -177,18 +259,89 @@ STATUS DecoderVideoLibAV::decodeFrame(bool &frameReady, StreamFrame *streamFrame
 		return S_FAIL;
 	}
 
-	int status;
-	status = avcodec_send_packet(_avc, static_cast<AVPacket *>(streamFrame->priv)) != 0;
-	if (status != 0) {
+	AVPacket *packet = static_cast<AVPacket *>(streamFrame->priv);
+	int status = avcodec_send_packet(_avc, packet);
+	if (status == AVERROR(EAGAIN)) {
+		// decoder output is full, move frames to queue and feed packet again
+		if (receiveFrames() != S_OK) {
+			return S_FAIL;
+		}
+		status = avcodec_send_packet(_avc, packet);
+	}
+	if (status < 0) {
 		log->printf("DecoderVideoLibAV::decodeFrame(): avcodec_send_packet failed, status: %d\n", status);
 		return S_FAIL;
 	}
-	status = avcodec_receive_frame(_avc, _avframe);
-	if (status < 0 && status != AVERROR(EAGAIN) && status != AVERROR_EOF) {
-		log->printf("DecoderVideoLibAV::decodeFrame(): avcodec_receive_frame failed, status: %d\n", status);
+
+	if (receiveFrames() != S_OK) {
 		return S_FAIL;
-	} else if (status == 0) {
-		frameReady = true;
+	}
+	frameReady = _numQueued > 0;
+
+	return S_OK;
+}
+
+STATUS DecoderVideoLibAV::drain(bool &frameReady) {
+	frameReady = false;
+
+	if (_initialized == false) {
+		log->printf("DecoderVideoLibAV::drain(): not initialized!\n");
+		return S_FAIL;
+	}
+
+	if (!_draining) {
+		int status = avcodec_send_packet(_avc, nullptr);
+		if (status < 0 && status != AVERROR_EOF) {
+			log->printf("DecoderVideoLibAV::drain(): avcodec_send_packet failed, status: %d\n", status);
+			return S_FAIL;
+		}
+		_draining = true;
+	}
+
+	if (receiveFrames() != S_OK) {
+		return S_FAIL;
+	}
+	frameReady = _numQueued > 0;
+
+	return S_OK;
+}
+
+STATUS DecoderVideoLibAV::flush() {
+	if (_initialized == false) {
+		return S_FAIL;
+	}
+
+	avcodec_flush_buffers(_avc);
+	for (int i = 0; i < _numQueued; i++) {
+		av_frame_unref(_frameQueue[i]);
+	}
+	_numQueued = 0;
+	_draining = false;
+
+	return S_OK;
+}
+
+STATUS DecoderVideoLibAV::receiveFrames() {
+	while (_numQueued < DECODER_LIBAV_FRAME_QUEUE_SIZE) {
+		AVFrame *frame = _frameQueue[_numQueued];
+		int status = avcodec_receive_frame(_avc, frame);
+		if (status == AVERROR(EAGAIN) || status == AVERROR_EOF) {
+			break;
+		} else if (status < 0) {
+			log->printf("DecoderVideoLibAV::receiveFrames(): avcodec_receive_frame failed, status: %d\n", status);
+			return S_FAIL;
+		}
+
+		// keep queue in presentation order, frames without timestamp stay in decode order
+		int pos = _numQueued++;
+		if (frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+			while (pos > 0 && _frameQueue[pos - 1]->best_effort_timestamp != AV_NOPTS_VALUE &&
+			       _frameQueue[pos - 1]->best_effort_timestamp > frame->best_effort_timestamp) {
+				_frameQueue[pos] = _frameQueue[pos - 1];
+				pos--;
+			}
+			_frameQueue[pos] = frame;
+		}
 	}
 
 	return S_OK;
@@ -211,6 +364,19 @@ STATUS DecoderVideoLibAV::getVideoStreamOutputFrame(Demuxer *demuxer, VideoFrame
 		return S_FAIL;
 	}
 
+	if (_numQueued == 0) {
+		log->printf("DecoderVideoLibAV::getVideoStreamOutputFrame(): no decoded frame\n");
+		return S_FAIL;
+	}
+
+	// previous output frame is released here, head of queue becomes current
+	AVFrame *frame = _frameQueue[0];
+	av_frame_unref(_avframe);
+	av_frame_move_ref(_avframe, frame);
+	_numQueued--;
+	memmove(&_frameQueue[0], &_frameQueue[1], _numQueued * sizeof(AVFrame *));
+	_frameQueue[_numQueued] = frame;
+
 	videoFrame->pixelfmt = info.pixelfmt;
 	videoFrame->data[0] = _avframe->data[0];
 	videoFrame->data[1] = _avframe->data[1];
@@ -222,14 +388,247 @@ STATUS DecoderVideoLibAV::getVideoStreamOutputFrame(Demuxer *demuxer, VideoFrame
 	videoFrame->stride[3] = _avframe->linesize[3];
 	videoFrame->width = _avframe->width;
 	videoFrame->height = _avframe->height;
+	videoFrame->displayBuffer = nullptr;
+	DirectBuffer *directBuffer = findDirectBuffer(_avframe);
+	if (directBuffer) {
+		// display sees whole buffer, visible part is in dx/dy/dw/dh
+		videoFrame->displayBuffer = &directBuffer->buffer;
+		videoFrame->width = _directWidth;
+		videoFrame->height = _directHeight;
+	}
 	videoFrame->dx = 0;
 	videoFrame->dy = 0;
 	videoFrame->dw = info.width;
 	videoFrame->dh = info.height;
+	switch (_avframe->colorspace) {
+	case AVCOL_SPC_BT709:
+		videoFrame->colorSpace = COLOR_SPACE_BT709;
+		break;
+	case AVCOL_SPC_BT470BG:
+	case AVCOL_SPC_SMPTE170M:
+		videoFrame->colorSpace = COLOR_SPACE_BT601;
+		break;
+	default:
+		videoFrame->colorSpace = COLOR_SPACE_UNKNOWN;
+		break;
+	}
+	switch (_avframe->color_range) {
+	case AVCOL_RANGE_MPEG:
+		videoFrame->colorRange = COLOR_RANGE_LIMITED;
+		break;
+	case AVCOL_RANGE_JPEG:
+		videoFrame->colorRange = COLOR_RANGE_FULL;
+		break;
+	default:
+		videoFrame->colorRange = COLOR_RANGE_UNKNOWN;
+		break;
+	}
+	if (_avframe->best_effort_timestamp != AV_NOPTS_VALUE) {
+		videoFrame->pts = av_rescale_q(_avframe->best_effort_timestamp, _avc->pkt_timebase, AV_TIME_BASE_Q);
+	} else {
+		videoFrame->pts = PTS_NONE;
+	}
 
 	return S_OK;
 }
 
+void DecoderVideoLibAV::setupThreads() {
+	int threads = _threadConfig.threads;
+
+	if (threads == 0) {
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads < 1)
+			threads = 1;
+	}
+	threads = MIN(threads, DECODER_MAX_THREADS);
+
+	_avc->thread_count = threads;
+	_avc->thread_type = 0;
+	if (_threadConfig.types & DECODER_THREAD_FRAME)
+		_avc->thread_type |= FF_THREAD_FRAME;
+	if (_threadConfig.types & DECODER_THREAD_SLICE)
+		_avc->thread_type |= FF_THREAD_SLICE;
+	if (_avc->thread_type == 0)
+		_avc->thread_count = 1;
+}
+
+void DecoderVideoLibAV::initDirectBuffers(StreamVideoInfo *info) {
+	int linesizeAlign[AV_NUM_DATA_POINTERS];
+	int width = info->width, height = info->height;
+	U32 align = av_cpu_max_align();
+	U32 numRefs;
+	int numBuffers;
+
+	_numDirectBuffers = 0;
+	_directFrames = _fallbackFrames = 0;
+
+	if (_display == nullptr || !(_avcodec->capabilities & AV_CODEC_CAP_DR1))
+		return;
+
+	switch (info->pixelfmt) {
+	case FMT_YUV420P:
+		_directFormat = AV_PIX_FMT_YUV420P;
+		break;
+	case FMT_NV12:
+		_directFormat = AV_PIX_FMT_NV12;
+		break;
+	default:
+		return;
+	}
+
+	// codec output format is fixed, buffers are only worth it if display takes that format as is
+	if (!_display->isVideoFormatSupported(info->pixelfmt)) {
+		log->printf("DecoderVideoLibAV::initDirectBuffers(): display can't show decoded format directly, using copy path\n");
+		return;
+	}
+
+	switch (info->codecId) {
+	case CODEC_ID_H264:
+		numRefs = GetH264MaxDpbFrames(info->profileLevel, (info->width + 15) / 16, (info->height + 15) / 16);
+		if (info->maxDecFrameBuffering > 0)
+			numRefs = numRefs ? MIN(numRefs, info->maxDecFrameBuffering) : info->maxDecFrameBuffering;
+		if (numRefs == 0)
+			numRefs = 16;
+		break;
+	case CODEC_ID_HEVC:
+		numRefs = 16;
+		break;
+	case CODEC_ID_VP9:
+		numRefs = 8;
+		break;
+	case CODEC_ID_VP8:
+		numRefs = 3;
+		break;
+	default:
+		numRefs = 2;
+		break;
+	}
+
+	// references, picture being decoded, one per extra frame thread, queued and displayed frames
+	numBuffers = numRefs + 1 + 2 + _outputQueueDepth;
+	if (_avc->thread_type & FF_THREAD_FRAME)
+		numBuffers += _avc->thread_count - 1;
+	numBuffers = MIN(numBuffers, DECODER_LIBAV_DIRECT_BUFFERS);
+
+	// codec writes past visible area, planar chroma stride must keep alignment too
+	_avc->pix_fmt = _directFormat;
+	avcodec_align_dimensions2(_avc, &width, &height, linesizeAlign);
+	_directWidth = ALIGN2(width, 7);
+	_directHeight = ALIGN2(height, 1);
+
+	for (int i = 0; i < numBuffers; i++) {
+		DirectBuffer *directBuffer = &_directBuffers[i];
+		DisplayVideoBuffer *db = &directBuffer->buffer;
+		memset((void *)directBuffer, 0, sizeof(DirectBuffer));
+		if (_display->getDisplayVideoBuffer(db, info->pixelfmt, _directWidth, _directHeight) != S_OK) {
+			if (i == 0)
+				log->printf("DecoderVideoLibAV::initDirectBuffers(): display has no buffers, using copy path\n");
+			break;
+		}
+		directBuffer->decoder = this;
+		_numDirectBuffers++;
+
+		// display may substitute layout it can scan out
+		bool usable = db->pixelfmt == info->pixelfmt && db->ptr != nullptr;
+		for (int p = 0; p < 3 && usable; p++) {
+			if (db->stride[p] % align || db->offset[p] % align ||
+			    (linesizeAlign[p] && db->stride[p] % linesizeAlign[p]))
+				usable = false;
+		}
+		if (!usable) {
+			log->printf("DecoderVideoLibAV::initDirectBuffers(): display buffer layout not usable, using copy path\n");
+			freeDirectBuffers();
+			return;
+		}
+	}
+
+	if (_numDirectBuffers > 0) {
+		log->printf("DecoderVideoLibAV::initDirectBuffers(): %d direct buffers %dx%d\n",
+		            _numDirectBuffers, _directWidth, _directHeight);
+	}
+}
+
+void DecoderVideoLibAV::freeDirectBuffers() {
+	for (int i = 0; i < _numDirectBuffers; i++) {
+		_display->releaseDisplayVideoBuffer(&_directBuffers[i].buffer);
+	}
+	memset((void *)_directBuffers, 0, sizeof(_directBuffers));
+	_numDirectBuffers = 0;
+}
+
+DecoderVideoLibAV::DirectBuffer *DecoderVideoLibAV::findDirectBuffer(AVFrame *frame) {
+	if (_numDirectBuffers == 0 || frame->buf[0] == nullptr)
+		return nullptr;
+
+	void *opaque = av_buffer_get_opaque(frame->buf[0]);
+	for (int i = 0; i < _numDirectBuffers; i++) {
+		if (opaque == &_directBuffers[i])
+			return &_directBuffers[i];
+	}
+
+	return nullptr;
+}
+
+// Called from codec threads with frame threading.
+int DecoderVideoLibAV::getBuffer2(AVCodecContext *avc, AVFrame *frame, int flags) {
+	DecoderVideoLibAV *decoder = static_cast<DecoderVideoLibAV *>(avc->opaque);
+	DirectBuffer *directBuffer = nullptr;
+	int linesizeAlign[AV_NUM_DATA_POINTERS];
+	int width = frame->width, height = frame->height;
+
+	if (frame->format == decoder->_directFormat) {
+		avcodec_align_dimensions2(avc, &width, &height, linesizeAlign);
+	}
+
+	pthread_mutex_lock(&decoder->_directLock);
+	if (frame->format == decoder->_directFormat &&
+	    width <= decoder->_directWidth && height <= decoder->_directHeight) {
+		// display keeps buffer locked until it is scanned out, it clears flag
+		// without _directLock, acquire pairs with its release
+		for (int i = 0; i < decoder->_numDirectBuffers; i++) {
+			DirectBuffer *buffer = &decoder->_directBuffers[i];
+			if (!buffer->inUse && !buffer->buffer.locked.load(std::memory_order_acquire)) {
+				buffer->inUse = true;
+				directBuffer = buffer;
+				break;
+			}
+		}
+	}
+	if (directBuffer)
+		decoder->_directFrames++;
+	else
+		decoder->_fallbackFrames++;
+	pthread_mutex_unlock(&decoder->_directLock);
+
+	if (directBuffer == nullptr)
+		return avcodec_default_get_buffer2(avc, frame, flags);
+
+	DisplayVideoBuffer *db = &directBuffer->buffer;
+	frame->buf[0] = av_buffer_create((uint8_t *)db->ptr, db->size, releaseBuffer, directBuffer, 0);
+	if (frame->buf[0] == nullptr) {
+		releaseBuffer(directBuffer, nullptr);
+		return AVERROR(ENOMEM);
+	}
+
+	int numPlanes = (decoder->_directFormat == AV_PIX_FMT_NV12) ? 2 : 3;
+	for (int i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+		frame->data[i] = (i < numPlanes) ? (uint8_t *)db->ptr + db->offset[i] : nullptr;
+		frame->linesize[i] = (i < numPlanes) ? db->stride[i] : 0;
+	}
+	frame->extended_data = frame->data;
+
+	return 0;
+}
+
+void DecoderVideoLibAV::releaseBuffer(void *opaque, uint8_t * /*data*/) {
+	DirectBuffer *directBuffer = static_cast<DirectBuffer *>(opaque);
+	DecoderVideoLibAV *decoder = directBuffer->decoder;
+
+	pthread_mutex_lock(&decoder->_directLock);
+	directBuffer->inUse = false;
+	pthread_mutex_unlock(&decoder->_directLock);
+}
+
 FORMAT_VIDEO DecoderVideoLibAV::getVideoFmt(Demuxer *demuxer)
 {
 	StreamVideoInfo info;
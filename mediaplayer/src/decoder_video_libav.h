@@ -22,8 +22,11 @@
 #ifndef DECODER_VIDEO_LIBAV_H
 #define DECODER_VIDEO_LIBAV_H
 
+#include <pthread.h>
+
 #include "basetypes.h"
 #include "decoder_video_base.h"
+#include "display_base.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -32,13 +35,34 @@ extern "C" {
 
 namespace MediaPLayer {
 
+#define DECODER_LIBAV_FRAME_QUEUE_SIZE  16
+#define DECODER_LIBAV_DIRECT_BUFFERS    32
+
 class DecoderVideoLibAV : public DecoderVideo {
 private:
 
+	typedef struct {
+		DisplayVideoBuffer   buffer;
+		DecoderVideoLibAV    *decoder;
+		bool                 inUse;   // referenced by libav frame
+	} DirectBuffer;
+
 	AVCodecContext       *_avc;
 	const AVCodec        *_avcodec;
 	AVFrame              *_avframe;
 	AVBSFContext         *_bsfc;
+	int                  _outputDelay;
+	AVFrame              *_frameQueue[DECODER_LIBAV_FRAME_QUEUE_SIZE]; // first _numQueued in pts order, rest free
+	int                  _numQueued;
+	bool                 _draining;
+	Display              *_display;
+	DirectBuffer         _directBuffers[DECODER_LIBAV_DIRECT_BUFFERS];
+	int                  _numDirectBuffers;
+	int                  _directWidth, _directHeight;
+	AVPixelFormat        _directFormat;
+	pthread_mutex_t      _directLock;
+	U64                  _directFrames;
+	U64                  _fallbackFrames;
 
 public:
 
@@ -49,12 +73,24 @@ public:
 	STATUS init(Demuxer *demuxer, Display *display);
 	STATUS deinit();
 	STATUS decodeFrame(bool &frameReady, StreamFrame *streamFrame);
-	STATUS flush() { return S_OK; }
+	STATUS flush();
+	STATUS drain(bool &frameReady);
+	bool hasPendingFrame() { return _numQueued > 0; }
 	void getDemuxerBuffer(StreamFrame *streamFrame);
 	STATUS getVideoStreamOutputFrame(Demuxer *demuxer, VideoFrame *videoFrame);
 	FORMAT_VIDEO getVideoFmt(Demuxer *demuxer);
 	int getVideoWidth(Demuxer *demuxer);
 	int getVideoHeight(Demuxer *demuxer);
+
+private:
+
+	void setupThreads();
+	STATUS receiveFrames();
+	void initDirectBuffers(StreamVideoInfo *info);
+	void freeDirectBuffers();
+	DirectBuffer *findDirectBuffer(AVFrame *frame);
+	static int getBuffer2(AVCodecContext *avc, AVFrame *frame, int flags);
+	static void releaseBuffer(void *opaque, uint8_t *data);
 };
 
 } // namespace
@@ -22,6 +22,7 @@
 #include "basetypes.h"
 #include "logs.h"
 #include "decoder_video_libdce.h"
+#include "h264_sps.h"
 #include "display_base.h"
 #include <string.h>
 #include <stdlib.h>
@@ -33,10 +34,15 @@ DecoderVideoLibDCE::DecoderVideoLibDCE() :
 		_display(nullptr), _codecEngine(nullptr), _codecHandle(nullptr), _codecParams(nullptr), _codecDynParams(nullptr),
 		_codecStatus(0), _codecInputBufs(nullptr), _codecOutputBufs(nullptr),
 		_codecInputArgs(nullptr), _codecOutputArgs(nullptr), _drmFd(0),
-		_frameWidth(0), _frameHeight(0),_inputBufPtr(nullptr), _inputBufSize(0), _inputBufHandle(0),
-		_numFrameBuffers(0), _frameBuffers(nullptr),
+		_frameWidth(0), _frameHeight(0), _numInputBuffers(0), _inputWriteIndex(0),
+		_inputCommitted(0), _inputDecoded(0),
+		_numFrameBuffers(0), _maxFrameBuffers(0), _frameBuffers(nullptr),
+		_freeHead(nullptr), _freeTail(nullptr), _parkedHead(nullptr), _parkedTail(nullptr),
+		_inputMetadata(nullptr),
 		_codecId(CODEC_ID_NONE) {
 	_bpp = 2;
+	memset(_inputBuffers, 0, sizeof(_inputBuffers));
+	memset(&_stats, 0, sizeof(_stats));
 }
 
 DecoderVideoLibDCE::~DecoderVideoLibDCE() {
@@ -114,15 +120,14 @@ STATUS DecoderVideoLibDCE::init(Demuxer *demuxer, Display *display) {
 	DisplayHandle displayHandle;
 	Int32 codecError;
 	int dpbSizeInFrames = 0;
-	struct drm_mode_create_dumb creq;
-	struct drm_mode_map_dumb mreq;
-	struct drm_prime_handle dreq;
+	int initialFrameBuffers;
 
 	_display = display;
 	if (display->getHandle(&displayHandle) != S_OK) {
 		log->printf("DecoderVideoLibDCE::init(): failed get display handle!\n");
 		goto fail;
 	}
+	_drmFd = displayHandle.handle;
 
 	StreamVideoInfo info;
 	if (demuxer->getVideoStreamInfo(&info) != S_OK) {
@@ -151,44 +156,29 @@ STATUS DecoderVideoLibDCE::init(Demuxer *demuxer, Display *display) {
 		break;
 	case CODEC_ID_H264:
 		_codecId = CODEC_ID_H264;
-		int maxDpb;
-		switch (info.profileLevel) {
-		case 30:
-			maxDpb = 8100;
-			break;
-		case 31:
-			maxDpb = 18100;
-			break;
-		case 32:
-			maxDpb = 20480;
-			break;
-		case 40:
-		case 41:
-			maxDpb = 32768;
-			break;
-		case 42:
-			maxDpb = 34816;
-			break;
-		case 50:
-			maxDpb = 110400;
-			break;
-		case 51:
-		case 52:
-			maxDpb = 184320;
-			break;
-		default:
-			log->printf("DecoderVideoLibDCE::init(): not supported profile level: %d\n", info.profileLevel);
+		dpbSizeInFrames = GetH264MaxDpbFrames(info.profileLevel, (info.width + 15) / 16, (info.height + 15) / 16);
+		if (dpbSizeInFrames == 0) {
+			// unknown level or frame too big for level gives no DPB size
+			log->printf("DecoderVideoLibDCE::init(): not supported profile level: %u for size %ux%u\n",
+			            info.profileLevel, info.width, info.height);
 			goto fail;
 		}
-		dpbSizeInFrames = MIN(16, maxDpb / ((info.width / 16) * (info.height / 16)));
-		_numFrameBuffers = IVIDEO2_MAX_IO_BUFFERS;
+		// SPS tells how many frames stream really keeps, level table is upper bound
+		if (info.maxDecFrameBuffering > 0) {
+			dpbSizeInFrames = MIN(dpbSizeInFrames, (int)info.maxDecFrameBuffering);
+		}
+		_numFrameBuffers = dpbSizeInFrames + 1; // plus picture being decoded
 		break;
 	default:
 		log->printf("DecoderVideoLibDCE::init(): not supported codec!\n");
 		goto fail;
 	}
 
+	// codec may hold more than DPB with display delay, pool grows up to old fixed size
+	_maxFrameBuffers = (_codecId == CODEC_ID_H264) ? IVIDEO2_MAX_IO_BUFFERS : _numFrameBuffers;
 	_numFrameBuffers += 2; // for display buffering
+	_numFrameBuffers += _outputQueueDepth; // for frames queued to display
+	_maxFrameBuffers += 2 + _outputQueueDepth;
 
 	_frameWidth  = ALIGN2(info.width, 4);
 	_frameHeight = ALIGN2(info.height, 4);
@@ -357,42 +347,23 @@ STATUS DecoderVideoLibDCE::init(Demuxer *demuxer, Display *display) {
 		goto fail;
 	}
 
-	creq.height = (uint32_t)_frameHeight;
-	creq.width = (uint32_t)_frameWidth;
-	creq.bpp = 8;
-	if (drmIoctl(displayHandle.handle, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
-		log->printf("DecoderVideoLibDCE::init(): Failed create input buffer\n");
-		goto fail;
-	}
-
-	_inputBufHandle = creq.handle;
-
-	mreq.handle = creq.handle;
-	if (drmIoctl(displayHandle.handle, DRM_IOCTL_MODE_MAP_DUMB, &mreq)) {
-		log->printf("DisplayOmapDrm::init(): Cannot map dumb buffer: %s\n", strerror(errno));
-		goto fail;
-	}
-
-	_inputBufPtr = mmap(0, creq.size, PROT_READ | PROT_WRITE, MAP_SHARED, displayHandle.handle, mreq.offset);
-	if (_inputBufPtr == MAP_FAILED) {
-		log->printf("DisplayOmapDrm::init(): Cannot map dumb buffer: %s\n", strerror(errno));
-		goto fail;
-	}
-
-	_inputBufSize = creq.size;
-
-	dreq.handle = _inputBufHandle;
-	dreq.flags = DRM_CLOEXEC;
-	if (drmIoctl(displayHandle.handle, DRM_IOCTL_PRIME_HANDLE_TO_FD, &dreq) < 0) {
-		log->printf("DisplayOmapDrm::init(): Cannot DMA buffer: %s\n", strerror(errno));
-		goto fail;
+	// ring of input buffers, next access unit is copied while current one decodes
+	for (int i = 0; i < DCE_NUM_INPUT_BUFFERS; i++) {
+		if (allocInputBuffer(&_inputBuffers[i]) != S_OK) {
+			goto fail;
+		}
+		_numInputBuffers++;
 	}
+	_inputWriteIndex = 0;
+	_inputCommitted = 0;
+	_inputDecoded = 0;
+	memset(&_stats, 0, sizeof(_stats));
+	_stats.inputBuffers = _numInputBuffers;
 
 	_codecInputBufs->numBufs = 1;
 	_codecInputBufs->descs[0].memType = XDM_MEMTYPE_RAW;
-	_codecInputBufs->descs[0].buf = (XDAS_Int8 *)dreq.fd;
-	_codecInputBufs->descs[0].bufSize.bytes = creq.size;
-	dce_buf_lock(1, (size_t *)&(_codecInputBufs->descs[0].buf));
+	_codecInputBufs->descs[0].buf = (XDAS_Int8 *)_inputBuffers[0].dmaBuf;
+	_codecInputBufs->descs[0].bufSize.bytes = _inputBuffers[0].size;
 
 	_codecOutputBufs->numBufs = 2;
 	_codecOutputBufs->descs[0].memType = XDM_MEMTYPE_RAW;
@@ -400,16 +371,25 @@ STATUS DecoderVideoLibDCE::init(Demuxer *demuxer, Display *display) {
 	_codecOutputBufs->descs[1].memType = XDM_MEMTYPE_RAW;
 	_codecOutputBufs->descs[1].bufSize.bytes = _frameWidth * (_frameHeight / 2);
 
-	_frameBuffers = (FrameBuffer **)calloc(_numFrameBuffers, sizeof(FrameBuffer *));
-	for (int i = 0; i < _numFrameBuffers; i++) {
-		_frameBuffers[i] = (FrameBuffer *)calloc(1, sizeof(FrameBuffer));
-		if (_display->getDisplayVideoBuffer(&_frameBuffers[i]->buffer, FMT_NV12, _frameWidth, _frameHeight) != S_OK) {
-			log->printf("DecoderVideoLibDCE::getBuffer(): Failed create output buffer\n");
+	_inputMetadata = (InputMetadata *)calloc(_maxFrameBuffers, sizeof(InputMetadata));
+	_frameBuffers = (FrameBuffer **)calloc(_maxFrameBuffers, sizeof(FrameBuffer *));
+	if (!_inputMetadata || !_frameBuffers) {
+		log->printf("DecoderVideoLibDCE::init(): Failed allocate frame buffer table\n");
+		goto fail;
+	}
+	initialFrameBuffers = _numFrameBuffers;
+	_numFrameBuffers = 0;
+	_freeHead = _freeTail = nullptr;
+	_parkedHead = _parkedTail = nullptr;
+	for (int i = 0; i < initialFrameBuffers; i++) {
+		FrameBuffer *fb = allocBuffer();
+		if (!fb) {
 			goto fail;
 		}
-		_frameBuffers[i]->index = i;
-		_frameBuffers[i]->locked = false;
+		pushFreeBuffer(fb);
 	}
+	log->printf("DecoderVideoLibDCE::init(): %d output buffers, up to %d, dpb %d frames\n",
+	            _numFrameBuffers, _maxFrameBuffers, dpbSizeInFrames);
 	_initialized = true;
 
 	return S_OK;
@@ -428,6 +408,11 @@ fail:
 		free(_frameBuffers);
 		_frameBuffers = nullptr;
 	}
+	_numFrameBuffers = 0;
+	_freeHead = _freeTail = nullptr;
+	_parkedHead = _parkedTail = nullptr;
+	free(_inputMetadata);
+	_inputMetadata = nullptr;
 
 	if (_codecHandle) {
 		VIDDEC3_delete(_codecHandle);
@@ -446,20 +431,11 @@ fail:
 		dce_free(_codecDynParams);
 		_codecDynParams = nullptr;
 	}
+	freeInputBuffers();
 	if (_codecInputBufs) {
-		dce_buf_unlock(1, (size_t *)&(_codecInputBufs->descs[0].buf));
-		munmap(_inputBufPtr, _inputBufSize);
-		close((int)_codecInputBufs->descs[0].buf);
 		dce_free(_codecInputBufs);
 		_codecInputBufs = nullptr;
 	}
-	if (_inputBufHandle > 0) {
-		struct drm_gem_close req = {
-			.handle = _inputBufHandle,
-		};
-		drmIoctl(_drmFd, DRM_IOCTL_MODE_DESTROY_DUMB, &req);
-		_inputBufHandle = 0;
-	}
 	if (_codecOutputBufs) {
 		dce_free(_codecOutputBufs);
 		_codecOutputBufs = nullptr;
@@ -500,6 +476,11 @@ STATUS DecoderVideoLibDCE::deinit() {
 		free(_frameBuffers);
 		_frameBuffers = nullptr;
 	}
+	_numFrameBuffers = 0;
+	_freeHead = _freeTail = nullptr;
+	_parkedHead = _parkedTail = nullptr;
+	free(_inputMetadata);
+	_inputMetadata = nullptr;
 
 	if (_codecHandle && _codecDynParams && _codecParams) {
 		VIDDEC3_control(_codecHandle, XDM_FLUSH, _codecDynParams, _codecStatus);
@@ -522,20 +503,11 @@ STATUS DecoderVideoLibDCE::deinit() {
 		dce_free(_codecDynParams);
 		_codecDynParams = nullptr;
 	}
+	freeInputBuffers();
 	if (_codecInputBufs) {
-		dce_buf_unlock(1, (size_t *)&(_codecInputBufs->descs[0].buf));
-        munmap(_inputBufPtr, _inputBufSize);
-		close((int)_codecInputBufs->descs[0].buf);
 		dce_free(_codecInputBufs);
 		_codecInputBufs = nullptr;
 	}
-	if (_inputBufHandle > 0) {
-		struct drm_gem_close req = {
-			.handle = _inputBufHandle,
-		};
-		drmIoctl(_drmFd, DRM_IOCTL_MODE_DESTROY_DUMB, &req);
-		_inputBufHandle = 0;
-	}
 	if (_codecOutputBufs) {
 		dce_free(_codecOutputBufs);
 		_codecOutputBufs = nullptr;
@@ -567,9 +539,21 @@ void DecoderVideoLibDCE::getDemuxerBuffer(StreamFrame *streamFrame) {
 		streamFrame->videoFrame.dataSize = 0;
 		streamFrame->videoFrame.externalDataSize = 0;
 	} else {
-		streamFrame->videoFrame.data = (U8 *)_inputBufPtr;
+		streamFrame->videoFrame.data = (U8 *)_inputBuffers[_inputWriteIndex].ptr;
 		streamFrame->videoFrame.dataSize = 0;
-		streamFrame->videoFrame.externalDataSize = _inputBufSize;
+		streamFrame->videoFrame.externalDataSize = _inputBuffers[_inputWriteIndex].size;
+	}
+}
+
+void DecoderVideoLibDCE::commitDemuxerBuffer(StreamFrame *streamFrame) {
+	if (!_initialized || !streamFrame) {
+		return;
+	}
+
+	if (streamFrame->videoFrame.data == _inputBuffers[_inputWriteIndex].ptr) {
+		if (++_inputWriteIndex >= _numInputBuffers)
+			_inputWriteIndex = 0;
+		_inputCommitted++;
 	}
 }
 
@@ -585,10 +569,34 @@ STATUS DecoderVideoLibDCE::decodeFrame(bool &frameReady, StreamFrame *streamFram
 
 	frameReady = false;
 
-	_codecInputArgs->inputID = (XDAS_Int32)fb;
+	int inputIndex = -1;
+	for (int i = 0; i < _numInputBuffers; i++) {
+		if (streamFrame->videoFrame.data == _inputBuffers[i].ptr) {
+			inputIndex = i;
+			break;
+		}
+	}
+	if (inputIndex == -1) {
+		log->printf("DecoderVideoLibDCE::decodeFrame(): Data not in input buffer\n");
+		unlockBuffer(fb);
+		return S_FAIL;
+	}
+
+	U32 inFlight = _inputCommitted - _inputDecoded;
+	if (inFlight > 1)
+		_stats.overlappedDecodes++;
+	if (inFlight > _stats.maxInputInFlight)
+		_stats.maxInputInFlight = inFlight;
+	_stats.decodes++;
+
+	// decoder reorders frames, so keep input timestamp until its buffer comes out
+	_inputMetadata[fb->index].frameBuffer = fb;
+	_inputMetadata[fb->index].pts = streamFrame->videoFrame.pts;
+	_codecInputArgs->inputID = fb->index + 1;
 	_codecInputArgs->numBytes = streamFrame->videoFrame.dataSize;
 
 	_codecInputBufs->numBufs = 1;
+	_codecInputBufs->descs[0].buf = (XDAS_Int8 *)_inputBuffers[inputIndex].dmaBuf;
 	_codecInputBufs->descs[0].bufSize.bytes = streamFrame->videoFrame.dataSize;
 
 	_codecOutputBufs->numBufs = 2;
@@ -599,6 +607,7 @@ STATUS DecoderVideoLibDCE::decodeFrame(bool &frameReady, StreamFrame *streamFram
 	memset(_codecOutputArgs->freeBufID, 0, sizeof(_codecOutputArgs->freeBufID));
 
 	Int32 codecError = VIDDEC3_process(_codecHandle, _codecInputBufs, _codecOutputBufs, _codecInputArgs, _codecOutputArgs);
+	_inputDecoded++;
 	if (codecError != VIDDEC3_EOK) {
 		log->printf("DecoderVideoLibDCE::decodeFrame(): VIDDEC3_process() status: %d, extendedError: %08x\n",
 				codecError, _codecOutputArgs->extendedError);
@@ -622,7 +631,7 @@ STATUS DecoderVideoLibDCE::decodeFrame(bool &frameReady, StreamFrame *streamFram
 	}
 
 	for (int i = 0; _codecOutputArgs->freeBufID[i]; i++) {
-		unlockBuffer((FrameBuffer *)_codecOutputArgs->freeBufID[i]);
+		unlockBuffer(getInputBuffer(_codecOutputArgs->freeBufID[i]));
 	}
 
 	return S_OK;
@@ -658,14 +667,13 @@ STATUS DecoderVideoLibDCE::flush() {
 			}
 		}
 		for (int i = 0; _codecOutputArgs->freeBufID[i]; i++) {
-			unlockBuffer((FrameBuffer *)_codecOutputArgs->freeBufID[i]);
+			unlockBuffer(getInputBuffer(_codecOutputArgs->freeBufID[i]));
 		}
 	} while (codecError != XDM_EFAIL);
 
 	for (int i = 0; i < _numFrameBuffers; i++) {
 		if (_frameBuffers[i]->buffer.priv && _frameBuffers[i]->locked) {
-			dce_buf_unlock(1, (size_t *)&(_frameBuffers[i]->buffer.dmaBuf));
-			_frameBuffers[i]->locked = 0;
+			unlockBuffer(_frameBuffers[i]);
 		}
 	}
 
@@ -691,7 +699,11 @@ STATUS DecoderVideoLibDCE::getVideoStreamOutputFrame(Demuxer *demuxer, VideoFram
 
 	XDM_Rect *r = &_codecOutputArgs->displayBufs.bufDesc[0].activeFrameRegion;
 
-	FrameBuffer *fb = (FrameBuffer *)_codecOutputArgs->outputID[foundIndex];
+	XDAS_Int32 inputID = _codecOutputArgs->outputID[foundIndex];
+	FrameBuffer *fb = getInputBuffer(inputID);
+	if (!fb) {
+		return S_FAIL;
+	}
 
 	videoFrame->pixelfmt = FMT_NV12;
 	videoFrame->data[0] = (U8 *)&fb->buffer;
@@ -708,6 +720,7 @@ STATUS DecoderVideoLibDCE::getVideoStreamOutputFrame(Demuxer *demuxer, VideoFram
 	videoFrame->dy = r->topLeft.y;
 	videoFrame->dw = r->bottomRight.x - r->topLeft.x;
 	videoFrame->dh = r->bottomRight.y - r->topLeft.y;
+	videoFrame->pts = _inputMetadata[inputID - 1].pts;
 
 	if (_codecId == CODEC_ID_MPEG2VIDEO && _frameWidth == 720 && (_frameHeight == 576 || _frameHeight == 480)) {
 		videoFrame->anistropicDVD = true;
@@ -746,19 +759,177 @@ int DecoderVideoLibDCE::getVideoHeight(Demuxer *demuxer) {
 	return _frameHeight;
 }
 
+STATUS DecoderVideoLibDCE::getStats(DecoderVideoStats *stats) {
+	if (!_initialized || !stats) {
+		return S_FAIL;
+	}
+
+	*stats = _stats;
+
+	return S_OK;
+}
+
+STATUS DecoderVideoLibDCE::allocInputBuffer(InputBuffer *buffer) {
+	struct drm_mode_create_dumb creq = {};
+	struct drm_mode_map_dumb mreq = {};
+
+	buffer->dmaBuf = -1;
+
+	creq.height = (uint32_t)_frameHeight;
+	creq.width = (uint32_t)_frameWidth;
+	creq.bpp = 8;
+	if (drmIoctl(_drmFd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
+		log->printf("DecoderVideoLibDCE::allocInputBuffer(): Failed create input buffer\n");
+		goto fail;
+	}
+	buffer->handle = creq.handle;
+	buffer->size = creq.size;
+
+	mreq.handle = creq.handle;
+	if (drmIoctl(_drmFd, DRM_IOCTL_MODE_MAP_DUMB, &mreq)) {
+		log->printf("DecoderVideoLibDCE::allocInputBuffer(): Cannot map dumb buffer: %s\n", strerror(errno));
+		goto fail;
+	}
+
+	buffer->ptr = mmap(0, creq.size, PROT_READ | PROT_WRITE, MAP_SHARED, _drmFd, mreq.offset);
+	if (buffer->ptr == MAP_FAILED) {
+		log->printf("DecoderVideoLibDCE::allocInputBuffer(): Cannot map dumb buffer: %s\n", strerror(errno));
+		buffer->ptr = nullptr;
+		goto fail;
+	}
+
+	if (drmPrimeHandleToFD(_drmFd, creq.handle, DRM_CLOEXEC, &buffer->dmaBuf)) {
+		log->printf("DecoderVideoLibDCE::allocInputBuffer(): Cannot export dma-buf: %s\n", strerror(errno));
+		buffer->dmaBuf = -1;
+		goto fail;
+	}
+
+	dce_buf_lock(1, (size_t *)&(buffer->dmaBuf));
+
+	return S_OK;
+
+fail:
+	if (buffer->ptr) {
+		munmap(buffer->ptr, buffer->size);
+	}
+	if (buffer->handle > 0) {
+		struct drm_mode_destroy_dumb dreq = {
+			.handle = buffer->handle,
+		};
+		drmIoctl(_drmFd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+	}
+	memset(buffer, 0, sizeof(InputBuffer));
+
+	return S_FAIL;
+}
+
+void DecoderVideoLibDCE::freeInputBuffers() {
+	for (int i = 0; i < _numInputBuffers; i++) {
+		InputBuffer *buffer = &_inputBuffers[i];
+		dce_buf_unlock(1, (size_t *)&(buffer->dmaBuf));
+		munmap(buffer->ptr, buffer->size);
+		close(buffer->dmaBuf);
+		struct drm_mode_destroy_dumb dreq = {
+			.handle = buffer->handle,
+		};
+		drmIoctl(_drmFd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+		memset(buffer, 0, sizeof(InputBuffer));
+	}
+	_numInputBuffers = 0;
+}
+
+DecoderVideoLibDCE::FrameBuffer *DecoderVideoLibDCE::getInputBuffer(XDAS_Int32 inputID) {
+	if (inputID < 1 || inputID > _numFrameBuffers) {
+		log->printf("DecoderVideoLibDCE::getInputBuffer(): Wrong input id: %d\n", inputID);
+		return nullptr;
+	}
+
+	return _inputMetadata[inputID - 1].frameBuffer;
+}
+
+DecoderVideoLibDCE::FrameBuffer *DecoderVideoLibDCE::allocBuffer() {
+	if (_numFrameBuffers >= _maxFrameBuffers) {
+		return nullptr;
+	}
+
+	FrameBuffer *fb = (FrameBuffer *)calloc(1, sizeof(FrameBuffer));
+	if (!fb) {
+		log->printf("DecoderVideoLibDCE::allocBuffer(): Failed allocate frame buffer\n");
+		return nullptr;
+	}
+	if (_display->getDisplayVideoBuffer(&fb->buffer, FMT_NV12, _frameWidth, _frameHeight) != S_OK) {
+		log->printf("DecoderVideoLibDCE::allocBuffer(): Failed create output buffer\n");
+		free(fb);
+		return nullptr;
+	}
+	fb->index = _numFrameBuffers;
+	fb->locked = false;
+	fb->next = nullptr;
+	_frameBuffers[_numFrameBuffers++] = fb;
+
+	return fb;
+}
+
+void DecoderVideoLibDCE::pushFreeBuffer(FrameBuffer *fb) {
+	fb->next = nullptr;
+	if (_freeTail)
+		_freeTail->next = fb;
+	else
+		_freeHead = fb;
+	_freeTail = fb;
+}
+
+void DecoderVideoLibDCE::pushParkedBuffer(FrameBuffer *fb) {
+	fb->next = nullptr;
+	if (_parkedTail)
+		_parkedTail->next = fb;
+	else
+		_parkedHead = fb;
+	_parkedTail = fb;
+}
+
+void DecoderVideoLibDCE::reclaimParkedBuffers() {
+	// parked list is at most the few buffers display holds
+	FrameBuffer *fb = _parkedHead;
+	_parkedHead = _parkedTail = nullptr;
+	while (fb) {
+		FrameBuffer *next = fb->next;
+		if (fb->buffer.locked.load(std::memory_order_acquire))
+			pushParkedBuffer(fb);
+		else
+			pushFreeBuffer(fb);
+		fb = next;
+	}
+}
+
 DecoderVideoLibDCE::FrameBuffer *DecoderVideoLibDCE::getBuffer() {
+	FrameBuffer *fb;
+
 	if (!_initialized) {
 		return nullptr;
 	}
 
-	for (int i = 0; i < _numFrameBuffers; i++) {
-		if (_frameBuffers[i]->buffer.priv && !_frameBuffers[i]->locked) {
-			if (!_frameBuffers[i]->buffer.locked) {
-				dce_buf_lock(1, (size_t *)&(_frameBuffers[i]->buffer.dmaBuf));
-				_frameBuffers[i]->locked = true;
-				return _frameBuffers[i];
-			}
+	reclaimParkedBuffers();
+
+	// oldest released buffer first, head is taken unless display locked it after release
+	while ((fb = _freeHead) != nullptr) {
+		_freeHead = fb->next;
+		if (_freeHead == nullptr)
+			_freeTail = nullptr;
+		if (fb->buffer.locked.load(std::memory_order_acquire)) {
+			pushParkedBuffer(fb);
+			continue;
 		}
+		fb->next = nullptr;
+		lockBuffer(fb);
+		return fb;
+	}
+
+	fb = allocBuffer();
+	if (fb) {
+		log->printf("DecoderVideoLibDCE::getBuffer(): Output pool grown to %d buffers\n", _numFrameBuffers);
+		lockBuffer(fb);
+		return fb;
 	}
 
 	log->printf("DecoderVideoLibDCE::getBuffer(): No free slots for output buffer\n");
@@ -803,6 +974,11 @@ void DecoderVideoLibDCE::unlockBuffer(FrameBuffer *fb) {
 	dce_buf_unlock(1, (size_t *)&(_frameBuffers[fb->index]->buffer.dmaBuf));
 
 	_frameBuffers[fb->index]->locked = false;
+	// buffer on screen waits apart, so getBuffer() never walks past it
+	if (_frameBuffers[fb->index]->buffer.locked.load(std::memory_order_acquire))
+		pushParkedBuffer(_frameBuffers[fb->index]);
+	else
+		pushFreeBuffer(_frameBuffers[fb->index]);
 }
 
 } // namespace
@@ -38,6 +38,7 @@
 
 #include <inttypes.h>
 #include <cstdint>
+#include <atomic>
 #include <unistd.h>
 #include <fcntl.h>
 #include <drm/drm.h>
@@ -52,16 +53,31 @@ extern "C" {
 
 namespace MediaPLayer {
 
+#define DCE_NUM_INPUT_BUFFERS  4
+
 class DecoderVideoLibDCE : public DecoderVideo {
 
 private:
 
-	typedef struct {
+	typedef struct FrameBuffer {
 		DisplayVideoBuffer      buffer;
 		int                     index;
 		bool                    locked;
+		struct FrameBuffer      *next; // free or parked list link
 	} FrameBuffer;
 
+	typedef struct {
+		FrameBuffer             *frameBuffer;
+		S64                     pts;
+	} InputMetadata;
+
+	typedef struct {
+		void                    *ptr;
+		U32                     size;
+		uint32_t                handle;
+		int                     dmaBuf;
+	} InputBuffer;
+
 	Display                    *_display;
 	Engine_Handle              _codecEngine;
 	VIDDEC3_Handle             _codecHandle;
@@ -75,11 +91,20 @@ private:
 	int                        _drmFd;
 	int                        _frameWidth;
 	int                        _frameHeight;
-	void                       *_inputBufPtr;
-	int                        _inputBufSize;
-	uint32_t                   _inputBufHandle;
+	InputBuffer                _inputBuffers[DCE_NUM_INPUT_BUFFERS];
+	int                        _numInputBuffers;
+	int                        _inputWriteIndex;
+	std::atomic<U32>           _inputCommitted;
+	std::atomic<U32>           _inputDecoded;
+	DecoderVideoStats          _stats;
 	int                        _numFrameBuffers;
+	int                        _maxFrameBuffers;
 	FrameBuffer                **_frameBuffers;
+	FrameBuffer                *_freeHead;
+	FrameBuffer                *_freeTail;
+	FrameBuffer                *_parkedHead;    // released by codec, still held by display
+	FrameBuffer                *_parkedTail;
+	InputMetadata              *_inputMetadata; // indexed by inputID - 1
 	unsigned int               _codecId;
 
 public:
@@ -90,17 +115,27 @@ public:
 	STATUS init(Demuxer *demuxer, Display *display);
 	STATUS deinit();
 	void getDemuxerBuffer(StreamFrame *streamFrame);
+	void commitDemuxerBuffer(StreamFrame *streamFrame);
+	U32 getNumDemuxerBuffers() { return DCE_NUM_INPUT_BUFFERS; }
 	STATUS decodeFrame(bool &frameReady, StreamFrame *streamFrame);
 	STATUS flush();
+	STATUS getStats(DecoderVideoStats *stats);
 	STATUS getVideoStreamOutputFrame(Demuxer *demuxer, VideoFrame *videoFrame);
 	FORMAT_VIDEO getVideoFmt(Demuxer * /*demuxer*/) { return FMT_NV12; }
 	int getVideoWidth(Demuxer *demuxer);
 	int getVideoHeight(Demuxer *demuxer);
 
 private:
+	FrameBuffer *allocBuffer();
 	FrameBuffer *getBuffer();
+	void pushFreeBuffer(FrameBuffer *fb);
+	void pushParkedBuffer(FrameBuffer *fb);
+	void reclaimParkedBuffers();
 	void lockBuffer(FrameBuffer *fb);
 	void unlockBuffer(FrameBuffer *fb);
+	FrameBuffer *getInputBuffer(XDAS_Int32 inputID);
+	STATUS allocInputBuffer(InputBuffer *buffer);
+	void freeInputBuffers();
 };
 
 } // namespace
@@ -30,13 +30,18 @@ namespace MediaPLayer {
 #define SEEK_BY_PERCENT  1
 #define SEEK_BY_TIME     2
 
+#define DEMUXER_READAHEAD_DEFAULT_BYTES       (8 * 1024 * 1024)
+#define DEMUXER_READAHEAD_DEFAULT_DURATION    5000 // ms
+#define DEMUXER_READAHEAD_DEFAULT_LOW         50   // percent
+#define DEMUXER_READAHEAD_DEFAULT_HIGH        100  // percent
+
 #pragma pack(1)
 
 typedef struct {
 	U8      *data;
 	U32      dataSize;
 	U32	     externalDataSize;
-	S64      pts;
+	S64      pts; // presentation timestamp in microseconds or PTS_NONE
 	bool     keyFrame;
 } StreamVideoFrame;
 
@@ -47,6 +52,8 @@ typedef struct {
 	void    *priv; // used for non API purposes
 } StreamAudioFrame;
 
+// Frame data without external buffer points into demuxer packet and is
+// valid until next readNextFrame(), unless frame is referenced by refFrame().
 typedef struct {
 	StreamVideoFrame      videoFrame;
 	StreamAudioFrame      audioFrame;
@@ -62,6 +69,7 @@ typedef struct {
 	U32          timeBaseScale;
 	U32          timeBaseRate;
 	U32          profileLevel;
+	U32          maxDecFrameBuffering; // H.264 SPS VUI, 0 if not signalled
 	float        fps;
 	void        *priv; // used for non API purposes
 } StreamVideoInfo;
@@ -72,6 +80,27 @@ typedef struct {
 	void        *priv; // used for non API purposes
 } StreamAudioInfo;
 
+typedef struct {
+	U32          maxBytes;      // byte budget of all queued packets, 0 disables read-ahead
+	U32          maxDuration;   // duration budget of longest stream queue in ms
+	U32          lowWatermark;  // percent of budgets below which reading resumes
+	U32          highWatermark; // percent of budgets at which reading pauses
+} DemuxerReadAheadConfig;
+
+typedef struct {
+	U64          packetsRead;
+	U64          throttles;      // reader paused at high watermark
+	U64          underruns;      // consumer found queues empty
+	U64          underrunTime;   // us consumer waited in total
+	U64          maxUnderrunTime;
+	U32          videoPackets;   // currently queued
+	U32          audioPackets;
+	U32          bytes;
+	U32          peakBytes;
+	S64          duration;       // us queued in longest stream queue
+	S64          peakDuration;
+} DemuxerReadAheadStats;
+
 #pragma pack()
 
 class Demuxer {
@@ -93,6 +122,10 @@ public:
 	virtual STATUS selectAudioStream(S32 index_audio) = 0;
 	virtual STATUS seekFrame(float seek, U32 flags) = 0;
 	virtual STATUS readNextFrame(StreamFrame *frame) = 0;
+	virtual STATUS refFrame(StreamFrame *frame) = 0;
+	virtual void unrefFrame(StreamFrame *frame) = 0;
+	virtual STATUS setReadAhead(DemuxerReadAheadConfig *config) = 0;
+	virtual STATUS getReadAheadStats(DemuxerReadAheadStats *stats) = 0;
 	virtual STATUS getVideoStreamInfo(StreamVideoInfo *info) = 0;
 };
 
@@ -23,6 +23,7 @@
 #include "logs.h"
 #include "demuxer_base.h"
 #include "demuxer_libav.h"
+#include "h264_sps.h"
 
 namespace MediaPLayer {
 
@@ -93,11 +94,8 @@ void DemuxerLibAV::closeFile() {
 		return;
 	}
 
-	if (_streamFrame.videoFrame.data) {
-		av_free(_streamFrame.videoFrame.data);
-		_streamFrame.videoFrame.data = nullptr;
-	}
-
+	_readAhead.stop();
+	_streamFrame = {};
 	av_packet_unref(&_packedFrame);
 	avformat_close_input(&_afc);
 }
@@ -129,6 +127,7 @@ STATUS DemuxerLibAV::selectVideoStream() {
 		}
 		if (cc->codec_type == AVMEDIA_TYPE_VIDEO) {
 			_videoStream = stream;
+			cc->pkt_timebase = stream->time_base;
 			if (cc->codec_id == AV_CODEC_ID_H264) {
 				if (cc->extradata && cc->extradata_size >= 8 && cc->extradata[0] == 1) {
 					const AVBitStreamFilter *bsf = av_bsf_get_by_name("h264_mp4toannexb");
@@ -220,8 +219,21 @@ STATUS DemuxerLibAV::selectVideoStream() {
 			_videoStreamInfo.timeBaseRate = static_cast<U32>(cc->time_base.den);
 			_videoStreamInfo.priv = cc;
 			_videoStreamInfo.codecTag = cc->codec_tag;
-			_videoStreamInfo.fps = av_q2d(stream->avg_frame_rate);
+			if (stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0) {
+				_videoStreamInfo.fps = av_q2d(stream->avg_frame_rate);
+			} else if (stream->r_frame_rate.num > 0 && stream->r_frame_rate.den > 0) {
+				_videoStreamInfo.fps = av_q2d(stream->r_frame_rate);
+			} else {
+				_videoStreamInfo.fps = 0; // unknown or variable frame rate
+			}
 			_videoStreamInfo.profileLevel = cc->level;
+			_videoStreamInfo.maxDecFrameBuffering = 0;
+			if (cc->codec_id == AV_CODEC_ID_H264) {
+				H264SpsInfo sps;
+				if (ParseH264Sps(cc->extradata, cc->extradata_size, &sps) == S_OK && sps.bitstreamRestriction) {
+					_videoStreamInfo.maxDecFrameBuffering = MAX(sps.maxDecFrameBuffering, 1U);
+				}
+			}
 
 
 			switch (cc->codec_id) {
@@ -436,6 +448,9 @@ STATUS DemuxerLibAV::seekFrame(float seek, U32 flags) {
 		return S_FAIL;
 	}
 
+	// queued packets are from old position, reader restarts on next read
+	_readAhead.stop();
+
 	if (av_seek_frame(_afc, -1, _pts, seek_flags) < 0) {
 		log->printf("DemuxerLibAV::seekFrame(): av_seek_frame failed!\n");
 		return S_FAIL;
@@ -450,17 +465,10 @@ STATUS DemuxerLibAV::readNextFrame(StreamFrame *frame) {
 		return S_FAIL;
 	}
 
-	if (_streamFrame.videoFrame.data && frame->videoFrame.externalDataSize == 0) {
-		av_free(_streamFrame.videoFrame.data);
-	}
-	if (_streamFrame.audioFrame.data && frame->audioFrame.externalDataSize == 0) {
-		av_free(_streamFrame.audioFrame.data);
-	}
-
 	_streamFrame = {};
 	av_packet_unref(&_packedFrame);
 
-	if (av_read_frame(_afc, &_packedFrame) == 0) {
+	if (readPacket(&_packedFrame) == S_OK) {
 		if (_packedFrame.stream_index == _videoStream->index) {
 			if (_bsf && frame->videoFrame.externalDataSize > 0) {
 				if (av_bsf_send_packet(_bsf, &_packedFrame) < 0) {
@@ -472,7 +480,11 @@ STATUS DemuxerLibAV::readNextFrame(StreamFrame *frame) {
 					return S_FAIL;
 				}
 			}
-			_streamFrame.videoFrame.pts = _packedFrame.pts * av_q2d(_videoStream->time_base);
+			if (_packedFrame.pts != AV_NOPTS_VALUE) {
+				_streamFrame.videoFrame.pts = av_rescale_q(_packedFrame.pts, _videoStream->time_base, AV_TIME_BASE_Q);
+			} else {
+				_streamFrame.videoFrame.pts = PTS_NONE;
+			}
 			_streamFrame.videoFrame.keyFrame = (_packedFrame.flags & AV_PKT_FLAG_KEY) != 0;
 			_streamFrame.videoFrame.dataSize = _packedFrame.size;
 			if (frame->videoFrame.externalDataSize > 0) {
@@ -499,9 +511,8 @@ STATUS DemuxerLibAV::readNextFrame(StreamFrame *frame) {
 					memcpy(_streamFrame.videoFrame.data, _packedFrame.data, _packedFrame.size);
 				}
 			} else {
-				_streamFrame.videoFrame.data = static_cast<U8 *>(av_malloc(_packedFrame.size + AV_INPUT_BUFFER_PADDING_SIZE));
-				memcpy(_streamFrame.videoFrame.data, _packedFrame.data, _packedFrame.size);
-				memset(_streamFrame.videoFrame.data + _packedFrame.size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+				// packet buffer is refcounted and padded, no copy needed
+				_streamFrame.videoFrame.data = _packedFrame.data;
 			}
 			_streamFrame.priv = &_packedFrame;
 		} else if (_audioStream && _packedFrame.stream_index == _audioStream->index) {
@@ -515,9 +526,7 @@ STATUS DemuxerLibAV::readNextFrame(StreamFrame *frame) {
 				_streamFrame.audioFrame.externalDataSize = frame->audioFrame.externalDataSize;
 				memcpy(_streamFrame.audioFrame.data, _packedFrame.data, _packedFrame.size);
 			} else {
-				_streamFrame.audioFrame.data = static_cast<U8 *>(av_malloc(_packedFrame.size + AV_INPUT_BUFFER_PADDING_SIZE));
-				memcpy(_streamFrame.audioFrame.data, _packedFrame.data, _packedFrame.size);
-				memset(_streamFrame.audioFrame.data + _packedFrame.size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+				_streamFrame.audioFrame.data = _packedFrame.data;
 			}
 			_streamFrame.priv = &_packedFrame;
 		}
@@ -529,6 +538,76 @@ STATUS DemuxerLibAV::readNextFrame(StreamFrame *frame) {
 	return S_FAIL;
 }
 
+STATUS DemuxerLibAV::readPacket(AVPacket *packet) {
+	if (!_readAhead.isEnabled()) {
+		return av_read_frame(_afc, packet) == 0 ? S_OK : S_FAIL;
+	}
+
+	if (!_readAhead.isRunning() && _readAhead.start(_afc, _videoStream, _audioStream) != S_OK) {
+		return S_FAIL;
+	}
+
+	return _readAhead.readPacket(packet);
+}
+
+STATUS DemuxerLibAV::setReadAhead(DemuxerReadAheadConfig *config) {
+	if (config == nullptr) {
+		log->printf("DemuxerLibAV::setReadAhead(): wrong arguments!\n");
+		return S_FAIL;
+	}
+	if (_readAhead.isRunning()) {
+		log->printf("DemuxerLibAV::setReadAhead(): read-ahead already running!\n");
+		return S_FAIL;
+	}
+
+	_readAhead.setConfig(config);
+
+	return S_OK;
+}
+
+STATUS DemuxerLibAV::getReadAheadStats(DemuxerReadAheadStats *stats) {
+	if (stats == nullptr || !_readAhead.isEnabled())
+		return S_FAIL;
+
+	_readAhead.getStats(stats);
+
+	return S_OK;
+}
+
+STATUS DemuxerLibAV::refFrame(StreamFrame *frame) {
+	if (frame == nullptr || frame->priv == nullptr) {
+		log->printf("DemuxerLibAV::refFrame(): wrong arguments!\n");
+		return S_FAIL;
+	}
+
+	// new reference shares packet buffer, so frame data pointers stay valid
+	AVPacket *source = static_cast<AVPacket *>(frame->priv);
+	AVPacket *packet = av_packet_clone(source);
+	if (packet == nullptr) {
+		log->printf("DemuxerLibAV::refFrame(): av_packet_clone failed!\n");
+		return S_FAIL;
+	}
+	if (packet->data != source->data) {
+		// source was not refcounted and got copied
+		if (frame->videoFrame.data == source->data)
+			frame->videoFrame.data = packet->data;
+		if (frame->audioFrame.data == source->data)
+			frame->audioFrame.data = packet->data;
+	}
+	frame->priv = packet;
+
+	return S_OK;
+}
+
+void DemuxerLibAV::unrefFrame(StreamFrame *frame) {
+	if (frame == nullptr || frame->priv == nullptr)
+		return;
+
+	AVPacket *packet = static_cast<AVPacket *>(frame->priv);
+	av_packet_free(&packet);
+	frame->priv = nullptr;
+}
+
 STATUS DemuxerLibAV::getVideoStreamInfo(StreamVideoInfo *info) {
 	if (!_initialized) {
 		log->printf("DemuxerLibAV::getVideoStreamInfo(): demuxer not opened!\n");
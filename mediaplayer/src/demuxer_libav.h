@@ -24,6 +24,7 @@
 
 #include "basetypes.h"
 #include "demuxer_base.h"
+#include "demuxer_readahead.h"
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -45,6 +46,7 @@ private:
 	AVBSFContext               *_bsf;
 	bool                        _firstWMV3frame;
 	uint32_t                    _extradataWMV3;
+	DemuxerReadAhead            _readAhead;
 
 public:
 	DemuxerLibAV();
@@ -58,7 +60,14 @@ public:
 	STATUS selectAudioStream(S32 index_audio);
 	STATUS seekFrame(float seek, U32 flags);
 	STATUS readNextFrame(StreamFrame *frame);
+	STATUS refFrame(StreamFrame *frame);
+	void unrefFrame(StreamFrame *frame);
+	STATUS setReadAhead(DemuxerReadAheadConfig *config);
+	STATUS getReadAheadStats(DemuxerReadAheadStats *stats);
 	STATUS getVideoStreamInfo(StreamVideoInfo *info);
+
+private:
+	STATUS readPacket(AVPacket *packet);
 };
 
 } // namespace
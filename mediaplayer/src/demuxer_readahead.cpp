@@ -0,0 +1,319 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "basetypes.h"
+#include "logs.h"
+#include "demuxer_readahead.h"
+
+namespace MediaPLayer {
+
+DemuxerReadAhead::DemuxerReadAhead() :
+		_afc(nullptr), _videoIndex(-1), _audioIndex(-1), _bytes(0), _seq(0),
+		_paused(false), _eof(false), _stop(false), _running(false), _delivered(false) {
+	memset(&_config, 0, sizeof(_config));
+	memset(&_videoQueue, 0, sizeof(_videoQueue));
+	memset(&_audioQueue, 0, sizeof(_audioQueue));
+	memset(&_stats, 0, sizeof(_stats));
+	pthread_mutex_init(&_lock, nullptr);
+	pthread_cond_init(&_notEmpty, nullptr);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&_notFull, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+DemuxerReadAhead::~DemuxerReadAhead() {
+	stop();
+	pthread_cond_destroy(&_notFull);
+	pthread_cond_destroy(&_notEmpty);
+	pthread_mutex_destroy(&_lock);
+}
+
+S64 DemuxerReadAhead::getTime() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (S64)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+void DemuxerReadAhead::setConfig(DemuxerReadAheadConfig *config) {
+	_config = *config;
+	if (_config.highWatermark == 0 || _config.highWatermark > 100)
+		_config.highWatermark = 100;
+	if (_config.lowWatermark >= _config.highWatermark)
+		_config.lowWatermark = _config.highWatermark / 2;
+}
+
+STATUS DemuxerReadAhead::start(AVFormatContext *afc, AVStream *videoStream, AVStream *audioStream) {
+	if (_running)
+		return S_OK;
+
+	_afc = afc;
+	_videoIndex = videoStream ? videoStream->index : -1;
+	_audioIndex = audioStream ? audioStream->index : -1;
+	_videoQueue.timeBase = videoStream ? videoStream->time_base : (AVRational){ 0, 1 };
+	_audioQueue.timeBase = audioStream ? audioStream->time_base : (AVRational){ 0, 1 };
+	_paused = false;
+	_eof = false;
+	_stop = false;
+	_delivered = false;
+
+	if (pthread_create(&_thread, nullptr, readThreadFunc, this) != 0) {
+		log->printf("DemuxerReadAhead::start(): failed create read thread!\n");
+		return S_FAIL;
+	}
+	_running = true;
+
+	return S_OK;
+}
+
+void DemuxerReadAhead::stop() {
+	if (_running) {
+		pthread_mutex_lock(&_lock);
+		_stop = true;
+		pthread_cond_broadcast(&_notFull);
+		pthread_cond_broadcast(&_notEmpty);
+		pthread_mutex_unlock(&_lock);
+
+		pthread_join(_thread, nullptr);
+		_running = false;
+	}
+
+	flush();
+}
+
+void DemuxerReadAhead::flush() {
+	PacketNode *node;
+
+	while ((node = pop(&_videoQueue)) != nullptr || (node = pop(&_audioQueue)) != nullptr) {
+		av_packet_free(&node->packet);
+		free(node);
+	}
+	_bytes = 0;
+}
+
+void DemuxerReadAhead::push(PacketQueue *queue, PacketNode *node) {
+	node->next = nullptr;
+	if (queue->tail)
+		queue->tail->next = node;
+	else
+		queue->head = node;
+	queue->tail = node;
+	queue->count++;
+	_bytes += node->packet->size;
+}
+
+DemuxerReadAhead::PacketNode *DemuxerReadAhead::pop(PacketQueue *queue) {
+	PacketNode *node = queue->head;
+
+	if (node == nullptr)
+		return nullptr;
+
+	queue->head = node->next;
+	if (queue->head == nullptr)
+		queue->tail = nullptr;
+	queue->count--;
+	_bytes -= node->packet->size;
+
+	return node;
+}
+
+S64 DemuxerReadAhead::getDuration(PacketQueue *queue) {
+	if (queue->head == nullptr || queue->head->time == AV_NOPTS_VALUE ||
+	    queue->tail->time == AV_NOPTS_VALUE)
+		return 0;
+
+	return MAX(queue->tail->time - queue->head->time, 0);
+}
+
+S64 DemuxerReadAhead::getQueuedDuration() {
+	return MAX(getDuration(&_videoQueue), getDuration(&_audioQueue));
+}
+
+bool DemuxerReadAhead::isAboveWatermark(U32 percent) {
+	if ((U64)_bytes * 100 >= (U64)_config.maxBytes * percent)
+		return true;
+	if (_config.maxDuration > 0 && getQueuedDuration() * 100 >= (S64)_config.maxDuration * 1000 * percent)
+		return true;
+
+	return false;
+}
+
+void *DemuxerReadAhead::readThreadFunc(void *arg) {
+	static_cast<DemuxerReadAhead *>(arg)->readLoop();
+	return nullptr;
+}
+
+void DemuxerReadAhead::readLoop() {
+	AVPacket *packet = av_packet_alloc();
+
+	if (packet == nullptr) {
+		log->printf("DemuxerReadAhead::readLoop(): av_packet_alloc failed!\n");
+		pthread_mutex_lock(&_lock);
+		_eof = true;
+		pthread_cond_broadcast(&_notEmpty);
+		pthread_mutex_unlock(&_lock);
+		return;
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&_lock);
+		while (!_stop && _paused) {
+			pthread_cond_wait(&_notFull, &_lock);
+		}
+		bool stop = _stop;
+		pthread_mutex_unlock(&_lock);
+		if (stop)
+			break;
+
+		int err = av_read_frame(_afc, packet);
+		if (err == AVERROR(EAGAIN)) {
+			// input has no data yet, retry later instead of spinning, stop wakes it
+			struct timespec t;
+			clock_gettime(CLOCK_MONOTONIC, &t);
+			t.tv_nsec += DEMUXER_READAHEAD_RETRY_DELAY * 1000000;
+			if (t.tv_nsec >= 1000000000) {
+				t.tv_sec++;
+				t.tv_nsec -= 1000000000;
+			}
+			pthread_mutex_lock(&_lock);
+			if (!_stop)
+				pthread_cond_timedwait(&_notFull, &_lock, &t);
+			pthread_mutex_unlock(&_lock);
+			continue;
+		}
+		if (err < 0)
+			break;
+
+		PacketQueue *queue;
+		if (packet->stream_index == _videoIndex) {
+			queue = &_videoQueue;
+		} else if (packet->stream_index == _audioIndex) {
+			queue = &_audioQueue;
+		} else {
+			av_packet_unref(packet);
+			continue;
+		}
+
+		PacketNode *node = (PacketNode *)malloc(sizeof(PacketNode));
+		if (node == nullptr) {
+			log->printf("DemuxerReadAhead::readLoop(): out of memory!\n");
+			av_packet_unref(packet);
+			break;
+		}
+		node->packet = packet;
+		S64 time = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+		node->time = time != AV_NOPTS_VALUE ? av_rescale_q(time, queue->timeBase, AV_TIME_BASE_Q) : AV_NOPTS_VALUE;
+
+		packet = av_packet_alloc();
+
+		pthread_mutex_lock(&_lock);
+		node->seq = _seq++;
+		push(queue, node);
+		_stats.packetsRead++;
+		if (_bytes > _stats.peakBytes)
+			_stats.peakBytes = _bytes;
+		S64 duration = getQueuedDuration();
+		if (duration > _stats.peakDuration)
+			_stats.peakDuration = duration;
+		if (isAboveWatermark(_config.highWatermark)) {
+			_paused = true;
+			_stats.throttles++;
+		}
+		pthread_cond_signal(&_notEmpty);
+		pthread_mutex_unlock(&_lock);
+
+		if (packet == nullptr) {
+			log->printf("DemuxerReadAhead::readLoop(): av_packet_alloc failed!\n");
+			break;
+		}
+	}
+
+	av_packet_free(&packet);
+
+	pthread_mutex_lock(&_lock);
+	_eof = true;
+	pthread_cond_broadcast(&_notEmpty);
+	pthread_mutex_unlock(&_lock);
+}
+
+STATUS DemuxerReadAhead::readPacket(AVPacket *packet) {
+	PacketNode *node;
+
+	pthread_mutex_lock(&_lock);
+
+	if (_videoQueue.head == nullptr && _audioQueue.head == nullptr && !_eof) {
+		// startup fill is not counted as underrun
+		S64 startTime = getTime();
+		while (_videoQueue.head == nullptr && _audioQueue.head == nullptr && !_eof && !_stop) {
+			pthread_cond_wait(&_notEmpty, &_lock);
+		}
+		if (_delivered) {
+			U64 waitTime = getTime() - startTime;
+			_stats.underruns++;
+			_stats.underrunTime += waitTime;
+			if (waitTime > _stats.maxUnderrunTime)
+				_stats.maxUnderrunTime = waitTime;
+		}
+	}
+
+	// keep file order between streams
+	if (_videoQueue.head && (_audioQueue.head == nullptr || _videoQueue.head->seq < _audioQueue.head->seq)) {
+		node = pop(&_videoQueue);
+	} else {
+		node = pop(&_audioQueue);
+	}
+
+	if (node && _paused && !isAboveWatermark(_config.lowWatermark)) {
+		_paused = false;
+		pthread_cond_signal(&_notFull);
+	}
+
+	pthread_mutex_unlock(&_lock);
+
+	if (node == nullptr)
+		return S_FAIL;
+
+	_delivered = true;
+	av_packet_move_ref(packet, node->packet);
+	av_packet_free(&node->packet);
+	free(node);
+
+	return S_OK;
+}
+
+void DemuxerReadAhead::getStats(DemuxerReadAheadStats *stats) {
+	pthread_mutex_lock(&_lock);
+	*stats = _stats;
+	stats->videoPackets = _videoQueue.count;
+	stats->audioPackets = _audioQueue.count;
+	stats->bytes = _bytes;
+	stats->duration = getQueuedDuration();
+	pthread_mutex_unlock(&_lock);
+}
+
+} // namespace
@@ -0,0 +1,107 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef DEMUXER_READAHEAD_H
+#define DEMUXER_READAHEAD_H
+
+#include <pthread.h>
+
+#include "basetypes.h"
+#include "demuxer_base.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#define DEMUXER_READAHEAD_RETRY_DELAY 10 // ms, wait after EAGAIN from input
+
+namespace MediaPLayer {
+
+// Background av_read_frame() loop feeding separate video and audio queues.
+// Reader pauses when byte or duration budget reaches high watermark and
+// resumes once consumer drains both below low watermark. Consumer gets
+// packets back in file order.
+class DemuxerReadAhead {
+private:
+
+	typedef struct PacketNode {
+		AVPacket            *packet;
+		U64                 seq;
+		S64                 time; // us, AV_NOPTS_VALUE if unknown
+		struct PacketNode   *next;
+	} PacketNode;
+
+	typedef struct {
+		PacketNode          *head;
+		PacketNode          *tail;
+		U32                 count;
+		AVRational          timeBase;
+	} PacketQueue;
+
+	AVFormatContext             *_afc;
+	int                         _videoIndex;
+	int                         _audioIndex;
+	DemuxerReadAheadConfig      _config;
+	PacketQueue                 _videoQueue;
+	PacketQueue                 _audioQueue;
+	U32                         _bytes;
+	U64                         _seq;
+	bool                        _paused;
+	bool                        _eof;
+	bool                        _stop;
+	bool                        _running;
+	bool                        _delivered;
+	pthread_t                   _thread;
+	pthread_mutex_t             _lock;
+	pthread_cond_t              _notEmpty;
+	pthread_cond_t              _notFull;
+	DemuxerReadAheadStats       _stats;
+
+public:
+
+	DemuxerReadAhead();
+	~DemuxerReadAhead();
+
+	void setConfig(DemuxerReadAheadConfig *config);
+	bool isEnabled() { return _config.maxBytes > 0; }
+	bool isRunning() { return _running; }
+	STATUS start(AVFormatContext *afc, AVStream *videoStream, AVStream *audioStream);
+	void stop();
+	STATUS readPacket(AVPacket *packet);
+	void getStats(DemuxerReadAheadStats *stats);
+
+private:
+
+	static void *readThreadFunc(void *arg);
+	void readLoop();
+	void flush();
+	void push(PacketQueue *queue, PacketNode *node);
+	PacketNode *pop(PacketQueue *queue);
+	S64 getDuration(PacketQueue *queue);
+	S64 getQueuedDuration();
+	bool isAboveWatermark(U32 percent);
+	static S64 getTime();
+};
+
+} // namespace
+
+#endif
@@ -26,11 +26,24 @@
 #include "display_fbdev.h"
 #include "display_omapdrm.h"
 #include "display_omapdrm_egl.h"
+#include "display_null.h"
 
 namespace MediaPLayer {
 
 Display::Display() :
-		_initialized(false) {
+		_initialized(false), _hwAccelDecode(false), _flags(0) {
+}
+
+bool Display::isVideoFormatSupported(FORMAT_VIDEO pixelfmt) {
+	FORMAT_VIDEO formats[DISPLAY_MAX_VIDEO_FORMATS];
+	U32 numFormats = getVideoFormats(formats);
+
+	for (U32 i = 0; i < numFormats; i++) {
+		if (formats[i] == pixelfmt)
+			return true;
+	}
+
+	return false;
 }
 
 Display *CreateDisplay(DISPLAY_TYPE displayType) {
@@ -41,6 +54,8 @@ Display *CreateDisplay(DISPLAY_TYPE displayType) {
 		return new DisplayOmapDrm();
 	case DISPLAY_OMAPDRM_EGL:
 		return new DisplayOmapDrmEgl();
+	case DISPLAY_NULL:
+		return new DisplayNull();
 	default:
 		return nullptr;
 	}
@@ -22,6 +22,8 @@
 #ifndef DISPLAY_BASE_H
 #define DISPLAY_BASE_H
 
+#include <atomic>
+
 #include "basetypes.h"
 #include "avtypes.h"
 #include "decoder_video_base.h"
@@ -30,6 +32,15 @@ struct omap_bo;
 
 namespace MediaPLayer {
 
+class Osd;
+
+#define DISPLAY_FLAG_CHECKSUM    (1 << 0) // checksum presented frames, null display only
+#define DISPLAY_FLAG_LEGACY_KMS  (1 << 1) // no atomic commits, omapdrm display only
+#define DISPLAY_FLAG_RGB565      (1 << 2) // 16 bit output to halve write bandwidth, fbdev display only
+
+#define DISPLAY_MAX_VIDEO_FORMATS 4
+#define DISPLAY_FLIP_TIMEOUT      100 // ms, page flip event wait before assuming it was lost
+
 typedef struct {
 	int     handle;
 } DisplayHandle;
@@ -38,14 +49,35 @@ typedef struct {
 	void           *priv;
 	U32            handle;
 	int            dmaBuf;
-	bool           locked;
+	// set while display holds buffer, cleared with release from present thread,
+	// decoder checks it with acquire before writing into buffer again
+	std::atomic<bool> locked;
+	FORMAT_VIDEO   pixelfmt;  // layout display created, may differ from requested one
+	void           *ptr;      // cpu mapping of whole buffer
+	U32            size;
+	U32            stride[4];
+	U32            offset[4];
 } DisplayVideoBuffer;
 
+typedef struct {
+	U32     sequence;      // vblank counter of last vblank
+	S64     time;          // us on CLOCK_MONOTONIC of that vblank
+	U32     flipSequence;  // vblank at which last completed flip reached screen
+	double  refresh;       // Hz
+} DisplayVblank;
+
+typedef struct {
+	U64     framesUploaded;  // frames written by cpu into display textures
+	U64     fenceWaits;      // uploads which blocked on gpu still reading texture
+	S64     fenceWaitTime;   // us
+} DisplayStats;
+
 class Display {
 protected:
 
 	bool	_initialized;
 	bool    _hwAccelDecode;
+	U32     _flags;
 
 public:
 
@@ -54,12 +86,27 @@ public:
 
 	virtual STATUS init(bool hwAccelDecode) = 0;
 	virtual STATUS deinit() = 0;
-	virtual STATUS configure(FORMAT_VIDEO videoFmt, int videoFps, int videoWidth, int videoHeight) = 0;
+	virtual STATUS configure(FORMAT_VIDEO videoFmt, float videoFps, int videoWidth, int videoHeight) = 0;
 	virtual STATUS putImage(VideoFrame *frame, bool skip) = 0;
 	virtual STATUS flip(bool skip) = 0;
 	virtual STATUS getHandle(DisplayHandle *handle) = 0;
 	virtual STATUS getDisplayVideoBuffer(DisplayVideoBuffer *handle, FORMAT_VIDEO pixelfmt, int width, int height) = 0;
 	virtual STATUS releaseDisplayVideoBuffer(DisplayVideoBuffer *handle) = 0;
+	// vblank counters of video output, S_FAIL if display can't provide them
+	virtual STATUS getVblank(DisplayVblank * /*vblank*/) { return S_FAIL; }
+	virtual STATUS waitForVblank(U32 /*sequence*/, DisplayVblank * /*vblank*/) { return S_FAIL; }
+	virtual STATUS getStats(DisplayStats * /*stats*/) { return S_FAIL; }
+	// Formats display buffers are scanned out or imported in without conversion,
+	// preferred first. Valid after configure(), decoders render into those directly.
+	virtual U32 getVideoFormats(FORMAT_VIDEO * /*formats*/) { return 0; }
+	bool isVideoFormatSupported(FORMAT_VIDEO pixelfmt);
+	// Rendering context of display is current on one thread only. Thread which is
+	// going to call putImage() and flip() attaches after configuring one detached.
+	virtual STATUS attachThread() { return S_OK; }
+	virtual STATUS detachThread() { return S_OK; }
+	// overlay drawn on top of video, nullptr if display has none
+	virtual Osd *getOsd() { return nullptr; }
+	void setFlags(U32 flags) { _flags = flags; }
 };
 
 Display *CreateDisplay(DISPLAY_TYPE displayType);
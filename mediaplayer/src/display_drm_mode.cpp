@@ -0,0 +1,108 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <math.h>
+
+#include "display_drm_mode.h"
+#include "logs.h"
+
+namespace MediaPLayer {
+
+double GetDrmModeRefresh(const drmModeModeInfo *mode) {
+	if (mode->htotal == 0 || mode->vtotal == 0)
+		return mode->vrefresh;
+
+	double refresh = mode->clock * 1000.0 / ((double)mode->htotal * mode->vtotal);
+	if (mode->flags & DRM_MODE_FLAG_DBLSCAN)
+		refresh /= 2;
+	if (mode->vscan > 1)
+		refresh /= mode->vscan;
+
+	return refresh;
+}
+
+static int selectFallbackMode(const drmModeConnector *connector, float videoFps) {
+	for (int i = 0; i < connector->count_modes; i++) {
+		const drmModeModeInfo *mode = &connector->modes[i];
+		if ((mode->vrefresh >= videoFps) && (mode->type & DRM_MODE_TYPE_PREFERRED))
+			return i;
+	}
+
+	int modeId = -1;
+	U64 highestArea = 0;
+	for (int i = 0; i < connector->count_modes; i++) {
+		const drmModeModeInfo *mode = &connector->modes[i];
+		const U64 area = mode->hdisplay * mode->vdisplay;
+		if ((mode->vrefresh >= videoFps) && (area > highestArea)) {
+			highestArea = area;
+			modeId = i;
+		}
+	}
+
+	return modeId;
+}
+
+int SelectDrmMode(const drmModeConnector *connector, float videoFps) {
+	int fallbackId = selectFallbackMode(connector, videoFps);
+	if (fallbackId == -1 || !(videoFps > 0))
+		return fallbackId;
+
+	const drmModeModeInfo *fallback = &connector->modes[fallbackId];
+	int modeId = -1;
+	double bestError = DRM_MODE_MATCH_TOLERANCE;
+	double bestRefresh = 0;
+
+	for (int i = 0; i < connector->count_modes; i++) {
+		const drmModeModeInfo *mode = &connector->modes[i];
+		if (mode->hdisplay != fallback->hdisplay || mode->vdisplay != fallback->vdisplay ||
+		    (mode->flags & DRM_MODE_FLAG_INTERLACE)) {
+			continue;
+		}
+
+		// every frame shown same number of vblanks, no 3:2 judder
+		double refresh = GetDrmModeRefresh(mode);
+		double multiple = round(refresh / videoFps);
+		if (multiple < 1)
+			continue;
+		double error = fabs(refresh - multiple * videoFps) / (multiple * videoFps);
+		if (error >= DRM_MODE_MATCH_TOLERANCE)
+			continue;
+
+		// on equal match higher refresh gives shorter latency
+		if (error < bestError - DRM_MODE_EQUAL_TOLERANCE ||
+		    (error < bestError + DRM_MODE_EQUAL_TOLERANCE && refresh > bestRefresh)) {
+			if (error < bestError)
+				bestError = error;
+			bestRefresh = refresh;
+			modeId = i;
+		}
+	}
+
+	if (modeId == -1) {
+		log->printf("SelectDrmMode(): No mode matches %.3f fps, using %.3f Hz\n",
+		            videoFps, GetDrmModeRefresh(fallback));
+		return fallbackId;
+	}
+
+	return modeId;
+}
+
+} // namespace
@@ -0,0 +1,44 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef DISPLAY_DRM_MODE_H
+#define DISPLAY_DRM_MODE_H
+
+#include "basetypes.h"
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+namespace MediaPLayer {
+
+#define DRM_MODE_MATCH_TOLERANCE 0.01 // relative refresh error accepted as match
+#define DRM_MODE_EQUAL_TOLERANCE 0.0005 // matches closer than this are equally good
+
+// Refresh rate from pixel clock, keeps 1000/1001 rates apart unlike vrefresh.
+double GetDrmModeRefresh(const drmModeModeInfo *mode);
+
+// Picks mode at preferred resolution with refresh equal to video frame rate
+// or its integer multiple. Falls back to preferred mode if none matches or
+// frame rate is unknown (0). Returns -1 if connector has no usable mode.
+int SelectDrmMode(const drmModeConnector *connector, float videoFps);
+
+} // namespace
+
+#endif
@@ -32,13 +32,15 @@
 
 #include "display_base.h"
 #include "display_fbdev.h"
+#include "colorconvert.h"
 #include "logs.h"
 
 namespace MediaPLayer {
 
 DisplayFBDev::DisplayFBDev() :
 		_fd(-1), _fbPtr(nullptr), _fbSize(0), _fbStride(0),
-		_fbWidth(0), _fbHeight(0), _scaleCtx(nullptr) {
+		_fbWidth(0), _fbHeight(0), _fbBpp(0), _numBuffers(1), _backBuffer(0),
+		_waitForVsync(true), _dstWidth(0), _dstHeight(0), _clearBuffers(0) {
 }
 
 DisplayFBDev::~DisplayFBDev() {
@@ -65,6 +67,8 @@ STATUS DisplayFBDev::deinit() {
 }
 
 STATUS DisplayFBDev::internalInit() {
+	struct fb_var_screeninfo origVinfo;
+
 	_fd = open("/dev/fb0", O_RDWR);
 	if (_fd == -1) {
 		log->printf("DisplayFBDev::internalInit(): Failed open /dev/fb0 %s\n", strerror(errno));
@@ -75,17 +79,40 @@ STATUS DisplayFBDev::internalInit() {
 		log->printf("DisplayFBDev::internalInit(): Failed FBIOGET_VSCREENINFO on /dev/fb0. %s\n", strerror(errno));
 		goto fail;
 	}
+	origVinfo = _vinfo;
+
+	if (_flags & DISPLAY_FLAG_RGB565) {
+		_vinfo.bits_per_pixel = 16;
+		_vinfo.red.offset = 11;
+		_vinfo.red.length = 5;
+		_vinfo.green.offset = 5;
+		_vinfo.green.length = 6;
+		_vinfo.blue.offset = 0;
+		_vinfo.blue.length = 5;
+		_vinfo.transp.offset = 0;
+		_vinfo.transp.length = 0;
+	}
 
-	_vinfo.xres_virtual = _vinfo.xres;
-	_vinfo.yres_virtual = _vinfo.yres;
+	if (setScreenInfo() == S_FAIL) {
+		if (!(_flags & DISPLAY_FLAG_RGB565))
+			goto fail;
+		// keep running in original mode rather than exit
+		log->printf("DisplayFBDev::internalInit(): RGB565 refused by driver, using %u bpp\n", origVinfo.bits_per_pixel);
+		_vinfo = origVinfo;
+		if (setScreenInfo() == S_FAIL)
+			goto fail;
+	}
 
-	if (ioctl(_fd, FBIOPUT_VSCREENINFO, &_vinfo) == -1) {
-		log->printf("DisplayFBDev::internalInit(): Failed FBIOPUT_VSCREENINFO on /dev/fb0. %s\n", strerror(errno));
+	// driver may adjust what was asked for
+	if (ioctl(_fd, FBIOGET_VSCREENINFO, &_vinfo) == -1) {
+		log->printf("DisplayFBDev::internalInit(): Failed FBIOGET_VSCREENINFO on /dev/fb0. %s\n", strerror(errno));
 		goto fail;
 	}
 
-	if (_vinfo.bits_per_pixel != 32) {
-		log->printf("DisplayFBDev::internalInit(): Display buffer is not 32 bits per pixel!\n");
+	if (_vinfo.bits_per_pixel != 32 &&
+	    !(_vinfo.bits_per_pixel == 16 && _vinfo.red.offset == 11 && _vinfo.red.length == 5 &&
+	      _vinfo.green.offset == 5 && _vinfo.green.length == 6 && _vinfo.blue.offset == 0)) {
+		log->printf("DisplayFBDev::internalInit(): Display buffer is not 32 bits or RGB565!\n");
 		goto fail;
 	}
 
@@ -108,6 +135,13 @@ STATUS DisplayFBDev::internalInit() {
 	_fbStride = _finfo.line_length;
 	_fbWidth = _vinfo.xres;
 	_fbHeight = _vinfo.yres;
+	_fbBpp = _vinfo.bits_per_pixel;
+	_numBuffers = 1;
+	if (_vinfo.yres_virtual >= _fbHeight * FBDEV_NUM_BUFFERS && _fbSize >= _fbStride * _fbHeight * FBDEV_NUM_BUFFERS)
+		_numBuffers = FBDEV_NUM_BUFFERS;
+	_backBuffer = _numBuffers - 1;
+	_dstWidth = _dstHeight = 0;
+	_clearBuffers = 0;
 	_fbPtr = static_cast<U8 *>(mmap(0, _fbSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0));
 	if (_fbPtr == reinterpret_cast<void *>(-1)) {
 		log->printf("DisplayFBDev::internalInit(): Failed get frame buffer! %s\n", strerror(errno));
@@ -115,7 +149,8 @@ STATUS DisplayFBDev::internalInit() {
 	}
 
 	memset(_fbPtr, 0, _fbSize);
-	_scaleCtx = nullptr;
+
+	log->printf("Using display fbdev: %ux%u, %u bpp, %u buffers\n", _fbWidth, _fbHeight, _fbBpp, _numBuffers);
 
 	_initialized = true;
 	return S_OK;
@@ -128,32 +163,47 @@ fail:
 	return S_FAIL;
 }
 
+STATUS DisplayFBDev::setScreenInfo() {
+	// back buffer is second screen below visible one
+	_vinfo.xres_virtual = _vinfo.xres;
+	_vinfo.yres_virtual = _vinfo.yres * FBDEV_NUM_BUFFERS;
+	_vinfo.xoffset = 0;
+	_vinfo.yoffset = 0;
+
+	if (ioctl(_fd, FBIOPUT_VSCREENINFO, &_vinfo) == -1) {
+		log->printf("DisplayFBDev::setScreenInfo(): No room for back buffer, frames may tear\n");
+		_vinfo.yres_virtual = _vinfo.yres;
+		if (ioctl(_fd, FBIOPUT_VSCREENINFO, &_vinfo) == -1) {
+			log->printf("DisplayFBDev::setScreenInfo(): Failed FBIOPUT_VSCREENINFO on /dev/fb0. %s\n", strerror(errno));
+			return S_FAIL;
+		}
+	}
+
+	return S_OK;
+}
+
 void DisplayFBDev::internalDeinit() {
 	if (_initialized == false)
 		return;
 
-	if (_scaleCtx) {
-		sws_freeContext(_scaleCtx);
-		_scaleCtx = nullptr;
-	}
-
 	if (_fbPtr) {
 		memset(_fbPtr, 0, _fbSize);
 		munmap(_fbPtr, _fbSize);
+		_fbPtr = nullptr;
+	}
+
+	if (_numBuffers > 1) {
+		_vinfo.yoffset = 0;
+		ioctl(_fd, FBIOPAN_DISPLAY, &_vinfo);
 	}
 
 	if (_fd != -1)
 		close(_fd);
 
-	if (!_scaleCtx) {
-		sws_freeContext(_scaleCtx);
-		_scaleCtx = nullptr;
-	}
-
 	_initialized = false;
 }
 
-STATUS DisplayFBDev::configure(FORMAT_VIDEO /*videoFmt*/, int /*videoFps*/,
+STATUS DisplayFBDev::configure(FORMAT_VIDEO /*videoFmt*/, float /*videoFps*/,
 			int /*videoWidth*/, int /*videoHeight*/) {
 	// nothing
 
@@ -161,10 +211,10 @@ STATUS DisplayFBDev::configure(FORMAT_VIDEO /*videoFmt*/, int /*videoFps*/,
 }
 
 STATUS DisplayFBDev::putImage(VideoFrame *frame, bool skip) {
-	U32 dstX = (_fbWidth - frame->width) / 2;
-	U32 dstY = (_fbHeight - frame->height) / 2;
+	U32 width, height, dstWidth, dstHeight, dstX, dstY;
+	U8 *backPtr;
 
-	if (frame == nullptr || frame->data[0] == nullptr) {
+	if (frame == nullptr || frame->data[0] == nullptr || frame->dw <= 0 || frame->dh <= 0) {
 		log->printf("DisplayFBDev::putImage(): Bad arguments!\n");
 		goto fail;
 	}
@@ -172,28 +222,60 @@ STATUS DisplayFBDev::putImage(VideoFrame *frame, bool skip) {
 	if (skip)
 		return S_OK;
 
-	if (frame->pixelfmt == FMT_YUV420P) {
-		uint8_t *srcPtr[4] = { frame->data[0], frame->data[1], frame->data[2], NULL };
-		int srcStride[4] = { static_cast<int>(frame->stride[0]),
-				static_cast<int>(frame->stride[1]),
-				static_cast<int>(frame->stride[2]), 0 };
-		uint8_t *dstPtr[4] = { _fbPtr + _fbStride * dstY + dstX * 4, NULL, NULL, NULL };
-		int dstStride[4] = { static_cast<int>(_fbStride), 0, 0, 0 };
-
-		if (!_scaleCtx) {
-			_scaleCtx = sws_getContext(frame->width, frame->height, AV_PIX_FMT_YUV420P, frame->width, frame->height,
-										AV_PIX_FMT_RGB32, SWS_POINT, NULL, NULL, NULL);
-			if (!_scaleCtx) {
-				log->printf("DisplayFBDev::putImage(): Can not create scale context!\n");
-				goto fail;
-			}
-		}
-		sws_scale(_scaleCtx, srcPtr, srcStride, 0, frame->height, dstPtr, dstStride);
-	} else {
+	if (frame->pixelfmt != FMT_YUV420P) {
 		log->printf("DisplayFBDev::putImage(): Can not handle pixel format!\n");
 		goto fail;
 	}
 
+	// scaled to screen keeping aspect, same as other displays
+	width = frame->dw;
+	height = frame->dh;
+	if (frame->anistropicDVD) {
+		dstWidth = _fbWidth;
+		dstHeight = _fbHeight;
+	} else if ((U64)width * _fbHeight >= (U64)height * _fbWidth) {
+		dstWidth = _fbWidth;
+		dstHeight = MAX((U32)((U64)height * _fbWidth / width), 1);
+	} else {
+		dstWidth = MAX((U32)((U64)width * _fbHeight / height), 2);
+		dstHeight = _fbHeight;
+	}
+	dstWidth &= ~1;
+
+	if (dstWidth != _dstWidth || dstHeight != _dstHeight) {
+		// borders of every buffer change with video size
+		_clearBuffers = (1 << _numBuffers) - 1;
+		_dstWidth = dstWidth;
+		_dstHeight = dstHeight;
+	}
+	dstX = (_fbWidth - dstWidth) / 2;
+	dstY = (_fbHeight - dstHeight) / 2;
+
+	backPtr = _fbPtr + _fbStride * _fbHeight * _backBuffer;
+
+	// front buffer is scanned out, it gets cleared once it becomes back buffer
+	if (_clearBuffers & (1 << _backBuffer)) {
+		memset(backPtr, 0, _fbStride * _fbHeight);
+		_clearBuffers &= ~(1 << _backBuffer);
+	}
+
+	{
+		ColorConvertJob job = {};
+		job.op = COLOR_CONVERT_YUV420_TO_RGB_SCALED;
+		job.src = { { frame->data[0], frame->data[1], frame->data[2] },
+		            { frame->stride[0], frame->stride[1], frame->stride[2] } };
+		job.dst = { { backPtr + _fbStride * dstY + dstX * (_fbBpp / 8), nullptr, nullptr },
+		            { _fbStride, 0, 0 } };
+		job.bpp = _fbBpp;
+		job.x = frame->dx;
+		job.y = frame->dy;
+		job.width = width;
+		job.height = height;
+		job.dstWidth = dstWidth;
+		job.dstHeight = dstHeight;
+		ColorConvertRun(nullptr, &job);
+	}
+
 	return S_OK;
 
 fail:
@@ -201,8 +283,31 @@ fail:
 }
 
 STATUS DisplayFBDev::flip(bool skip) {
+	if (!_initialized)
+		return S_FAIL;
 
-	// nothing
+	if (skip)
+		return S_OK;
+
+	if (_numBuffers == 1)
+		return S_OK;
+
+	_vinfo.yoffset = _fbHeight * _backBuffer;
+	if (ioctl(_fd, FBIOPAN_DISPLAY, &_vinfo) == -1) {
+		log->printf("DisplayFBDev::flip(): Failed FBIOPAN_DISPLAY: %s\n", strerror(errno));
+		return S_FAIL;
+	}
+
+	// pan may latch at next vsync, old front buffer is free only once it passed
+	if (_waitForVsync) {
+		U32 screen = 0;
+		if (ioctl(_fd, FBIO_WAITFORVSYNC, &screen) == -1) {
+			log->printf("DisplayFBDev::flip(): No FBIO_WAITFORVSYNC, frames may tear: %s\n", strerror(errno));
+			_waitForVsync = false;
+		}
+	}
+
+	_backBuffer = (_backBuffer + 1) % _numBuffers;
 
 	return S_OK;
 }
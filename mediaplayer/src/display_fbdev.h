@@ -25,17 +25,12 @@
 #include <linux/fb.h>
 #include "display_base.h"
 
-#ifdef __cplusplus
-extern "C"
-{
-    #include <libswscale/swscale.h>
-}
-#endif
-
 #include "basetypes.h"
 
 namespace MediaPLayer {
 
+#define FBDEV_NUM_BUFFERS 2
+
 class DisplayFBDev : public Display {
 private:
 
@@ -46,7 +41,12 @@ private:
 	U32                         _fbSize;
 	U32                         _fbStride;
 	U32                         _fbWidth, _fbHeight;
-	SwsContext                 *_scaleCtx;
+	U32                         _fbBpp;
+	U32                         _numBuffers;   // 1 if virtual screen can't hold back buffer
+	U32                         _backBuffer;   // index of buffer not being scanned out
+	bool                        _waitForVsync;
+	U32                         _dstWidth, _dstHeight; // scaled video size, borders are black
+	U32                         _clearBuffers; // bit per buffer still having borders of old size
 
 public:
 
@@ -55,7 +55,7 @@ public:
 
 	STATUS init(bool hwAccelDecode);
 	STATUS deinit();
-	STATUS configure(FORMAT_VIDEO videoFmt, int videoFps, int videoWidth, int videoHeight);
+	STATUS configure(FORMAT_VIDEO videoFmt, float videoFps, int videoWidth, int videoHeight);
 	STATUS putImage(VideoFrame *frame, bool skip);
 	STATUS flip(bool skip);
 	STATUS getHandle(DisplayHandle *handle) { return S_FAIL; };
@@ -66,6 +66,7 @@ private:
 
 	STATUS internalInit();
 	void internalDeinit();
+	STATUS setScreenInfo();
 };
 
 } // namespace
@@ -0,0 +1,383 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include "display_null.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <xf86drm.h>
+
+extern "C" {
+	#include <libavutil/adler32.h>
+}
+
+#include "display_base.h"
+#include "logs.h"
+
+namespace MediaPLayer {
+
+DisplayNull::DisplayNull() :
+		_fd(-1), _currentBuffer(nullptr), _checksum(1), _numFrames(0) {
+}
+
+DisplayNull::~DisplayNull() {
+	deinit();
+}
+
+STATUS DisplayNull::init(bool hwAccelDecode) {
+	if (_initialized)
+		return S_FAIL;
+
+	_hwAccelDecode = hwAccelDecode;
+
+	if (internalInit() == S_FAIL)
+		return S_FAIL;
+
+	return S_OK;
+}
+
+STATUS DisplayNull::deinit() {
+	// nothing to tear down, teardown paths call it unconditionally
+	if (!_initialized)
+		return S_OK;
+
+	internalDeinit();
+
+	return S_OK;
+}
+
+STATUS DisplayNull::internalInit() {
+	drmDevice *devices[DRM_MAX_MINOR] = { 0 };
+
+	// connected output is not needed, device is used only for buffers
+	int card_count = drmGetDevices2(0, devices, SIZE_OF_ARRAY(devices));
+	for (int i = 0; i < card_count; i++) {
+		drmDevice *dev = devices[i];
+		if (!(dev->available_nodes & (1 << DRM_NODE_PRIMARY))) {
+			continue;
+		}
+		_fd = open(dev->nodes[DRM_NODE_PRIMARY], O_RDWR | O_CLOEXEC);
+		if (_fd >= 0)
+			break;
+	}
+	if (card_count > 0)
+		drmFreeDevices(devices, card_count);
+
+	if (_fd < 0) {
+		if (_hwAccelDecode) {
+			log->printf("DisplayNull::internalInit(): No DRM device for hardware decoder buffers!\n");
+			return S_FAIL;
+		}
+		log->printf("DisplayNull::internalInit(): No DRM device, using heap buffers\n");
+	}
+
+	_currentBuffer = nullptr;
+	_checksum = 1;
+	_numFrames = 0;
+	_initialized = true;
+
+	return S_OK;
+}
+
+void DisplayNull::internalDeinit() {
+	if (_initialized == false)
+		return;
+
+	if (_flags & DISPLAY_FLAG_CHECKSUM) {
+		log->printf("DisplayNull: frames: %llu, checksum: %08x\n", _numFrames, _checksum);
+	}
+
+	if (_currentBuffer) {
+		_currentBuffer->locked.store(false, std::memory_order_release);
+		_currentBuffer = nullptr;
+	}
+
+	if (_fd != -1) {
+		drmClose(_fd);
+		_fd = -1;
+	}
+
+	_initialized = false;
+}
+
+STATUS DisplayNull::configure(FORMAT_VIDEO videoFmt, float videoFps, int videoWidth, int videoHeight) {
+	if (_initialized == false)
+		return S_FAIL;
+
+	switch (videoFmt) {
+	case FMT_YUV420P:
+	case FMT_NV12:
+	case FMT_RGB24:
+	case FMT_ARGB:
+		break;
+	default:
+		log->printf("DisplayNull::configure(): Not supported format!\n");
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+void DisplayNull::checksumPlane(const U8 *ptr, U32 stride, U32 width, U32 height) {
+	for (U32 y = 0; y < height; y++) {
+		_checksum = av_adler32_update(_checksum, ptr, width);
+		ptr += stride;
+	}
+}
+
+STATUS DisplayNull::putImage(VideoFrame *frame, bool skip) {
+	if (frame == nullptr || frame->data[0] == nullptr) {
+		log->printf("DisplayNull::putImage(): Bad arguments!\n");
+		return S_FAIL;
+	}
+
+	_numFrames++;
+
+	if (_hwAccelDecode) {
+		DisplayVideoBuffer *db = (DisplayVideoBuffer *)(frame->data[0]);
+		db->locked = true;
+		_currentBuffer = db;
+		if (_flags & DISPLAY_FLAG_CHECKSUM) {
+			VideoBuffer *videoBuffer = (VideoBuffer *)db->priv;
+			const U8 *y = (const U8 *)videoBuffer->ptr;
+			const U8 *uv = y + videoBuffer->stride * videoBuffer->height;
+			checksumPlane(y + frame->dy * videoBuffer->stride + frame->dx,
+			              videoBuffer->stride, frame->dw, frame->dh);
+			checksumPlane(uv + (frame->dy / 2) * videoBuffer->stride + (frame->dx & ~1),
+			              videoBuffer->stride, ALIGN2(frame->dw, 1), (frame->dh + 1) / 2);
+		}
+		return S_OK;
+	}
+
+	if (frame->displayBuffer) {
+		// software decoder rendered into our buffer, hold it like hardware one
+		DisplayVideoBuffer *db = (DisplayVideoBuffer *)frame->displayBuffer;
+		db->locked = true;
+		_currentBuffer = db;
+	}
+
+	if (!(_flags & DISPLAY_FLAG_CHECKSUM))
+		return S_OK;
+
+	switch (frame->pixelfmt) {
+	case FMT_YUV420P:
+		checksumPlane(frame->data[0], frame->stride[0], frame->dw, frame->dh);
+		checksumPlane(frame->data[1], frame->stride[1], (frame->dw + 1) / 2, (frame->dh + 1) / 2);
+		checksumPlane(frame->data[2], frame->stride[2], (frame->dw + 1) / 2, (frame->dh + 1) / 2);
+		break;
+	case FMT_NV12:
+		checksumPlane(frame->data[0], frame->stride[0], frame->dw, frame->dh);
+		checksumPlane(frame->data[1], frame->stride[1], ALIGN2(frame->dw, 1), (frame->dh + 1) / 2);
+		break;
+	case FMT_RGB24:
+		checksumPlane(frame->data[0], frame->stride[0], frame->dw * 3, frame->dh);
+		break;
+	case FMT_ARGB:
+		checksumPlane(frame->data[0], frame->stride[0], frame->dw * 4, frame->dh);
+		break;
+	default:
+		log->printf("DisplayNull::putImage(): Not supported format!\n");
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+STATUS DisplayNull::flip(bool skip) {
+	if (!_initialized)
+		return S_FAIL;
+
+	// nothing scans out, buffer can go back to decoder right away
+	if (_currentBuffer) {
+		_currentBuffer->locked.store(false, std::memory_order_release);
+		_currentBuffer = nullptr;
+	}
+
+	return S_OK;
+}
+
+STATUS DisplayNull::getHandle(DisplayHandle *handle) {
+	if (!_initialized || handle == nullptr || _fd == -1)
+		return S_FAIL;
+
+	handle->handle = _fd;
+
+	return S_OK;
+};
+
+U32 DisplayNull::getVideoFormats(FORMAT_VIDEO *formats) {
+	if (!_initialized || formats == nullptr)
+		return 0;
+
+	// nothing is scanned out, every layout buffers can be created in is native
+	formats[0] = FMT_YUV420P;
+	formats[1] = FMT_NV12;
+	formats[2] = FMT_RGB24;
+	formats[3] = FMT_ARGB;
+
+	return 4;
+}
+
+STATUS DisplayNull::getDisplayVideoBuffer(DisplayVideoBuffer *handle, FORMAT_VIDEO pixelfmt, int width, int height) {
+	if (!_initialized || handle == nullptr)
+		return S_FAIL;
+
+	U32 size;
+	memset(handle->stride, 0, sizeof(handle->stride));
+	memset(handle->offset, 0, sizeof(handle->offset));
+	switch (pixelfmt) {
+	case FMT_YUV420P:
+		size = width * height * 3 / 2;
+		handle->stride[0] = width;
+		handle->stride[1] = handle->stride[2] = width / 2;
+		handle->offset[1] = width * height;
+		handle->offset[2] = width * height + (width / 2) * (height / 2);
+		break;
+	case FMT_NV12:
+		size = width * height * 3 / 2;
+		handle->stride[0] = handle->stride[1] = width;
+		handle->offset[1] = width * height;
+		break;
+	case FMT_RGB24:
+		size = width * height * 3;
+		handle->stride[0] = width * 3;
+		break;
+	case FMT_ARGB:
+		size = width * height * 4;
+		handle->stride[0] = width * 4;
+		break;
+	default:
+		log->printf("DisplayNull::getDisplayVideoBuffer(): Not supported format!\n");
+		return S_FAIL;
+	}
+
+	VideoBuffer *videoBuffer = new VideoBuffer;
+	memset(videoBuffer, 0, sizeof(VideoBuffer));
+	videoBuffer->dmaBuf = -1;
+
+	if (_fd != -1) {
+		struct drm_mode_create_dumb creq = {
+			.height = size,
+			.width = 1,
+			.bpp = 8,
+		};
+		if (drmIoctl(_fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
+			log->printf("DisplayNull::getDisplayVideoBuffer(): Cannot create dumb buffer: %s\n", strerror(errno));
+			goto fail;
+		}
+		videoBuffer->handle = creq.handle;
+
+		struct drm_mode_map_dumb mreq = {
+			.handle = creq.handle,
+		};
+		if (drmIoctl(_fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq)) {
+			log->printf("DisplayNull::getDisplayVideoBuffer(): Cannot map dumb buffer: %s\n", strerror(errno));
+			goto fail;
+		}
+
+		void *map = mmap(0, creq.size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, mreq.offset);
+		if (map == MAP_FAILED) {
+			log->printf("DisplayNull::getDisplayVideoBuffer(): Cannot map dumb buffer: %s\n", strerror(errno));
+			goto fail;
+		}
+		videoBuffer->ptr = map;
+
+		if (drmPrimeHandleToFD(_fd, creq.handle, DRM_CLOEXEC, &videoBuffer->dmaBuf)) {
+			log->printf("DisplayNull::getDisplayVideoBuffer(): Cannot exports a dma-buf: %s\n", strerror(errno));
+			goto fail;
+		}
+	} else {
+		if (posix_memalign(&videoBuffer->ptr, 4096, size) != 0) {
+			log->printf("DisplayNull::getDisplayVideoBuffer(): out of memory!\n");
+			videoBuffer->ptr = nullptr;
+			goto fail;
+		}
+	}
+
+	videoBuffer->width = width;
+	videoBuffer->height = height;
+	videoBuffer->stride = width;
+	videoBuffer->size = size;
+
+	handle->priv = videoBuffer;
+	handle->handle = videoBuffer->handle;
+	handle->dmaBuf = videoBuffer->dmaBuf;
+	handle->locked = false;
+	handle->pixelfmt = pixelfmt;
+	handle->ptr = videoBuffer->ptr;
+	handle->size = size;
+
+	return S_OK;
+
+fail:
+
+	if (_fd != -1) {
+		if (videoBuffer->dmaBuf != -1)
+			close(videoBuffer->dmaBuf);
+		if (videoBuffer->ptr)
+			munmap(videoBuffer->ptr, size);
+		if (videoBuffer->handle > 0) {
+			struct drm_mode_destroy_dumb dreq = {
+				.handle = videoBuffer->handle,
+			};
+			drmIoctl(_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+		}
+	}
+	delete videoBuffer;
+
+	return S_FAIL;
+};
+
+STATUS DisplayNull::releaseDisplayVideoBuffer(DisplayVideoBuffer *handle) {
+	if (!_initialized || handle == nullptr)
+		return S_FAIL;
+
+	VideoBuffer *videoBuffer = (VideoBuffer *)handle->priv;
+	if (videoBuffer == nullptr)
+		return S_FAIL;
+
+	if (videoBuffer->handle > 0) {
+		close(videoBuffer->dmaBuf);
+		munmap(videoBuffer->ptr, videoBuffer->size);
+		struct drm_mode_destroy_dumb dreq = {
+			.handle = videoBuffer->handle,
+		};
+		drmIoctl(_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+	} else {
+		free(videoBuffer->ptr);
+	}
+
+	if (_currentBuffer == handle)
+		_currentBuffer = nullptr;
+
+	delete videoBuffer;
+
+	handle->handle = 0;
+	handle->priv = nullptr;
+
+	return S_OK;
+};
+
+} // namespace
@@ -0,0 +1,75 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef DISPLAY_NULL_H
+#define DISPLAY_NULL_H
+
+#include "display_base.h"
+#include "basetypes.h"
+#include <cstdint>
+
+namespace MediaPLayer {
+
+// Display without output, used to measure demux and decode throughput.
+// Video buffers are DRM dumb buffers when any DRM device is present
+// (required by hardware decoder), otherwise plain heap allocations.
+class DisplayNull : public Display {
+private:
+
+	typedef struct {
+		int             dmaBuf;
+		uint32_t        handle;
+		void            *ptr;
+		U32             width, height;
+		U32             stride;
+		U32             size;
+	} VideoBuffer;
+
+	int                         _fd;
+	DisplayVideoBuffer          *_currentBuffer;
+	U32                         _checksum;
+	U64                         _numFrames;
+
+public:
+
+	DisplayNull();
+	~DisplayNull();
+
+	STATUS init(bool hwAccelDecode);
+	STATUS deinit();
+	STATUS configure(FORMAT_VIDEO videoFmt, float videoFps, int videoWidth, int videoHeight);
+	STATUS putImage(VideoFrame *frame, bool skip);
+	STATUS flip(bool skip);
+	STATUS getHandle(DisplayHandle *handle);
+	STATUS getDisplayVideoBuffer(DisplayVideoBuffer *handle, FORMAT_VIDEO pixelfmt, int width, int height);
+	STATUS releaseDisplayVideoBuffer(DisplayVideoBuffer *handle);
+	U32 getVideoFormats(FORMAT_VIDEO *formats);
+
+private:
+
+	STATUS internalInit();
+	void internalDeinit();
+	void checksumPlane(const U8 *ptr, U32 stride, U32 width, U32 height);
+};
+
+} // namespace
+
+#endif
@@ -26,34 +26,27 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#include <poll.h>
 #include <sys/mman.h>
 #include <xf86drm.h>
 #include "display_base.h"
+#include "colorconvert.h"
+#include "display_drm_mode.h"
 #include "logs.h"
 
-static struct frame_info {
-	unsigned int w;
-	unsigned int h;
-	unsigned int dx;
-	unsigned int dy;
-	unsigned int dw;
-	unsigned int dh;
-	unsigned int y_stride;
-	unsigned int uv_stride;
-} yuv420_frame_info, nv12_frame_info;
-
-extern "C" int yuv420_to_nv12_convert(unsigned char *vdst[3], unsigned char *vsrc[3], unsigned char *, unsigned char *);
-extern "C" void yuv420_to_nv12_open(struct frame_info *dst, struct frame_info *src);
-
 namespace MediaPLayer {
 
 DisplayOmapDrm::DisplayOmapDrm() :
 		_fd(-1), _drmResources(nullptr),
 		_oldCrtc(nullptr),  _drmPlaneResources(nullptr), _connectorId(-1),
-		_crtcId(-1), _osdPlaneId(-1), _videoPlaneId(-1),
+		_crtcId(-1), _crtcIndex(-1), _osdPlaneId(-1), _videoPlaneId(-1), _numVideoFormats(0),
 		_primaryHandle(0), _primaryFbId(0), _primarySize(0), _primaryPtr(nullptr),
-		_currentOSDBuffer(), _currentVideoBuffer(0),
-		_scaleCtx(nullptr) {
+		_primaryWidth(0), _primaryHeight(0),
+		_currentVideoBuffer(0), _osdFbId(0), _osdNextFbId(0), _osdUpdate(false), _osdPlaneDisable(true),
+		_pendingVideoBuffer(nullptr), _displayedVideoBuffer(nullptr),
+		_flipPending(false), _pageFlipEvents(true), _flipSequence(0),
+		_atomic(false), _osdPlaneProps(), _videoPlaneProps(),
+		_outFencePtrProp(0), _outFence(-1) {
 }
 
 DisplayOmapDrm::~DisplayOmapDrm() {
@@ -111,6 +104,8 @@ STATUS DisplayOmapDrm::internalInit() {
 	}
 
 	drmModeConnectorPtr connector;
+	uint32_t fallbackConnectorId;
+	fallbackConnectorId = -1;
 	for (int i = 0; i < _drmResources->count_connectors; i++) {
 		connector = drmModeGetConnector(_fd, _drmResources->connectors[i]);
 		if (connector == nullptr)
@@ -126,10 +121,16 @@ STATUS DisplayOmapDrm::internalInit() {
 			drmModeFreeConnector(connector);
 			break;
 		}
+		// other outputs like vkms virtual one are used only without HDMI
+		if (fallbackConnectorId == -1)
+			fallbackConnectorId = connector->connector_id;
+		drmModeFreeConnector(connector);
 	}
+	if (_connectorId == -1)
+		_connectorId = fallbackConnectorId;
 
 	if (_connectorId == -1) {
-		log->printf("DisplayOmapDrm::internalInit(): Failed to find active HDMI connector!\n");
+		log->printf("DisplayOmapDrm::internalInit(): Failed to find active connector!\n");
 		goto fail;
 	}
 
@@ -160,20 +161,19 @@ void DisplayOmapDrm::internalDeinit() {
 	if (_initialized == false)
 		return;
 
-	for (int i = 0; i < NUM_OSD_FB; i++) {
-		if (_osdBuffers[i].fbId) {
-			drmModeRmFB(_fd, _osdBuffers[i].fbId);
-		}
-		if (_osdBuffers[i].ptr) {
-			munmap(_osdBuffers[i].ptr, _osdBuffers[i].size);
-		}
-		if (_osdBuffers[i].handle > 0) {
-			struct drm_mode_destroy_dumb dreq = {
-				.handle = _osdBuffers[i].handle,
-			};
-			drmIoctl(_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+	// buffers can't be freed while scanout still reads them
+	waitForFlip();
+	returnVideoBuffer(_displayedVideoBuffer);
+	_displayedVideoBuffer = nullptr;
+
+	releaseOsdBuffers();
+	_osd.setSize(0, 0);
+
+	for (int i = 0; i < NUM_VIDEO_FB; i++) {
+		if (_directVideoBuffers[i]) {
+			_directVideoBuffers[i]->db->locked.store(false, std::memory_order_release);
+			_directVideoBuffers[i] = nullptr;
 		}
-		_osdBuffers[i] = {};
 	}
 
 	if (!_hwAccelDecode) {
@@ -201,19 +201,7 @@ void DisplayOmapDrm::internalDeinit() {
 		_oldCrtc = nullptr;
 	}
 
-	if (_primaryFbId) {
-		drmModeRmFB(_fd, _primaryFbId);
-		_primaryFbId = 0;
-	}
-	if (_primaryPtr) {
-		munmap(_primaryPtr, _primarySize);
-	}
-	if (_primaryHandle > 0) {
-		struct drm_mode_destroy_dumb dreq = {
-			.handle = _primaryHandle,
-		};
-		drmIoctl(_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
-	}
+	releasePrimaryBuffer();
 
 	if (_drmPlaneResources != nullptr)
 		drmModeFreePlaneResources(_drmPlaneResources);
@@ -227,7 +215,7 @@ void DisplayOmapDrm::internalDeinit() {
 	_initialized = false;
 }
 
-STATUS DisplayOmapDrm::configure(FORMAT_VIDEO videoFmt, int videoFps, int videoWidth, int videoHeight) {
+STATUS DisplayOmapDrm::configure(FORMAT_VIDEO videoFmt, float videoFps, int videoWidth, int videoHeight) {
 	int modeId = -1;
 	_crtcId = -1;
 
@@ -248,26 +236,7 @@ STATUS DisplayOmapDrm::configure(FORMAT_VIDEO videoFmt, int videoFps, int videoW
 		return S_FAIL;
 	}
 
-	for (int j = 0; j < connector->count_modes; j++) {
-		auto mode = &connector->modes[j];
-		if ((mode->vrefresh >= videoFps) && (mode->type & DRM_MODE_TYPE_PREFERRED)) {
-			modeId = j;
-			break;
-		}
-	}
-
-	if (modeId == -1) {
-		U64 hightestArea = 0;
-		for (int j = 0; j < connector->count_modes; j++) {
-			auto mode = &connector->modes[j];
-			const U64 area = mode->hdisplay * mode->vdisplay;
-			if ((mode->vrefresh >= videoFps) && (area > hightestArea))
-			{
-				hightestArea = area;
-				modeId = j;
-			}
-		}
-	}
+	modeId = SelectDrmMode(connector, videoFps);
 
 	for (int i = 0; i < connector->count_encoders; i++) {
 		auto encoder = drmModeGetEncoder(_fd, connector->encoders[i]);
@@ -299,10 +268,10 @@ STATUS DisplayOmapDrm::configure(FORMAT_VIDEO videoFmt, int videoFps, int videoW
 		return S_FAIL;
 	}
 
-	int crtcIndex = -1;
+	_crtcIndex = -1;
     for (int i = 0; i < _drmResources->count_crtcs; i++) {
         if (_drmResources->crtcs[i] == _crtcId) {
-            crtcIndex = i;
+            _crtcIndex = i;
             break;
         }
     }
@@ -314,7 +283,7 @@ STATUS DisplayOmapDrm::configure(FORMAT_VIDEO videoFmt, int videoFps, int videoW
 		if (plane == nullptr)
 			continue;
         uint32_t possible_crtcs = plane->possible_crtcs;
-        if (possible_crtcs & (1 << crtcIndex)) {
+        if (possible_crtcs & (1 << _crtcIndex)) {
             drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(_fd, plane->plane_id, DRM_MODE_OBJECT_PLANE);
             if (!props) {
                 log->printf("DisplayOmapDrm::configure(): Failed to find properties for plane!\n");
@@ -346,152 +315,64 @@ STATUS DisplayOmapDrm::configure(FORMAT_VIDEO videoFmt, int videoFps, int videoW
 		log->printf("DisplayOmapDrm::configure(): Failed to find plane!\n");
 		return S_FAIL;
 	}
+	readVideoFormats();
 
-	drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(_fd, _osdPlaneId, DRM_MODE_OBJECT_PLANE);
-	if (!props) {
-		log->printf("DisplayOmapDrm::configure(): Failed to find properties for plane!\n");
-		return S_FAIL;
-	}
-	for (int i = 0; i < props->count_props; i++) {
-		drmModePropertyPtr prop = drmModeGetProperty(_fd, props->props[i]);
-		if (prop != nullptr && strcmp(prop->name, "zorder") == 0 && drm_property_type_is(prop, DRM_MODE_PROP_RANGE)) {
-			if (drmModeObjectSetProperty(_fd, _osdPlaneId, DRM_MODE_OBJECT_PLANE, prop->prop_id, 1)) {
-				log->printf("DisplayOmapDrm::configure(): Failed to set zorder property for plane!\n");
-				return S_FAIL;
-			}
-		}
-		drmModeFreeProperty(prop);
-	}
-	drmModeFreeObjectProperties(props);
-
-	props = drmModeObjectGetProperties(_fd, _videoPlaneId, DRM_MODE_OBJECT_PLANE);
-	if (!props) {
-		log->printf("DisplayOmapDrm::configure(): Failed to find properties for plane!\n");
-		return S_FAIL;
-	}
-	for (int i = 0; i < props->count_props; i++) {
-		drmModePropertyPtr prop = drmModeGetProperty(_fd, props->props[i]);
-		if (prop != nullptr && strcmp(prop->name, "zorder") == 0 && drm_property_type_is(prop, DRM_MODE_PROP_RANGE)) {
-			if (drmModeObjectSetProperty(_fd, _videoPlaneId, DRM_MODE_OBJECT_PLANE, prop->prop_id, 0)) {
-				log->printf("DisplayOmapDrm::configure(): Failed to set zorder property for plane!\n");
-				return S_FAIL;
-			}
-		}
-		drmModeFreeProperty(prop);
+	_atomic = initAtomic() == S_OK;
+	if (!_atomic) {
+		// atomic commits carry zorder with each frame, legacy path sets it once
+		if (setPlaneZorder(_osdPlaneId, 1) == S_FAIL || setPlaneZorder(_videoPlaneId, 0) == S_FAIL)
+			return S_FAIL;
 	}
-	drmModeFreeObjectProperties(props);
 
-	log->printf("Using display HDMI output: %dx%d@%d\n", _modeInfo.hdisplay, _modeInfo.vdisplay, _modeInfo.vrefresh);
+	log->printf("Using display output: %dx%d@%.3f, %s KMS\n", _modeInfo.hdisplay, _modeInfo.vdisplay,
+	            GetDrmModeRefresh(&_modeInfo), _atomic ? "atomic" : "legacy");
 
 	uint32_t fourcc = 0;
-	uint32_t handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
 	U32 videoBufferSize = 0;
+	U32 allocated;
 	int ret;
 
-	struct drm_mode_create_dumb creq = {
-		.height = _modeInfo.vdisplay,
-		.width = _modeInfo.hdisplay,
-		.bpp = 32,
-	};
-
-	if (drmIoctl(_fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
-		log->printf("DisplayOmapDrm::configure(): Cannot create dumb buffer: %s\n", strerror(errno));
-		return S_FAIL;
-	}
-
-	_primaryHandle = handles[0] = creq.handle;
-	pitches[0] = creq.pitch;
-	ret = drmModeAddFB2(_fd, _modeInfo.hdisplay, _modeInfo.vdisplay,
-	                	DRM_FORMAT_ARGB8888,
-						handles, pitches, offsets, &_primaryFbId, 0);
-	if (ret < 0) {
-		log->printf("DisplayOmapDrm::configure(): failed add video buffer: %s\n", strerror(errno));
-		return S_FAIL;
-	}
-
-	struct drm_mode_map_dumb mreq = {
-		.handle = creq.handle,
-	};
-	if (drmIoctl(_fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq)) {
-		log->printf("DisplayOmapDrm::configure(): Cannot map dumb buffer: %s\n", strerror(errno));
-		return S_FAIL;
-	}
-
-	_primaryPtr = mmap(0, creq.size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, mreq.offset);
-	if (_primaryPtr == MAP_FAILED) {
-		log->printf("DisplayOmapDrm::configure(): Cannot map dumb buffer: %s\n", strerror(errno));
-		return S_FAIL;
-	}
-
-	memset(_primaryPtr, 0, creq.size);
-
 	_oldCrtc = drmModeGetCrtc(_fd, _crtcId);
-	ret = drmModeSetCrtc(_fd, _crtcId, _primaryFbId, 0, 0, &_connectorId, 1, &_modeInfo);
-	if (ret < 0) {
-		log->printf("DisplayOmapDrm::configure(): failed set crtc: %s\n", strerror(errno));
-		return S_FAIL;
-	}
-
-	for (int i = 0; i < NUM_OSD_FB; i++) {
-		if (drmIoctl(_fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
-			log->printf("DisplayOmapDrm::configure(): Cannot create dumb buffer: %s\n", strerror(errno));
+	// decoder frame pool needs the memory more than black primary plane does
+	if (!_hwAccelDecode || !_atomic || setModeAtomic() == S_FAIL) {
+		if (createPrimaryBuffer(_modeInfo.hdisplay, _modeInfo.vdisplay) == S_FAIL)
 			return S_FAIL;
-		}
-		_osdBuffers[i].handle = handles[0] = creq.handle;
-		pitches[0] = creq.pitch;
-
-		ret = drmModeAddFB2(_fd, _modeInfo.hdisplay, _modeInfo.vdisplay,
-		                    DRM_FORMAT_ARGB8888,
-		                    handles, pitches, offsets, &_osdBuffers[i].fbId, 0);
+		ret = drmModeSetCrtc(_fd, _crtcId, _primaryFbId, 0, 0, &_connectorId, 1, &_modeInfo);
 		if (ret < 0) {
-			log->printf("DisplayOmapDrm::configure(): failed add video buffer: %s\n", strerror(errno));
-			return S_FAIL;
-		}
-
-		_osdBuffers[i].ptr = mmap(0, creq.size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, mreq.offset);
-		if (_osdBuffers[i].ptr == MAP_FAILED) {
-			log->printf("DisplayOmapDrm::configure(): Cannot map dumb buffer: %s\n", strerror(errno));
-			return S_FAIL;
-		}
-
-		_osdBuffers[i].width = _modeInfo.hdisplay;
-		_osdBuffers[i].height = _modeInfo.vdisplay;
-		_osdBuffers[i].stride = pitches[0];
-		_osdBuffers[i].size = creq.size;
-		if (_osdBuffers[i].ptr == nullptr) {
-			log->printf("DisplayOmapDrm::internalInit(): Failed get primary frame buffer!");
+			log->printf("DisplayOmapDrm::configure(): failed set crtc: %s\n", strerror(errno));
 			return S_FAIL;
 		}
-		memset(_osdBuffers[i].ptr, 0, _osdBuffers[i].size);
 	}
 
+	// osd buffers come with first content, black primary buffer only sets mode
+	_osd.setSize(_modeInfo.hdisplay, _modeInfo.vdisplay);
+	_osdFbId = _primaryFbId;
+	_osdNextFbId = 0;
+	_osdUpdate = _osdFbId != 0;
+	_osdPlaneDisable = true;
+
+	allocated = _primarySize;
 	if (!_hwAccelDecode) {
 		for (int i = 0; i < NUM_VIDEO_FB; i++) {
-			_videoBuffers[i] = getVideoBuffer(FMT_NV12, videoWidth, videoHeight);
+			// planar frames are copied as they are if plane scans them out
+			_videoBuffers[i] = getVideoBuffer(videoFmt, videoWidth, videoHeight);
+			if (_videoBuffers[i])
+				allocated += _videoBuffers[i]->size;
 		}
 	}
+	log->printf("Display buffers: %u bytes allocated, primary %ux%u\n", allocated, _primaryWidth, _primaryHeight);
 
-	_scaleCtx = nullptr;
-
-	_currentOSDBuffer = 0;
 	_currentVideoBuffer = 0;
+	_pendingVideoBuffer = nullptr;
+	_displayedVideoBuffer = nullptr;
+	_flipPending = false;
+	_pageFlipEvents = true;
 
 	return S_OK;
 
 fail:
 
-	for (int i = 0; i < NUM_OSD_FB; i++) {
-		if (_osdBuffers[i].fbId) {
-			drmModeRmFB(_fd, _osdBuffers[i].fbId);
-		}
-		if (_osdBuffers[i].ptr) {
-			munmap(_osdBuffers[i].ptr, _osdBuffers[i].size);
-		}
-		if (_osdBuffers[i].handle > 0) {
-			drmIoctl(_fd, DRM_IOCTL_GEM_CLOSE, &_osdBuffers[i].handle);
-		}
-		_osdBuffers[i] = {};
-	}
+	releaseOsdBuffers();
 
 	for (int i = 0; i < NUM_VIDEO_FB; i++) {
 		if (_videoBuffers[i] && _videoBuffers[i]->fbId) {
@@ -509,18 +390,7 @@ fail:
 		_videoBuffers[i] = {};
 	}
 
-	if (_primaryFbId) {
-		drmModeRmFB(_fd, _primaryFbId);
-	}
-	if (_primaryPtr) {
-		munmap(_primaryPtr, _primarySize);
-	}
-	if (_primaryHandle > 0) {
-		struct drm_mode_destroy_dumb dreq = {
-			.handle = _primaryHandle,
-		};
-		drmIoctl(_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
-	}
+	releasePrimaryBuffer();
 
 	return S_FAIL;
 }
@@ -531,77 +401,49 @@ STATUS DisplayOmapDrm::putImage(VideoFrame *frame, bool skip) {
 		goto fail;
 	}
 
+	VideoBuffer *videoBuffer;
+	U32 srcX, srcY;
+	srcX = frame->dx;
+	srcY = frame->dy;
 	if (_hwAccelDecode) {
 		DisplayVideoBuffer *db = (DisplayVideoBuffer *)(frame->data[0]);
 		db->locked = true;
 		_videoBuffers[_currentVideoBuffer] = (VideoBuffer *)db->priv;
+	} else if (frame->displayBuffer) {
+		// software decoder rendered into scanout buffer, nothing to copy
+		DisplayVideoBuffer *db = (DisplayVideoBuffer *)frame->displayBuffer;
+		db->locked = true;
+		_directVideoBuffers[_currentVideoBuffer] = (VideoBuffer *)db->priv;
 	} else {
-		uint8_t *srcPtr[4] = {};
-		uint8_t *dstPtr[4] = {};
-		int srcStride[4] = {};
-		int dstStride[4] = {};
-
-		uint8_t *dst = (uint8_t *)_videoBuffers[_currentVideoBuffer]->ptr;
-		if (0 && frame->pixelfmt == FMT_YUV420P && (ALIGN2(frame->width, 5) == frame->width)) {
-			srcPtr[0] = frame->data[0];
-			srcPtr[1] = frame->data[1];
-			srcPtr[2] = frame->data[2];
-			dstPtr[0] = dst;
-			dstPtr[1] = dst + frame->width * frame->height;
-			dstPtr[2] = 0;
-
-			yuv420_frame_info.w = frame->width;
-			yuv420_frame_info.h = frame->height;
-			yuv420_frame_info.dx = 0;
-			yuv420_frame_info.dy = 0;
-			yuv420_frame_info.dw = frame->width;
-			yuv420_frame_info.dh = frame->height;
-			yuv420_frame_info.y_stride = frame->stride[0];
-			yuv420_frame_info.uv_stride = frame->stride[1];
-
-			nv12_frame_info.w = frame->width;
-			nv12_frame_info.h = frame->height;
-			nv12_frame_info.dx = 0;
-			nv12_frame_info.dy = 0;
-			nv12_frame_info.dw = frame->width;
-			nv12_frame_info.dh = frame->height;
-			nv12_frame_info.y_stride = frame->width;
-			nv12_frame_info.uv_stride = frame->width;
-
-//			yuv420_to_nv12_open(&yuv420_frame_info, &nv12_frame_info);
-
-//			yuv420_to_nv12_convert(dstPtr, srcPtr, NULL, NULL);
+		// only visible part is converted, it starts at buffer origin
+		VideoBuffer *dstBuffer = _videoBuffers[_currentVideoBuffer];
+		U8 *dst = (U8 *)dstBuffer->ptr;
+		ColorConvertJob job = {};
+		U32 lumaSize = dstBuffer->stride * dstBuffer->height;
+		job.src = { { frame->data[0], frame->data[1], frame->data[2] },
+		            { frame->stride[0], frame->stride[1], frame->stride[2] } };
+		job.dst = { { dst, dst + lumaSize, nullptr },
+		            { dstBuffer->stride, dstBuffer->stride, 0 } };
+		job.x = frame->dx;
+		job.y = frame->dy;
+		job.width = MIN(frame->dw + (frame->dx & 1), dstBuffer->width);
+		job.height = MIN(frame->dh + (frame->dy & 1), dstBuffer->height);
+
+		if (frame->pixelfmt == FMT_YUV420P && dstBuffer->pixelfmt == FMT_YUV420P) {
+			job.op = COLOR_CONVERT_COPY_YUV420;
+			job.dst = { { dst, dst + lumaSize, dst + lumaSize + (dstBuffer->stride / 2) * (dstBuffer->height / 2) },
+			            { dstBuffer->stride, dstBuffer->stride / 2, dstBuffer->stride / 2 } };
 		} else if (frame->pixelfmt == FMT_YUV420P) {
-			srcPtr[0] = frame->data[0];
-			srcPtr[1] = frame->data[1];
-			srcPtr[2] = frame->data[2];
-			srcPtr[3] = frame->data[3];
-			srcStride[0] = frame->stride[0];
-			srcStride[1] = frame->stride[1];
-			srcStride[2] = frame->stride[2];
-			srcStride[3] = frame->stride[3];
-			dstPtr[0] = dst;
-			dstPtr[1] = dst + frame->width * frame->height;
-			dstPtr[2] = nullptr;
-			dstPtr[3] = nullptr;
-			dstStride[0] = frame->width;
-			dstStride[1] = frame->width;
-			dstStride[2] = 0;
-			dstStride[3] = 0;
-
-			if (!_scaleCtx) {
-				_scaleCtx = sws_getContext(frame->width, frame->height, AV_PIX_FMT_YUV420P, frame->width, frame->height,
-						AV_PIX_FMT_NV12, SWS_POINT, NULL, NULL, NULL);
-				if (!_scaleCtx) {
-					log->printf("DisplayOmapDrm::putImage(): Can not create scale context!\n");
-					goto fail;
-				}
-			}
-			sws_scale(_scaleCtx, srcPtr, srcStride, 0, frame->height, dstPtr, dstStride);
+			job.op = COLOR_CONVERT_YUV420_TO_NV12;
+		} else if (frame->pixelfmt == FMT_NV12) {
+			job.op = COLOR_CONVERT_COPY_NV12;
 		} else {
 			log->printf("DisplayOmapDrm::putImage(): Not supported format!\n");
 			goto fail;
 		}
+		ColorConvertRun(nullptr, &job);
+		srcX = frame->dx & 1;
+		srcY = frame->dy & 1;
 	}
 
 	float x, y, w, h;
@@ -626,15 +468,19 @@ STATUS DisplayOmapDrm::putImage(VideoFrame *frame, bool skip) {
 		}
 	}
 
-	_videoBuffers[_currentVideoBuffer]->srcX = frame->dx;
-	_videoBuffers[_currentVideoBuffer]->srcY = frame->dy;
-	_videoBuffers[_currentVideoBuffer]->srcWidth = frame->dw;
-	_videoBuffers[_currentVideoBuffer]->srcHeight = frame->dh;
+	videoBuffer = _directVideoBuffers[_currentVideoBuffer];
+	if (videoBuffer == nullptr)
+		videoBuffer = _videoBuffers[_currentVideoBuffer];
 
-	_videoBuffers[_currentVideoBuffer]->dstX = x;
-	_videoBuffers[_currentVideoBuffer]->dstY = y;
-	_videoBuffers[_currentVideoBuffer]->dstWidth = w;
-	_videoBuffers[_currentVideoBuffer]->dstHeight = h;
+	videoBuffer->srcX = srcX;
+	videoBuffer->srcY = srcY;
+	videoBuffer->srcWidth = frame->dw;
+	videoBuffer->srcHeight = frame->dh;
+
+	videoBuffer->dstX = x;
+	videoBuffer->dstY = y;
+	videoBuffer->dstWidth = w;
+	videoBuffer->dstHeight = h;
 
 	return S_OK;
 
@@ -643,49 +489,551 @@ fail:
 }
 
 STATUS DisplayOmapDrm::flip(bool skip) {
+	VideoBuffer *videoBuffer;
+	STATUS status = S_FAIL;
+
 	if (!_initialized)
 		return S_FAIL;
 
-	if (!skip && drmModeSetPlane(_fd, _videoPlaneId, _crtcId,
-	                             _videoBuffers[_currentVideoBuffer]->fbId, 0,
-	                             _videoBuffers[_currentVideoBuffer]->dstX,
-	                             _videoBuffers[_currentVideoBuffer]->dstY,
-	                             _videoBuffers[_currentVideoBuffer]->dstWidth,
-	                             _videoBuffers[_currentVideoBuffer]->dstHeight,
-	                             _videoBuffers[_currentVideoBuffer]->srcX << 16,
-	                             _videoBuffers[_currentVideoBuffer]->srcY << 16,
-	                             _videoBuffers[_currentVideoBuffer]->srcWidth << 16,
-	                             _videoBuffers[_currentVideoBuffer]->srcHeight << 16
-	                            )) {
-		log->printf("DisplayOmapDrm::flip(): failed set plane: %s\n", strerror(errno));
+	// one flip in flight, its buffers are reused only after it completes
+	if (waitForFlip() == S_FAIL)
+		goto fail;
+
+	videoBuffer = _directVideoBuffers[_currentVideoBuffer];
+	_directVideoBuffers[_currentVideoBuffer] = nullptr;
+	if (videoBuffer == nullptr)
+		videoBuffer = _videoBuffers[_currentVideoBuffer];
+
+	if (skip) {
+		// never reached the screen, can go back to decoder right away
+		if (videoBuffer != _displayedVideoBuffer)
+			returnVideoBuffer(videoBuffer);
+		videoBuffer = nullptr;
+	}
+
+	if (updateOsd() == S_FAIL) {
+		if (videoBuffer != _displayedVideoBuffer)
+			returnVideoBuffer(videoBuffer);
 		goto fail;
 	}
-	if (++_currentVideoBuffer >= NUM_VIDEO_FB)
-		_currentVideoBuffer = 0;
-	if (_videoBuffers[_currentVideoBuffer] &&
-		_videoBuffers[_currentVideoBuffer]->db) {
-		_videoBuffers[_currentVideoBuffer]->db->locked = false;
+
+	_pendingVideoBuffer = videoBuffer;
+	if (videoBuffer == nullptr && !_osdUpdate) {
+		// nothing changes on screen, flip only paces playback by vblank
+		if (requestVblankEvent() == S_FAIL)
+			goto fail;
+		_flipPending = true;
+		return S_OK;
+	}
+
+	if (_atomic) {
+		status = commitAtomic(videoBuffer);
+		if (status == S_FAIL && _osdUpdate && _osdNextFbId == 0 && _primaryFbId) {
+			// primary plane has to stay on with some drivers, show black buffer on it instead
+			log->printf("DisplayOmapDrm::flip(): failed turn off osd plane: %s\n", strerror(errno));
+			_osdPlaneDisable = false;
+			_osdNextFbId = _primaryFbId;
+			status = commitAtomic(videoBuffer);
+		}
+		if (status == S_FAIL) {
+			log->printf("DisplayOmapDrm::flip(): failed atomic commit: %s, using legacy path\n", strerror(errno));
+			_atomic = false;
+			setPlaneZorder(_osdPlaneId, 1);
+			setPlaneZorder(_videoPlaneId, 0);
+		}
+	}
+	if (!_atomic && commitLegacy(videoBuffer) == S_FAIL) {
+		// buffer stays locked if it made it to the screen anyway
+		_pendingVideoBuffer = nullptr;
+		if (videoBuffer != _displayedVideoBuffer)
+			returnVideoBuffer(videoBuffer);
+		goto fail;
+	}
+	_flipPending = true;
+
+	if (_osdUpdate) {
+		_osdFbId = _osdNextFbId;
+		_osdUpdate = false;
+	}
+
+	// copy path must not write into buffer which is still on screen
+	do {
+		if (++_currentVideoBuffer >= NUM_VIDEO_FB)
+			_currentVideoBuffer = 0;
+	} while (!_hwAccelDecode &&
+	         (_videoBuffers[_currentVideoBuffer] == _displayedVideoBuffer ||
+	          _videoBuffers[_currentVideoBuffer] == _pendingVideoBuffer));
+
+	return S_OK;
+
+fail:
+
+	return S_FAIL;
+}
+
+STATUS DisplayOmapDrm::updateOsd() {
+	OsdRect rects[OSD_MAX_DIRTY_RECTS];
+	U32 numRects;
+	int back;
+
+	// unchanged osd costs neither copies nor plane updates
+	if (!_osd.isDirty())
+		return S_OK;
+
+	numRects = _osd.getDirtyRects(rects);
+	for (int i = 0; i < NUM_OSD_FB; i++) {
+		for (U32 r = 0; r < numRects; r++) {
+			Osd::unionRect(&_osdBuffers[i].stale, &rects[r]);
+		}
+	}
+
+	if (_osd.isEmpty()) {
+		// buffers are kept, stale areas get copied once osd shows up again
+		_osd.clearDirty();
+		_osdNextFbId = _osdPlaneDisable ? 0 : _primaryFbId;
+		_osdUpdate = _osdNextFbId != _osdFbId;
+		return S_OK;
+	}
+
+	if (_osdBuffers[0].fbId == 0 && allocOsdBuffers() == S_FAIL)
+		return S_FAIL;
+
+	// previous flip completed, so buffer not on plane is free to write
+	back = (_osdFbId == _osdBuffers[0].fbId) ? 1 : 0;
+	_osd.copyRect(&_osdBuffers[back].stale, (U8 *)_osdBuffers[back].ptr, _osdBuffers[back].stride);
+	_osdBuffers[back].stale = {};
+	_osd.clearDirty();
+
+	_osdNextFbId = _osdBuffers[back].fbId;
+	_osdUpdate = true;
+
+	return S_OK;
+}
+
+STATUS DisplayOmapDrm::allocOsdBuffers() {
+	uint32_t handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
+
+	for (int i = 0; i < NUM_OSD_FB; i++) {
+		struct drm_mode_create_dumb creq = {
+			.height = _modeInfo.vdisplay,
+			.width = _modeInfo.hdisplay,
+			.bpp = 32,
+		};
+		if (drmIoctl(_fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
+			log->printf("DisplayOmapDrm::allocOsdBuffers(): Cannot create dumb buffer: %s\n", strerror(errno));
+			goto fail;
+		}
+		_osdBuffers[i].handle = handles[0] = creq.handle;
+		_osdBuffers[i].size = creq.size;
+		pitches[0] = creq.pitch;
+
+		if (drmModeAddFB2(_fd, _modeInfo.hdisplay, _modeInfo.vdisplay,
+		                  DRM_FORMAT_ARGB8888,
+		                  handles, pitches, offsets, &_osdBuffers[i].fbId, 0) < 0) {
+			log->printf("DisplayOmapDrm::allocOsdBuffers(): failed add osd buffer: %s\n", strerror(errno));
+			_osdBuffers[i].fbId = 0;
+			goto fail;
+		}
+
+		struct drm_mode_map_dumb mreq = {
+			.handle = creq.handle,
+		};
+		if (drmIoctl(_fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq)) {
+			log->printf("DisplayOmapDrm::allocOsdBuffers(): Cannot map dumb buffer: %s\n", strerror(errno));
+			goto fail;
+		}
+		_osdBuffers[i].ptr = mmap(0, creq.size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, mreq.offset);
+		if (_osdBuffers[i].ptr == MAP_FAILED) {
+			log->printf("DisplayOmapDrm::allocOsdBuffers(): Cannot map dumb buffer: %s\n", strerror(errno));
+			_osdBuffers[i].ptr = nullptr;
+			goto fail;
+		}
+
+		_osdBuffers[i].width = _modeInfo.hdisplay;
+		_osdBuffers[i].height = _modeInfo.vdisplay;
+		_osdBuffers[i].stride = pitches[0];
+		// canvas is copied whole into each buffer on first use
+		_osdBuffers[i].stale = { 0, 0, _modeInfo.hdisplay, _modeInfo.vdisplay };
+	}
+
+	return S_OK;
+
+fail:
+
+	releaseOsdBuffers();
+
+	return S_FAIL;
+}
+
+STATUS DisplayOmapDrm::createPrimaryBuffer(U32 width, U32 height) {
+	uint32_t handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
+	struct drm_mode_create_dumb creq = {
+		.height = height,
+		.width = width,
+		.bpp = 32,
+	};
+	struct drm_mode_map_dumb mreq = {};
+
+	if (drmIoctl(_fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
+		log->printf("DisplayOmapDrm::createPrimaryBuffer(): Cannot create dumb buffer: %s\n", strerror(errno));
+		goto fail;
 	}
+	_primaryHandle = handles[0] = creq.handle;
+	_primarySize = creq.size;
+	pitches[0] = creq.pitch;
 
+	if (drmModeAddFB2(_fd, width, height, DRM_FORMAT_ARGB8888,
+	                  handles, pitches, offsets, &_primaryFbId, 0) < 0) {
+		log->printf("DisplayOmapDrm::createPrimaryBuffer(): failed add primary buffer: %s\n", strerror(errno));
+		_primaryFbId = 0;
+		goto fail;
+	}
 
-	if (drmModeSetPlane(_fd, _osdPlaneId, _crtcId,
-	                    _osdBuffers[_currentOSDBuffer].fbId, 0,
-	                    0, 0, _modeInfo.hdisplay, _modeInfo.vdisplay,
-	                    0, 0, _modeInfo.hdisplay << 16, _modeInfo.vdisplay << 16
-	                   )) {
-		log->printf("DisplayOmapDrm::flip(): failed set plane: %s\n", strerror(errno));
+	mreq.handle = creq.handle;
+	if (drmIoctl(_fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq)) {
+		log->printf("DisplayOmapDrm::createPrimaryBuffer(): Cannot map dumb buffer: %s\n", strerror(errno));
 		goto fail;
 	}
-	if (++_currentOSDBuffer >= NUM_OSD_FB)
-		_currentOSDBuffer = 0;
+	_primaryPtr = mmap(0, creq.size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, mreq.offset);
+	if (_primaryPtr == MAP_FAILED) {
+		log->printf("DisplayOmapDrm::createPrimaryBuffer(): Cannot map dumb buffer: %s\n", strerror(errno));
+		_primaryPtr = nullptr;
+		goto fail;
+	}
+	memset(_primaryPtr, 0, _primarySize);
+
+	_primaryWidth = width;
+	_primaryHeight = height;
 
 	return S_OK;
 
 fail:
 
+	releasePrimaryBuffer();
+
 	return S_FAIL;
 }
 
+void DisplayOmapDrm::releasePrimaryBuffer() {
+	if (_primaryFbId) {
+		drmModeRmFB(_fd, _primaryFbId);
+	}
+	if (_primaryPtr) {
+		munmap(_primaryPtr, _primarySize);
+	}
+	if (_primaryHandle > 0) {
+		struct drm_mode_destroy_dumb dreq = {
+			.handle = _primaryHandle,
+		};
+		drmIoctl(_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+	}
+	_primaryHandle = 0;
+	_primaryFbId = 0;
+	_primaryPtr = nullptr;
+	_primarySize = 0;
+	_primaryWidth = _primaryHeight = 0;
+}
+
+STATUS DisplayOmapDrm::setModeAtomic() {
+	uint32_t modeIdProp = getPropertyId(_crtcId, DRM_MODE_OBJECT_CRTC, "MODE_ID");
+	uint32_t activeProp = getPropertyId(_crtcId, DRM_MODE_OBJECT_CRTC, "ACTIVE");
+	uint32_t connectorCrtcProp = getPropertyId(_connectorId, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID");
+	uint32_t modeBlob = 0;
+	STATUS status = S_FAIL;
+
+	if (!modeIdProp || !activeProp || !connectorCrtcProp)
+		return S_FAIL;
+	if (drmModeCreatePropertyBlob(_fd, &_modeInfo, sizeof(_modeInfo), &modeBlob))
+		return S_FAIL;
+
+	// crtc without primary plane first, then tiny primary buffer scaled over screen
+	for (int attempt = 0; attempt < 2 && status == S_FAIL; attempt++) {
+		if (attempt == 1 &&
+		    createPrimaryBuffer((_modeInfo.hdisplay + LEAN_PRIMARY_SCALE - 1) / LEAN_PRIMARY_SCALE,
+		                        (_modeInfo.vdisplay + LEAN_PRIMARY_SCALE - 1) / LEAN_PRIMARY_SCALE) == S_FAIL)
+			break;
+
+		drmModeAtomicReqPtr req = drmModeAtomicAlloc();
+		if (req == nullptr)
+			break;
+		drmModeAtomicAddProperty(req, _connectorId, connectorCrtcProp, _crtcId);
+		drmModeAtomicAddProperty(req, _crtcId, modeIdProp, modeBlob);
+		drmModeAtomicAddProperty(req, _crtcId, activeProp, 1);
+		if (_primaryFbId) {
+			addOsdPlaneProperties(req, _primaryFbId);
+		} else {
+			drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.fbId, 0);
+			drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.crtcId, 0);
+		}
+		if (drmModeAtomicCommit(_fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr) == 0)
+			status = S_OK;
+		else
+			releasePrimaryBuffer();
+		drmModeAtomicFree(req);
+	}
+
+	// crtc state keeps its own reference to mode
+	drmModeDestroyPropertyBlob(_fd, modeBlob);
+
+	return status;
+}
+
+void DisplayOmapDrm::addOsdPlaneProperties(drmModeAtomicReqPtr req, uint32_t fbId) {
+	U32 srcWidth = (fbId == _primaryFbId) ? _primaryWidth : _modeInfo.hdisplay;
+	U32 srcHeight = (fbId == _primaryFbId) ? _primaryHeight : _modeInfo.vdisplay;
+
+	drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.fbId, fbId);
+	drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.crtcId, _crtcId);
+	drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.srcX, 0);
+	drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.srcY, 0);
+	drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.srcW, srcWidth << 16);
+	drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.srcH, srcHeight << 16);
+	drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.crtcX, 0);
+	drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.crtcY, 0);
+	drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.crtcW, _modeInfo.hdisplay);
+	drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.crtcH, _modeInfo.vdisplay);
+	if (_osdPlaneProps.zorder)
+		drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.zorder, 1);
+}
+
+void DisplayOmapDrm::releaseOsdBuffers() {
+	for (int i = 0; i < NUM_OSD_FB; i++) {
+		if (_osdBuffers[i].fbId) {
+			drmModeRmFB(_fd, _osdBuffers[i].fbId);
+		}
+		if (_osdBuffers[i].ptr) {
+			munmap(_osdBuffers[i].ptr, _osdBuffers[i].size);
+		}
+		if (_osdBuffers[i].handle > 0) {
+			struct drm_mode_destroy_dumb dreq = {
+				.handle = _osdBuffers[i].handle,
+			};
+			drmIoctl(_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+		}
+		_osdBuffers[i] = {};
+	}
+}
+
+STATUS DisplayOmapDrm::commitAtomic(VideoBuffer *videoBuffer) {
+	drmModeAtomicReqPtr req = drmModeAtomicAlloc();
+	uint32_t flags = DRM_MODE_ATOMIC_NONBLOCK;
+	int ret;
+
+	if (req == nullptr)
+		return S_FAIL;
+
+	// video plane keeps its previous state when frame is skipped
+	if (videoBuffer) {
+		drmModeAtomicAddProperty(req, _videoPlaneId, _videoPlaneProps.fbId, videoBuffer->fbId);
+		drmModeAtomicAddProperty(req, _videoPlaneId, _videoPlaneProps.crtcId, _crtcId);
+		drmModeAtomicAddProperty(req, _videoPlaneId, _videoPlaneProps.srcX, videoBuffer->srcX << 16);
+		drmModeAtomicAddProperty(req, _videoPlaneId, _videoPlaneProps.srcY, videoBuffer->srcY << 16);
+		drmModeAtomicAddProperty(req, _videoPlaneId, _videoPlaneProps.srcW, videoBuffer->srcWidth << 16);
+		drmModeAtomicAddProperty(req, _videoPlaneId, _videoPlaneProps.srcH, videoBuffer->srcHeight << 16);
+		drmModeAtomicAddProperty(req, _videoPlaneId, _videoPlaneProps.crtcX, videoBuffer->dstX);
+		drmModeAtomicAddProperty(req, _videoPlaneId, _videoPlaneProps.crtcY, videoBuffer->dstY);
+		drmModeAtomicAddProperty(req, _videoPlaneId, _videoPlaneProps.crtcW, videoBuffer->dstWidth);
+		drmModeAtomicAddProperty(req, _videoPlaneId, _videoPlaneProps.crtcH, videoBuffer->dstHeight);
+		if (_videoPlaneProps.zorder)
+			drmModeAtomicAddProperty(req, _videoPlaneId, _videoPlaneProps.zorder, 0);
+	}
+
+	// osd plane keeps its state too unless osd content changed
+	if (_osdUpdate && _osdNextFbId == 0) {
+		drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.fbId, 0);
+		drmModeAtomicAddProperty(req, _osdPlaneId, _osdPlaneProps.crtcId, 0);
+	} else if (_osdUpdate) {
+		addOsdPlaneProperties(req, _osdNextFbId);
+	}
+
+	// completion comes as out fence, or as page flip event on older kernels
+	_outFence = -1;
+	if (_outFencePtrProp)
+		drmModeAtomicAddProperty(req, _crtcId, _outFencePtrProp, (uint64_t)(uintptr_t)&_outFence);
+	else
+		flags |= DRM_MODE_PAGE_FLIP_EVENT;
+
+	ret = drmModeAtomicCommit(_fd, req, flags, this);
+	drmModeAtomicFree(req);
+	if (ret) {
+		_outFence = -1;
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+STATUS DisplayOmapDrm::commitLegacy(VideoBuffer *videoBuffer) {
+	if (videoBuffer && drmModeSetPlane(_fd, _videoPlaneId, _crtcId,
+	                                   videoBuffer->fbId, 0,
+	                                   videoBuffer->dstX,
+	                                   videoBuffer->dstY,
+	                                   videoBuffer->dstWidth,
+	                                   videoBuffer->dstHeight,
+	                                   videoBuffer->srcX << 16,
+	                                   videoBuffer->srcY << 16,
+	                                   videoBuffer->srcWidth << 16,
+	                                   videoBuffer->srcHeight << 16
+	                                  )) {
+		log->printf("DisplayOmapDrm::commitLegacy(): failed set plane: %s\n", strerror(errno));
+		return S_FAIL;
+	}
+
+	// flip of primary plane gives event at vblank which latched both planes,
+	// it needs plane to be on already
+	bool pageFlip = false;
+	if (_osdUpdate && _osdNextFbId && _osdFbId && _pageFlipEvents) {
+		if (drmModePageFlip(_fd, _crtcId, _osdNextFbId, DRM_MODE_PAGE_FLIP_EVENT, this)) {
+			log->printf("DisplayOmapDrm::commitLegacy(): failed page flip: %s, using vblank events\n", strerror(errno));
+			_pageFlipEvents = false;
+		} else {
+			pageFlip = true;
+		}
+	}
+	if (_osdUpdate && !pageFlip) {
+		int ret = drmModeSetPlane(_fd, _osdPlaneId, _osdNextFbId ? _crtcId : 0,
+		                          _osdNextFbId, 0,
+		                          0, 0, _modeInfo.hdisplay, _modeInfo.vdisplay,
+		                          0, 0, _modeInfo.hdisplay << 16, _modeInfo.vdisplay << 16);
+		if (ret && _osdNextFbId == 0 && _primaryFbId) {
+			// primary plane has to stay on with some drivers, show black buffer on it instead
+			log->printf("DisplayOmapDrm::commitLegacy(): failed turn off osd plane: %s\n", strerror(errno));
+			_osdPlaneDisable = false;
+			_osdNextFbId = _primaryFbId;
+			ret = drmModeSetPlane(_fd, _osdPlaneId, _crtcId,
+			                      _osdNextFbId, 0,
+			                      0, 0, _modeInfo.hdisplay, _modeInfo.vdisplay,
+			                      0, 0, _primaryWidth << 16, _primaryHeight << 16);
+		}
+		if (ret) {
+			log->printf("DisplayOmapDrm::commitLegacy(): failed set plane: %s\n", strerror(errno));
+			completeFlip(currentVblank());
+			return S_FAIL;
+		}
+	}
+	if (!pageFlip && requestVblankEvent() == S_FAIL) {
+		completeFlip(currentVblank());
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+STATUS DisplayOmapDrm::requestVblankEvent() {
+	drmVBlank vbl{};
+	vbl.request.type = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT |
+	                   ((_crtcIndex << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK));
+	vbl.request.sequence = 1;
+	vbl.request.signal = (unsigned long)this;
+	if (drmWaitVBlank(_fd, &vbl)) {
+		log->printf("DisplayOmapDrm::requestVblankEvent(): failed request vblank event: %s\n", strerror(errno));
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+void DisplayOmapDrm::flipHandler(int fd, unsigned int sequence, unsigned int tvSec, unsigned int tvUsec, void *userData) {
+	((DisplayOmapDrm *)userData)->completeFlip(sequence);
+}
+
+STATUS DisplayOmapDrm::waitForFlip() {
+	drmEventContext eventContext{};
+	eventContext.version = 2;
+	eventContext.vblank_handler = flipHandler;
+	eventContext.page_flip_handler = flipHandler;
+
+	while (_flipPending) {
+		struct pollfd pfd = { _outFence != -1 ? _outFence : _fd, POLLIN, 0 };
+		int ret = poll(&pfd, 1, DISPLAY_FLIP_TIMEOUT);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			// event is lost, assume flip is done to not stall playback
+			log->printf("DisplayOmapDrm::waitForFlip(): Timeout waiting for flip event!\n");
+			completeFlip(currentVblank());
+			break;
+		}
+		if (_outFence != -1) {
+			// fence signals once commit is on screen, at vblank which is current one now
+			completeFlip(currentVblank());
+		} else if (drmHandleEvent(_fd, &eventContext)) {
+			log->printf("DisplayOmapDrm::waitForFlip(): failed handle event: %s\n", strerror(errno));
+			return S_FAIL;
+		}
+	}
+
+	return S_OK;
+}
+
+void DisplayOmapDrm::completeFlip(U32 sequence) {
+	// pending buffer is on screen now, previous one went off screen
+	if (_pendingVideoBuffer) {
+		if (_displayedVideoBuffer != _pendingVideoBuffer)
+			returnVideoBuffer(_displayedVideoBuffer);
+		_displayedVideoBuffer = _pendingVideoBuffer;
+		_pendingVideoBuffer = nullptr;
+	}
+	if (_outFence != -1) {
+		close(_outFence);
+		_outFence = -1;
+	}
+	_flipSequence = sequence;
+	_flipPending = false;
+}
+
+STATUS DisplayOmapDrm::queryVblank(U32 type, U32 sequence, DisplayVblank *vblank) {
+	drmVBlank vbl{};
+	vbl.request.type = (drmVBlankSeqType)(type |
+	                   ((_crtcIndex << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK));
+	vbl.request.sequence = sequence;
+
+	int ret;
+	do {
+		ret = drmWaitVBlank(_fd, &vbl);
+	} while (ret && errno == EINTR);
+	if (ret)
+		return S_FAIL;
+
+	if (vblank) {
+		vblank->sequence = vbl.reply.sequence;
+		vblank->time = (S64)vbl.reply.tval_sec * 1000000 + vbl.reply.tval_usec;
+		vblank->flipSequence = _flipSequence;
+		vblank->refresh = GetDrmModeRefresh(&_modeInfo);
+	}
+
+	return S_OK;
+}
+
+U32 DisplayOmapDrm::currentVblank() {
+	DisplayVblank vblank;
+
+	if (queryVblank(DRM_VBLANK_RELATIVE, 0, &vblank) == S_FAIL)
+		return _flipSequence;
+
+	return vblank.sequence;
+}
+
+STATUS DisplayOmapDrm::getVblank(DisplayVblank *vblank) {
+	if (!_initialized || _crtcIndex == -1 || vblank == nullptr)
+		return S_FAIL;
+
+	return queryVblank(DRM_VBLANK_RELATIVE, 0, vblank);
+}
+
+STATUS DisplayOmapDrm::waitForVblank(U32 sequence, DisplayVblank *vblank) {
+	if (!_initialized || _crtcIndex == -1 || vblank == nullptr)
+		return S_FAIL;
+
+	return queryVblank(DRM_VBLANK_ABSOLUTE, sequence, vblank);
+}
+
+void DisplayOmapDrm::returnVideoBuffer(VideoBuffer *buffer) {
+	// buffers of copy path have no display buffer handle and stay with display
+	if (buffer && buffer->db)
+		buffer->db->locked.store(false, std::memory_order_release);
+}
+
 STATUS DisplayOmapDrm::getHandle(DisplayHandle *handle) {
 	if (!_initialized || handle == nullptr)
 		return S_FAIL;
@@ -695,6 +1043,130 @@ STATUS DisplayOmapDrm::getHandle(DisplayHandle *handle) {
 	return S_OK;
 };
 
+void DisplayOmapDrm::readVideoFormats() {
+	// layouts getDisplayVideoBuffer() can create, preferred first
+	static const struct {
+		uint32_t        fourcc;
+		FORMAT_VIDEO    pixelfmt;
+	} formatMap[] = {
+		{ DRM_FORMAT_NV12,   FMT_NV12 },
+		{ DRM_FORMAT_YUV420, FMT_YUV420P },
+	};
+
+	_numVideoFormats = 0;
+
+	drmModePlane *plane = drmModeGetPlane(_fd, _videoPlaneId);
+	if (plane == nullptr)
+		return;
+
+	for (U32 m = 0; m < sizeof(formatMap) / sizeof(formatMap[0]); m++) {
+		for (U32 i = 0; i < plane->count_formats; i++) {
+			if (plane->formats[i] == formatMap[m].fourcc) {
+				_videoFormats[_numVideoFormats++] = formatMap[m].pixelfmt;
+				break;
+			}
+		}
+	}
+	drmModeFreePlane(plane);
+}
+
+U32 DisplayOmapDrm::getVideoFormats(FORMAT_VIDEO *formats) {
+	if (!_initialized || formats == nullptr)
+		return 0;
+
+	memcpy(formats, _videoFormats, _numVideoFormats * sizeof(FORMAT_VIDEO));
+
+	return _numVideoFormats;
+}
+
+uint32_t DisplayOmapDrm::getPropertyId(uint32_t objectId, uint32_t objectType, const char *name) {
+	uint32_t propertyId = 0;
+
+	drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(_fd, objectId, objectType);
+	if (props == nullptr)
+		return 0;
+
+	for (U32 i = 0; i < props->count_props && propertyId == 0; i++) {
+		drmModePropertyPtr prop = drmModeGetProperty(_fd, props->props[i]);
+		if (prop == nullptr)
+			continue;
+		if (strcmp(prop->name, name) == 0 && !(prop->flags & DRM_MODE_PROP_IMMUTABLE))
+			propertyId = prop->prop_id;
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+
+	return propertyId;
+}
+
+STATUS DisplayOmapDrm::getPlaneProperties(int planeId, PlaneProperties *props) {
+	props->fbId = getPropertyId(planeId, DRM_MODE_OBJECT_PLANE, "FB_ID");
+	props->crtcId = getPropertyId(planeId, DRM_MODE_OBJECT_PLANE, "CRTC_ID");
+	props->srcX = getPropertyId(planeId, DRM_MODE_OBJECT_PLANE, "SRC_X");
+	props->srcY = getPropertyId(planeId, DRM_MODE_OBJECT_PLANE, "SRC_Y");
+	props->srcW = getPropertyId(planeId, DRM_MODE_OBJECT_PLANE, "SRC_W");
+	props->srcH = getPropertyId(planeId, DRM_MODE_OBJECT_PLANE, "SRC_H");
+	props->crtcX = getPropertyId(planeId, DRM_MODE_OBJECT_PLANE, "CRTC_X");
+	props->crtcY = getPropertyId(planeId, DRM_MODE_OBJECT_PLANE, "CRTC_Y");
+	props->crtcW = getPropertyId(planeId, DRM_MODE_OBJECT_PLANE, "CRTC_W");
+	props->crtcH = getPropertyId(planeId, DRM_MODE_OBJECT_PLANE, "CRTC_H");
+	// omapdrm names it zorder, zpos is generic one
+	props->zorder = getPropertyId(planeId, DRM_MODE_OBJECT_PLANE, "zorder");
+	if (props->zorder == 0)
+		props->zorder = getPropertyId(planeId, DRM_MODE_OBJECT_PLANE, "zpos");
+
+	if (props->fbId == 0 || props->crtcId == 0 ||
+	    props->srcX == 0 || props->srcY == 0 || props->srcW == 0 || props->srcH == 0 ||
+	    props->crtcX == 0 || props->crtcY == 0 || props->crtcW == 0 || props->crtcH == 0) {
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+STATUS DisplayOmapDrm::initAtomic() {
+	if (_flags & DISPLAY_FLAG_LEGACY_KMS)
+		return S_FAIL;
+
+	if (drmSetClientCap(_fd, DRM_CLIENT_CAP_ATOMIC, 1)) {
+		log->printf("DisplayOmapDrm::initAtomic(): Atomic modesetting not supported\n");
+		return S_FAIL;
+	}
+
+	if (getPlaneProperties(_osdPlaneId, &_osdPlaneProps) == S_FAIL ||
+	    getPlaneProperties(_videoPlaneId, &_videoPlaneProps) == S_FAIL) {
+		log->printf("DisplayOmapDrm::initAtomic(): Failed to find plane properties!\n");
+		return S_FAIL;
+	}
+
+	_outFencePtrProp = getPropertyId(_crtcId, DRM_MODE_OBJECT_CRTC, "OUT_FENCE_PTR");
+
+	return S_OK;
+}
+
+STATUS DisplayOmapDrm::setPlaneZorder(int planeId, U64 zorder) {
+	drmModeObjectPropertiesPtr props = drmModeObjectGetProperties(_fd, planeId, DRM_MODE_OBJECT_PLANE);
+	if (!props) {
+		log->printf("DisplayOmapDrm::setPlaneZorder(): Failed to find properties for plane!\n");
+		return S_FAIL;
+	}
+	for (int i = 0; i < props->count_props; i++) {
+		drmModePropertyPtr prop = drmModeGetProperty(_fd, props->props[i]);
+		if (prop != nullptr && strcmp(prop->name, "zorder") == 0 && drm_property_type_is(prop, DRM_MODE_PROP_RANGE)) {
+			if (drmModeObjectSetProperty(_fd, planeId, DRM_MODE_OBJECT_PLANE, prop->prop_id, zorder)) {
+				log->printf("DisplayOmapDrm::setPlaneZorder(): Failed to set zorder property for plane!\n");
+				drmModeFreeProperty(prop);
+				drmModeFreeObjectProperties(props);
+				return S_FAIL;
+			}
+		}
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+
+	return S_OK;
+}
+
 DisplayOmapDrm::VideoBuffer *DisplayOmapDrm::getVideoBuffer(FORMAT_VIDEO pixelfmt, int width, int height) {
 	DisplayVideoBuffer buffer;
 
@@ -714,10 +1186,18 @@ STATUS DisplayOmapDrm::getDisplayVideoBuffer(DisplayVideoBuffer *handle, FORMAT_
 
 	uint32_t handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
 	uint32_t fbSize;
+	uint32_t fourcc;
 
 	VideoBuffer *videoBuffer = new VideoBuffer;
 	memset(videoBuffer, 0, sizeof(VideoBuffer));
 
+	// planar layout only when overlay scans it out, NV12 otherwise
+	if (pixelfmt == FMT_YUV420P && isVideoFormatSupported(FMT_YUV420P)) {
+		fourcc = DRM_FORMAT_YUV420;
+	} else {
+		fourcc = DRM_FORMAT_NV12;
+	}
+
 	fbSize = width * height * 3 / 2;
 	handle->locked = 0;
 
@@ -754,10 +1234,17 @@ STATUS DisplayOmapDrm::getDisplayVideoBuffer(DisplayVideoBuffer *handle, FORMAT_
 	handles[0] = creq.handle;
 	pitches[0] = width;
 	handles[1] = handles[0];
-	pitches[1] = pitches[0];
 	offsets[1] = width * height;
+	if (fourcc == DRM_FORMAT_YUV420) {
+		pitches[1] = width / 2;
+		handles[2] = handles[0];
+		pitches[2] = width / 2;
+		offsets[2] = offsets[1] + (width / 2) * (height / 2);
+	} else {
+		pitches[1] = pitches[0];
+	}
 	if (drmModeAddFB2(_fd, width, height,
-	                  DRM_FORMAT_NV12, handles, pitches, offsets, &videoBuffer->fbId, 0) < 0) {
+	                  fourcc, handles, pitches, offsets, &videoBuffer->fbId, 0) < 0) {
 		log->printf("DisplayOmapDrm::getVideoBuffer(): failed add video buffer: %s\n", strerror(errno));
 		return S_FAIL;
 	}
@@ -776,9 +1263,17 @@ STATUS DisplayOmapDrm::getDisplayVideoBuffer(DisplayVideoBuffer *handle, FORMAT_
 	videoBuffer->dstHeight = height;
 	videoBuffer->dmaBuf = handle->dmaBuf;
 	videoBuffer->size = fbSize;
+	videoBuffer->pixelfmt = (fourcc == DRM_FORMAT_YUV420) ? FMT_YUV420P : FMT_NV12;
 	videoBuffer->ptr = map;
 	videoBuffer->db = handle;
 	handle->priv = videoBuffer;
+	handle->pixelfmt = videoBuffer->pixelfmt;
+	handle->ptr = map;
+	handle->size = fbSize;
+	for (int i = 0; i < 4; i++) {
+		handle->stride[i] = pitches[i];
+		handle->offset[i] = offsets[i];
+	}
 
 	return S_OK;
 
@@ -24,12 +24,7 @@
 
 #include "display_base.h"
 #include "basetypes.h"
-#ifdef __cplusplus
-extern "C"
-{
-	#include <libswscale/swscale.h>
-}
-#endif
+#include "osd.h"
 #include <cstdint>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -39,6 +34,7 @@ namespace MediaPLayer {
 
 #define NUM_OSD_FB   2
 #define NUM_VIDEO_FB 3
+#define LEAN_PRIMARY_SCALE 8
 
 class DisplayOmapDrm : public Display {
 private:
@@ -50,6 +46,7 @@ private:
 		U32             width, height;
 		U32             stride;
 		U32             size;
+		OsdRect         stale;          // changed on canvas since buffer was last written
 	} OSDBuffer;
 
 	typedef struct {
@@ -60,6 +57,7 @@ private:
 		U32             width, height;
 		U32             stride;
 		U32             size;
+		FORMAT_VIDEO    pixelfmt;
 		U32             srcX, srcY;
 		U32             srcWidth, srcHeight;
 		U32             dstX, dstY;
@@ -67,6 +65,13 @@ private:
 		DisplayVideoBuffer *db;
 	} VideoBuffer;
 
+	typedef struct {
+		uint32_t        fbId, crtcId;
+		uint32_t        srcX, srcY, srcW, srcH;
+		uint32_t        crtcX, crtcY, crtcW, crtcH;
+		uint32_t        zorder; // optional
+	} PlaneProperties;
+
 	int                         _fd;
 	drmModeResPtr               _drmResources;
 	drmModePlaneResPtr          _drmPlaneResources;
@@ -74,19 +79,38 @@ private:
 	drmModeModeInfo             _modeInfo;
 	uint32_t                    _connectorId;
 	uint32_t                    _crtcId;
+	int                         _crtcIndex;
 	int                         _osdPlaneId;
 	int                         _videoPlaneId;
+	FORMAT_VIDEO                _videoFormats[DISPLAY_MAX_VIDEO_FORMATS]; // video plane scans these out
+	U32                         _numVideoFormats;
 
 	uint32_t                    _primaryHandle;
 	uint32_t                    _primaryFbId;
 	void                        *_primaryPtr;
 	U32                         _primarySize;
-	OSDBuffer                   _osdBuffers[NUM_OSD_FB]{};
+	U32                         _primaryWidth, _primaryHeight; // smaller than mode if plane scales it, 0 if none
+	OSDBuffer                   _osdBuffers[NUM_OSD_FB]{}; // allocated on first osd content
 	VideoBuffer                 *_videoBuffers[NUM_VIDEO_FB]{};
+	VideoBuffer                 *_directVideoBuffers[NUM_VIDEO_FB]{}; // decoder rendered buffers, used instead of _videoBuffers
 
-	int                         _currentOSDBuffer;
+	Osd                         _osd;
+	uint32_t                    _osdFbId;               // on osd plane, 0 if plane is off
+	uint32_t                    _osdNextFbId;           // committed with next flip if _osdUpdate
+	bool                        _osdUpdate;
+	bool                        _osdPlaneDisable;       // false if driver keeps osd (primary) plane on
 	int                         _currentVideoBuffer;
-	SwsContext                  *_scaleCtx;
+	VideoBuffer                 *_pendingVideoBuffer;   // queued for next vblank
+	VideoBuffer                 *_displayedVideoBuffer; // scanned out by video plane
+	bool                        _flipPending;
+	bool                        _pageFlipEvents;        // false if driver can't flip, vblank events used then
+	U32                         _flipSequence;          // vblank at which last flip completed
+
+	bool                        _atomic;
+	PlaneProperties             _osdPlaneProps;
+	PlaneProperties             _videoPlaneProps;
+	uint32_t                    _outFencePtrProp;       // 0 if not supported, page flip event used then
+	int32_t                     _outFence;
 
 public:
 
@@ -95,17 +119,42 @@ public:
 
 	STATUS init(bool hwAccelDecode);
 	STATUS deinit();
-	STATUS configure(FORMAT_VIDEO videoFmt, int videoFps, int videoWidth, int videoHeight);
+	STATUS configure(FORMAT_VIDEO videoFmt, float videoFps, int videoWidth, int videoHeight);
 	STATUS putImage(VideoFrame *frame, bool skip);
 	STATUS flip(bool skip);
 	STATUS getHandle(DisplayHandle *handle);
 	STATUS getDisplayVideoBuffer(DisplayVideoBuffer *handle, FORMAT_VIDEO pixelfmt, int width, int height);
 	STATUS releaseDisplayVideoBuffer(DisplayVideoBuffer *handle);
+	STATUS getVblank(DisplayVblank *vblank);
+	STATUS waitForVblank(U32 sequence, DisplayVblank *vblank);
+	U32 getVideoFormats(FORMAT_VIDEO *formats);
+	Osd *getOsd() { return _initialized ? &_osd : nullptr; }
 
 private:
 
 	STATUS internalInit();
 	void internalDeinit();
+	void readVideoFormats();
+	uint32_t getPropertyId(uint32_t objectId, uint32_t objectType, const char *name);
+	STATUS getPlaneProperties(int planeId, PlaneProperties *props);
+	STATUS initAtomic();
+	STATUS setPlaneZorder(int planeId, U64 zorder);
+	STATUS createPrimaryBuffer(U32 width, U32 height);
+	void releasePrimaryBuffer();
+	STATUS setModeAtomic();
+	void addOsdPlaneProperties(drmModeAtomicReqPtr req, uint32_t fbId);
+	STATUS allocOsdBuffers();
+	void releaseOsdBuffers();
+	STATUS updateOsd();
+	STATUS requestVblankEvent();
+	STATUS commitAtomic(VideoBuffer *videoBuffer);
+	STATUS commitLegacy(VideoBuffer *videoBuffer);
+	STATUS waitForFlip();
+	void completeFlip(U32 sequence);
+	STATUS queryVblank(U32 type, U32 sequence, DisplayVblank *vblank);
+	U32 currentVblank();
+	void returnVideoBuffer(VideoBuffer *buffer);
+	static void flipHandler(int fd, unsigned int sequence, unsigned int tvSec, unsigned int tvUsec, void *userData);
 	VideoBuffer *getVideoBuffer(FORMAT_VIDEO pixelfmt, int width, int height);
 	STATUS releaseVideoBuffer(VideoBuffer *buffer);
 };
@@ -26,35 +26,48 @@
 #include <fcntl.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <poll.h>
+#include <time.h>
 #include "display_base.h"
+#include "colorconvert.h"
+#include "display_drm_mode.h"
 #include "logs.h"
 
-static struct frame_info {
-	unsigned int w;
-	unsigned int h;
-	unsigned int dx;
-	unsigned int dy;
-	unsigned int dw;
-	unsigned int dh;
-	unsigned int y_stride;
-	unsigned int uv_stride;
-} yuv420_frame_info, nv12_frame_info;
-
-extern "C" int yuv420_to_nv12_convert(unsigned char *vdst[3], unsigned char *vsrc[3], unsigned char *, unsigned char *);
-extern "C" void yuv420_to_nv12_open(struct frame_info *dst, struct frame_info *src);
-
 namespace MediaPLayer {
 
+// SAMPLER is defined ahead of this, sampler2D for uploaded planes or samplerExternalOES for imported ones
+static const GLchar *yuvFragmentShaderSource =
+		"precision mediump float;                                         \n"
+		"varying vec2   textureCoords;                                    \n"
+		"uniform SAMPLER textureY;                                        \n"
+		"uniform SAMPLER textureU;                                        \n"
+		"uniform SAMPLER textureV;                                        \n"
+		"uniform mat3   colorMatrix;                                      \n"
+		"uniform vec3   colorOffset;                                      \n"
+		"uniform vec2   chromaScale;                                      \n"
+		"void main()                                                      \n"
+		"{                                                                \n"
+		"    vec2 chromaCoords = textureCoords * chromaScale;             \n"
+		"    vec3 yuv = vec3(texture2D(textureY, textureCoords).r,        \n"
+		"                    texture2D(textureU, chromaCoords).r,         \n"
+		"                    texture2D(textureV, chromaCoords).r);        \n"
+		"    gl_FragColor = vec4(colorMatrix * (yuv - colorOffset), 1.0); \n"
+		"}                                                                \n";
+
 DisplayOmapDrmEgl::DisplayOmapDrmEgl() :
 		_fd(-1),
 		_drmResources(nullptr), _drmPlaneResources(nullptr),
 		_connectorId(-1), _oldCrtc(nullptr), _crtcId(-1), _planeId(-1),
 		_primaryHandle(0), _primaryFbId(0), _primarySize(0), _primaryPtr(nullptr),
 		_gbmDevice(nullptr), _gbmSurface(nullptr),
+		_frontBo(nullptr), _pendingBo(nullptr), _flipPending(false), _pageFlip(true), _flipSkipped(false),
 		_eglDisplay(nullptr), _eglSurface(nullptr), _eglConfig(nullptr), _eglContext(nullptr),
 		eglCreateImageKHR(nullptr), eglDestroyImageKHR(nullptr), glEGLImageTargetTexture2DOES(nullptr),
-		_vertexShader(0), _fragmentShader(0), _glProgram(0), _renderTexture(nullptr),
-		_fbWidth(0), _fbHeight(0), _scaleCtx(nullptr) {
+		eglCreateSyncKHR(nullptr), eglDestroySyncKHR(nullptr), eglClientWaitSyncKHR(nullptr),
+		_vertexShader(0), _fragmentShader(0), _glProgram(0), _renderSlots(), _renderSlot(0),
+		_yuvProgram(), _yuvExternalProgram(), _planarImport(true),
+		_currentBuffer(nullptr), _currentFence(nullptr), _retiredBuffer(nullptr), _retiredFence(nullptr),
+		_fbWidth(0), _fbHeight(0), _stats() {
 }
 
 DisplayOmapDrmEgl::~DisplayOmapDrmEgl() {
@@ -163,8 +176,6 @@ STATUS DisplayOmapDrmEgl::internalInit() {
 		goto fail;
 	}
 
-	_scaleCtx = nullptr;
-
 	_initialized = true;
 	return S_OK;
 
@@ -197,11 +208,6 @@ void DisplayOmapDrmEgl::internalDeinit() {
 	if (_initialized == false)
 		return;
 
-	if (_scaleCtx) {
-		sws_freeContext(_scaleCtx);
-		_scaleCtx = nullptr;
-	}
-
 	if (_vertexShader) {
 		glDeleteShader(_vertexShader);
 		_vertexShader = 0;
@@ -217,11 +223,27 @@ void DisplayOmapDrmEgl::internalDeinit() {
 		_glProgram = 0;
 	}
 
-	if (_renderTexture) {
-		releaseVideoBuffer(_renderTexture);
-		_renderTexture = nullptr;
+	destroyYUVProgram(&_yuvProgram);
+	destroyYUVProgram(&_yuvExternalProgram);
+
+	releaseRenderSlots();
+
+	waitForFlip();
+	if (_frontBo) {
+		// fb of buffer goes away with surface, scan out black or previous one meanwhile
+		if (_primaryFbId)
+			drmModeSetCrtc(_fd, _crtcId, _primaryFbId, 0, 0, &_connectorId, 1, &_modeInfo);
+		else if (_oldCrtc)
+			drmModeSetCrtc(_fd, _oldCrtc->crtc_id, _oldCrtc->buffer_id,
+			               _oldCrtc->x, _oldCrtc->y, &_connectorId, 1, &_oldCrtc->mode);
+		gbm_surface_release_buffer(_gbmSurface, _frontBo);
+		_frontBo = nullptr;
 	}
 
+	// both buffers go back to decoder only after gpu is done with them
+	retireCurrentBuffer();
+	releaseRetiredBuffer(false);
+
 	if (_eglDisplay) {
 		glFinish();
 		eglMakeCurrent(_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
@@ -248,19 +270,7 @@ void DisplayOmapDrmEgl::internalDeinit() {
 		_oldCrtc = nullptr;
 	}
 
-	if (_primaryFbId) {
-		drmModeRmFB(_fd, _primaryFbId);
-		_primaryFbId = 0;
-	}
-	if (_primaryPtr) {
-		munmap(_primaryPtr, _primarySize);
-	}
-	if (_primaryHandle > 0) {
-		struct drm_mode_destroy_dumb dreq = {
-		.handle = _primaryHandle,
-		};
-		drmIoctl(_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
-	}
+	releasePrimaryBuffer();
 
 	if (_drmPlaneResources != nullptr)
 		drmModeFreePlaneResources(_drmPlaneResources);
@@ -274,10 +284,7 @@ void DisplayOmapDrmEgl::internalDeinit() {
 	_initialized = false;
 }
 
-STATUS DisplayOmapDrmEgl::configure(FORMAT_VIDEO videoFmt, int videoFps, int videoWidth, int videoHeight) {
-	struct drm_mode_create_dumb creq = {0};
-	struct drm_mode_map_dumb mreq = {0};
-
+STATUS DisplayOmapDrmEgl::configure(FORMAT_VIDEO videoFmt, float videoFps, int videoWidth, int videoHeight) {
 	if (!_initialized)
 		return S_FAIL;
 
@@ -318,7 +325,6 @@ STATUS DisplayOmapDrmEgl::configure(FORMAT_VIDEO videoFmt, int videoFps, int vid
 
 	int modeId = -1;
 	_crtcId = -1;
-	uint32_t handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
 	int ret;
 
 	switch (videoFmt) {
@@ -344,27 +350,9 @@ STATUS DisplayOmapDrmEgl::configure(FORMAT_VIDEO videoFmt, int videoFps, int vid
 		return S_FAIL;
 	}
 
-	for (int j = 0; j < connector->count_modes; j++) {
-		auto mode = &connector->modes[j];
-		if ((mode->vrefresh >= videoFps) && (mode->type & DRM_MODE_TYPE_PREFERRED)) {
-			modeId = j;
-			break;
-		}
-	}
-
-	if (modeId == -1) {
+	modeId = SelectDrmMode(connector, videoFps);
+	if (modeId == -1)
 		modeId = 0;
-		U64 highestArea = 0;
-		for (int j = 0; j < connector->count_modes; j++) {
-			auto mode = &connector->modes[j];
-			const U64 area = mode->hdisplay * mode->vdisplay;
-			if ((mode->vrefresh >= videoFps) && (area > highestArea))
-			{
-				highestArea = area;
-				modeId = j;
-			}
-		}
-	}
 
 	_modeInfo = connector->modes[modeId];
 
@@ -427,7 +415,7 @@ STATUS DisplayOmapDrmEgl::configure(FORMAT_VIDEO videoFmt, int videoFps, int vid
 	_fbWidth = _modeInfo.hdisplay;
 	_fbHeight = _modeInfo.vdisplay;
 
-	log->printf("Using display HDMI output: %dx%d@%d\n", _fbWidth, _fbHeight, _modeInfo.vrefresh);
+	log->printf("Using display HDMI output: %dx%d@%.3f\n", _fbWidth, _fbHeight, GetDrmModeRefresh(&_modeInfo));
 
 	_gbmSurface = gbm_surface_create(
 			_gbmDevice,
@@ -507,6 +495,16 @@ STATUS DisplayOmapDrmEgl::configure(FORMAT_VIDEO videoFmt, int videoFps, int vid
 		goto fail;
 	}
 
+	if (strstr(eglQueryString(_eglDisplay, EGL_EXTENSIONS), "EGL_KHR_fence_sync")) {
+		eglCreateSyncKHR = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+		eglDestroySyncKHR = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+		eglClientWaitSyncKHR = (PFNEGLCLIENTWAITSYNCKHRPROC)eglGetProcAddress("eglClientWaitSyncKHR");
+	}
+	if (!eglCreateSyncKHR || !eglDestroySyncKHR || !eglClientWaitSyncKHR) {
+		log->printf("DisplayOmapDrmEgl::configure(): No EGL_KHR_fence_sync, texture reuse is not fenced\n");
+		eglCreateSyncKHR = nullptr;
+	}
+
 	GLint shaderStatus;
 	_vertexShader = glCreateShader(GL_VERTEX_SHADER);
 	glShaderSource(_vertexShader, 1, &vertexShaderSource, nullptr);
@@ -559,6 +557,15 @@ STATUS DisplayOmapDrmEgl::configure(FORMAT_VIDEO videoFmt, int videoFps, int vid
 		goto fail;
 	}
 
+	// without these frames are converted to NV12 on cpu
+	if (createYUVProgram(&_yuvProgram, false) == S_FAIL) {
+		log->printf("DisplayOmapDrmEgl::configure(): No shader for uploaded YUV planes\n");
+	}
+	if (createYUVProgram(&_yuvExternalProgram, true) == S_FAIL) {
+		log->printf("DisplayOmapDrmEgl::configure(): No shader for imported YUV planes\n");
+		_planarImport = false;
+	}
+
 	glUseProgram(_glProgram);
 
 	glViewport(0, 0, _fbWidth, _fbHeight);
@@ -567,45 +574,18 @@ STATUS DisplayOmapDrmEgl::configure(FORMAT_VIDEO videoFmt, int videoFps, int vid
 	glClear(GL_COLOR_BUFFER_BIT);
 
 
-	creq.height = _modeInfo.vdisplay;
-	creq.width = _modeInfo.hdisplay;
-	creq.bpp = 32;
-	if (drmIoctl(_fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
-		log->printf("DisplayOmapDrm::configure(): Cannot create dumb buffer: %s\n", strerror(errno));
-		return S_FAIL;
-	}
-
-	_primaryHandle = handles[0] = creq.handle;
-	pitches[0] = creq.pitch;
-	ret = drmModeAddFB2(_fd, _modeInfo.hdisplay, _modeInfo.vdisplay,
-	                    DRM_FORMAT_ARGB8888,
-	                    handles, pitches, offsets, &_primaryFbId, 0);
-	if (ret < 0) {
-		log->printf("DisplayOmapDrm::configure(): failed add video buffer: %s\n", strerror(errno));
-		return S_FAIL;
-	}
-
-	mreq.handle = creq.handle;
-	if (drmIoctl(_fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq)) {
-		log->printf("DisplayOmapDrm::configure(): Cannot map dumb buffer: %s\n", strerror(errno));
-		return S_FAIL;
-	}
-
-	_primaryPtr = mmap(0, creq.size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, mreq.offset);
-	if (_primaryPtr == MAP_FAILED) {
-		log->printf("DisplayOmapDrm::configure(): Cannot map dumb buffer: %s\n", strerror(errno));
-		return S_FAIL;
-	}
-	_primarySize = creq.size;
-
-	memset(_primaryPtr, 0, _primarySize);
-
 	_oldCrtc = drmModeGetCrtc(_fd, _crtcId);
-	ret = drmModeSetCrtc(_fd, _crtcId, _primaryFbId, 0, 0, &_connectorId, 1, &_modeInfo);
-	if (ret < 0) {
-		log->printf("DisplayOmapDrm::configure(): failed set crtc: %s\n", strerror(errno));
-		return S_FAIL;
+	// first frame sets crtc, black primary buffer would only compete with decoder frame pool
+	if (!_hwAccelDecode) {
+		if (createPrimaryBuffer() == S_FAIL)
+			return S_FAIL;
+		ret = drmModeSetCrtc(_fd, _crtcId, _primaryFbId, 0, 0, &_connectorId, 1, &_modeInfo);
+		if (ret < 0) {
+			log->printf("DisplayOmapDrm::configure(): failed set crtc: %s\n", strerror(errno));
+			return S_FAIL;
+		}
 	}
+	log->printf("Display buffers: %u bytes allocated besides GBM surface\n", _primarySize);
 
 	return S_OK;
 
@@ -623,6 +603,8 @@ fail:
 		glDeleteProgram(_glProgram);
 		_glProgram = 0;
 	}
+	destroyYUVProgram(&_yuvProgram);
+	destroyYUVProgram(&_yuvExternalProgram);
 	if (_eglSurface) {
 		eglDestroySurface(_eglDisplay, _eglSurface);
 		_eglSurface = nullptr;
@@ -643,6 +625,73 @@ fail:
 	return S_FAIL;
 }
 
+STATUS DisplayOmapDrmEgl::createPrimaryBuffer() {
+	uint32_t handles[4] = { 0 }, pitches[4] = { 0 }, offsets[4] = { 0 };
+	struct drm_mode_create_dumb creq = {0};
+	struct drm_mode_map_dumb mreq = {0};
+
+	creq.height = _modeInfo.vdisplay;
+	creq.width = _modeInfo.hdisplay;
+	creq.bpp = 32;
+	if (drmIoctl(_fd, DRM_IOCTL_MODE_CREATE_DUMB, &creq) < 0) {
+		log->printf("DisplayOmapDrmEgl::createPrimaryBuffer(): Cannot create dumb buffer: %s\n", strerror(errno));
+		goto fail;
+	}
+
+	_primaryHandle = handles[0] = creq.handle;
+	_primarySize = creq.size;
+	pitches[0] = creq.pitch;
+	if (drmModeAddFB2(_fd, _modeInfo.hdisplay, _modeInfo.vdisplay,
+	                  DRM_FORMAT_ARGB8888,
+	                  handles, pitches, offsets, &_primaryFbId, 0) < 0) {
+		log->printf("DisplayOmapDrmEgl::createPrimaryBuffer(): failed add primary buffer: %s\n", strerror(errno));
+		_primaryFbId = 0;
+		goto fail;
+	}
+
+	mreq.handle = creq.handle;
+	if (drmIoctl(_fd, DRM_IOCTL_MODE_MAP_DUMB, &mreq)) {
+		log->printf("DisplayOmapDrmEgl::createPrimaryBuffer(): Cannot map dumb buffer: %s\n", strerror(errno));
+		goto fail;
+	}
+
+	_primaryPtr = mmap(0, creq.size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, mreq.offset);
+	if (_primaryPtr == MAP_FAILED) {
+		log->printf("DisplayOmapDrmEgl::createPrimaryBuffer(): Cannot map dumb buffer: %s\n", strerror(errno));
+		_primaryPtr = nullptr;
+		goto fail;
+	}
+
+	memset(_primaryPtr, 0, _primarySize);
+
+	return S_OK;
+
+fail:
+
+	releasePrimaryBuffer();
+
+	return S_FAIL;
+}
+
+void DisplayOmapDrmEgl::releasePrimaryBuffer() {
+	if (_primaryFbId) {
+		drmModeRmFB(_fd, _primaryFbId);
+	}
+	if (_primaryPtr) {
+		munmap(_primaryPtr, _primarySize);
+	}
+	if (_primaryHandle > 0) {
+		struct drm_mode_destroy_dumb dreq = {
+			.handle = _primaryHandle,
+		};
+		drmIoctl(_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &dreq);
+	}
+	_primaryHandle = 0;
+	_primaryFbId = 0;
+	_primaryPtr = nullptr;
+	_primarySize = 0;
+}
+
 void DisplayOmapDrmEgl::drmFbDestroyCallback(gbm_bo *gbmBo, void *data) {
 	DisplayOmapDrmEgl::DrmFb *drmFb = (DisplayOmapDrmEgl::DrmFb *)data;
 
@@ -695,9 +744,8 @@ STATUS DisplayOmapDrmEgl::putImage(VideoFrame *frame, bool skip) {
 		return S_FAIL;
 
 	RenderTexture *renderTexture;
-	uint32_t fourcc;
-	uint32_t stride;
-	uint32_t fbSize;
+	RenderSlot *slot = nullptr;
+	U32 textureWidth, textureHeight;
 	float x, y;
 	float cropLeft, cropRight, cropTop, cropBottom;
 	GLfloat coords[] = {
@@ -737,10 +785,72 @@ STATUS DisplayOmapDrmEgl::putImage(VideoFrame *frame, bool skip) {
 	position[6] =  x;
 	position[7] =  y;
 
-	cropLeft = (float)(frame->dx) / frame->width;
-	cropRight = (float)(frame->dw + frame->dx) / frame->width;
-	cropTop = (float)(frame->dy) / frame->height;
-	cropBottom = (float)(frame->dh + frame->dy) / frame->height;
+	DisplayVideoBuffer *db;
+	db = nullptr;
+	if (_hwAccelDecode) {
+		db = (DisplayVideoBuffer *)(frame->data[0]);
+	} else if (frame->displayBuffer) {
+		// software decoder rendered into texture buffer, nothing to upload
+		db = (DisplayVideoBuffer *)frame->displayBuffer;
+	}
+
+	textureWidth = frame->width;
+	textureHeight = frame->height;
+	if (db) {
+		// previous buffer stays locked until gpu finished sampling it
+		db->locked = true;
+		if (_currentBuffer != db) {
+			retireCurrentBuffer();
+			_currentBuffer = db;
+		}
+		renderTexture = (RenderTexture *)db->priv;
+		if (renderTexture->planar) {
+			// decoder buffers are padded for codec alignment
+			textureWidth = db->stride[0];
+			textureHeight = db->offset[1] / db->stride[0];
+		}
+	} else if (frame->pixelfmt == FMT_YUV420P && _yuvProgram.program) {
+		// planes go to gpu as they are, shader converts them
+		renderTexture = nullptr;
+		slot = getRenderSlot();
+		if (uploadPlanes(slot, frame) == S_FAIL)
+			goto fail;
+		textureWidth = frame->stride[0];
+	} else {
+		slot = getRenderSlot();
+		if (!slot->renderTexture) {
+			slot->renderTexture = getVideoBuffer(frame->pixelfmt, frame->width, frame->height);
+			if (!slot->renderTexture) {
+				goto fail;
+			}
+		}
+		renderTexture = slot->renderTexture;
+
+		// texture keeps whole frame, crop is done by texture coordinates
+		U8 *dst = (U8 *)renderTexture->mapPtr;
+		ColorConvertJob job = {};
+		job.src = { { frame->data[0], frame->data[1], frame->data[2] },
+		            { frame->stride[0], frame->stride[1], frame->stride[2] } };
+		job.dst = { { dst, dst + frame->width * frame->height, nullptr },
+		            { (U32)frame->width, (U32)frame->width, 0 } };
+		job.width = frame->width;
+		job.height = frame->height;
+
+		if (frame->pixelfmt == FMT_YUV420P) {
+			job.op = COLOR_CONVERT_YUV420_TO_NV12;
+		} else if (frame->pixelfmt == FMT_NV12) {
+			job.op = COLOR_CONVERT_COPY_NV12;
+		} else {
+			log->printf("DisplayOmapDrmEgl::putImage(): Not supported format!\n");
+			goto fail;
+		}
+		ColorConvertRun(nullptr, &job);
+	}
+
+	cropLeft = (float)(frame->dx) / textureWidth;
+	cropRight = (float)(frame->dw + frame->dx) / textureWidth;
+	cropTop = (float)(frame->dy) / textureHeight;
+	cropBottom = (float)(frame->dh + frame->dy) / textureHeight;
 
 	coords[0] = coords[4] = cropLeft;
 	coords[2] = coords[6] = cropRight;
@@ -753,132 +863,388 @@ STATUS DisplayOmapDrmEgl::putImage(VideoFrame *frame, bool skip) {
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, coords);
 	glEnableVertexAttribArray(1);
 
-	if (_hwAccelDecode) {
-		DisplayVideoBuffer *db = (DisplayVideoBuffer *)(frame->data[0]);
-		renderTexture = (RenderTexture *)db->priv;
-	} else if (!_renderTexture) {
-		_renderTexture = renderTexture = getVideoBuffer(frame->pixelfmt, frame->width, frame->height);
-		if (!_renderTexture) {
-			goto fail;
+	glDepthMask(GL_FALSE);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+
+	if (renderTexture == nullptr) {
+		// chroma rows may be padded differently than half of luma ones
+		useYUVProgram(&_yuvProgram, frame,
+		              (float)slot->planeWidth[0] / (2 * slot->planeWidth[1]),
+		              (float)slot->planeHeight[0] / (2 * slot->planeHeight[1]));
+	} else if (renderTexture->planar) {
+		useYUVProgram(&_yuvExternalProgram, frame, 1.0f, 1.0f);
+		for (int i = 0; i < NUM_YUV_PLANES; i++) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_EXTERNAL_OES, renderTexture->planeTextures[i]);
+			glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		}
+		glActiveTexture(GL_TEXTURE0);
 	} else {
-		renderTexture = _renderTexture;
+		glUseProgram(_glProgram);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_EXTERNAL_OES, renderTexture->glTexture);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	}
 
-	if (!_hwAccelDecode) {
-		uint8_t *srcPtr[4] = {};
-		uint8_t *dstPtr[4] = {};
-		int srcStride[4] = {};
-		int dstStride[4] = {};
-
-		uint8_t *dst = (uint8_t *)renderTexture->mapPtr;
-		if (0 && frame->pixelfmt == FMT_YUV420P && (ALIGN2(frame->width, 5) == frame->width)) {
-			srcPtr[0] = frame->data[0];
-			srcPtr[1] = frame->data[1];
-			srcPtr[2] = frame->data[2];
-			dstPtr[0] = dst;
-			dstPtr[1] = dst + frame->width * frame->height;
-			dstPtr[2] = 0;
-
-			yuv420_frame_info.w = frame->width;
-			yuv420_frame_info.h = frame->height;
-			yuv420_frame_info.dx = 0;
-			yuv420_frame_info.dy = 0;
-			yuv420_frame_info.dw = frame->width;
-			yuv420_frame_info.dh = frame->height;
-			yuv420_frame_info.y_stride = frame->stride[0];
-			yuv420_frame_info.uv_stride = frame->stride[1];
-
-			nv12_frame_info.w = frame->width;
-			nv12_frame_info.h = frame->height;
-			nv12_frame_info.dx = 0;
-			nv12_frame_info.dy = 0;
-			nv12_frame_info.dw = frame->width;
-			nv12_frame_info.dh = frame->height;
-			nv12_frame_info.y_stride = frame->width;
-			nv12_frame_info.uv_stride = frame->width;
-
-			//yuv420_to_nv12_open(&yuv420_frame_info, &nv12_frame_info);
-
-			//yuv420_to_nv12_convert(dstPtr, srcPtr, NULL, NULL);
-		} else if (frame->pixelfmt == FMT_YUV420P) {
-			srcPtr[0] = frame->data[0];
-			srcPtr[1] = frame->data[1];
-			srcPtr[2] = frame->data[2];
-			srcPtr[3] = frame->data[3];
-			srcStride[0] = frame->stride[0];
-			srcStride[1] = frame->stride[1];
-			srcStride[2] = frame->stride[2];
-			srcStride[3] = frame->stride[3];
-			dstPtr[0] = dst;
-			dstPtr[1] = dst + frame->width * frame->height;
-			dstPtr[2] = nullptr;
-			dstPtr[3] = nullptr;
-			dstStride[0] = frame->width;
-			dstStride[1] = frame->width;
-			dstStride[2] = 0;
-			dstStride[3] = 0;
-
-			if (!_scaleCtx) {
-				_scaleCtx = sws_getContext(frame->width, frame->height, AV_PIX_FMT_YUV420P, frame->width, frame->height,
-						AV_PIX_FMT_NV12, SWS_POINT, NULL, NULL, NULL);
-				if (!_scaleCtx) {
-					log->printf("DisplayOmapDrm::putImage(): Can not create scale context!\n");
-					goto fail;
-				}
-			}
-			sws_scale(_scaleCtx, srcPtr, srcStride, 0, frame->height, dstPtr, dstStride);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	if (slot)
+		fenceRenderSlot(slot);
+	else if (db)
+		fenceCurrentBuffer();
+
+	glFlush();
+
+	return S_OK;
+
+fail:
+	return S_FAIL;
+}
+
+STATUS DisplayOmapDrmEgl::createYUVProgram(YUVProgram *program, bool external) {
+	static const char *names[NUM_YUV_PLANES] = { "textureY", "textureU", "textureV" };
+	const GLchar *sources[2] = {
+		external ? "#extension GL_OES_EGL_image_external : require\n#define SAMPLER samplerExternalOES\n" :
+		           "#define SAMPLER sampler2D\n",
+		yuvFragmentShaderSource
+	};
+	GLint shaderStatus;
+
+	program->fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(program->fragmentShader, 2, sources, nullptr);
+	glCompileShader(program->fragmentShader);
+	glGetShaderiv(program->fragmentShader, GL_COMPILE_STATUS, &shaderStatus);
+	if (!shaderStatus) {
+		log->printf("DisplayOmapDrmEgl::createYUVProgram(): fragment shader compilation failed!\n");
+		glGetShaderiv(program->fragmentShader, GL_INFO_LOG_LENGTH, &shaderStatus);
+		char logStr[shaderStatus];
+		if (shaderStatus > 1) {
+			glGetShaderInfoLog(program->fragmentShader, shaderStatus, nullptr, logStr);
+			log->printf(logStr);
+		}
+		goto fail;
+	}
+
+	program->program = glCreateProgram();
+
+	glAttachShader(program->program, _vertexShader);
+	glAttachShader(program->program, program->fragmentShader);
+
+	glBindAttribLocation(program->program, 0, "position");
+	glBindAttribLocation(program->program, 1, "texCoord");
+
+	glLinkProgram(program->program);
+	glGetProgramiv(program->program, GL_LINK_STATUS, &shaderStatus);
+	if (!shaderStatus) {
+		log->printf("DisplayOmapDrmEgl::createYUVProgram(): program linking failed!\n");
+		glGetProgramiv(program->program, GL_INFO_LOG_LENGTH, &shaderStatus);
+		char logStr[shaderStatus];
+		if (shaderStatus > 1) {
+			glGetProgramInfoLog(program->program, shaderStatus, nullptr, logStr);
+			log->printf(logStr);
+		}
+		goto fail;
+	}
+
+	glUseProgram(program->program);
+	for (int i = 0; i < NUM_YUV_PLANES; i++) {
+		program->planeLoc[i] = glGetUniformLocation(program->program, names[i]);
+		glUniform1i(program->planeLoc[i], i);
+	}
+	program->matrixLoc = glGetUniformLocation(program->program, "colorMatrix");
+	program->offsetLoc = glGetUniformLocation(program->program, "colorOffset");
+	program->chromaScaleLoc = glGetUniformLocation(program->program, "chromaScale");
+
+	return S_OK;
+
+fail:
+
+	destroyYUVProgram(program);
+
+	return S_FAIL;
+}
+
+void DisplayOmapDrmEgl::destroyYUVProgram(YUVProgram *program) {
+	if (program->program) {
+		glDeleteProgram(program->program);
+	}
+	if (program->fragmentShader) {
+		glDeleteShader(program->fragmentShader);
+	}
+	memset(program, 0, sizeof(YUVProgram));
+}
+
+void DisplayOmapDrmEgl::useYUVProgram(YUVProgram *program, VideoFrame *frame, float chromaScaleX, float chromaScaleY) {
+	GLfloat matrix[9], offset[3];
+
+	ColorConvertGetYUVMatrix(frame->colorSpace, frame->colorRange, frame->dh, matrix, offset);
+
+	glUseProgram(program->program);
+	glUniformMatrix3fv(program->matrixLoc, 1, GL_FALSE, matrix);
+	glUniform3fv(program->offsetLoc, 1, offset);
+	glUniform2f(program->chromaScaleLoc, chromaScaleX, chromaScaleY);
+}
+
+DisplayOmapDrmEgl::RenderSlot *DisplayOmapDrmEgl::getRenderSlot() {
+	_renderSlot = (_renderSlot + 1) % NUM_RENDER_SLOTS;
+	RenderSlot *slot = &_renderSlots[_renderSlot];
+
+	_stats.framesUploaded++;
+
+	if (slot->fence == nullptr)
+		return slot;
+
+	// usually draw from two frames ago is long done, only count real waits
+	if (eglClientWaitSyncKHR(_eglDisplay, slot->fence, 0, 0) == EGL_TIMEOUT_EXPIRED_KHR) {
+		S64 startTime = getTime();
+		if (eglClientWaitSyncKHR(_eglDisplay, slot->fence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR,
+		                         EGL_FOREVER_KHR) == EGL_FALSE) {
+			log->printf("DisplayOmapDrmEgl::getRenderSlot(): failed wait for fence, error: %s\n", eglGetErrorStr(eglGetError()));
+		}
+		_stats.fenceWaits++;
+		_stats.fenceWaitTime += getTime() - startTime;
+	}
+
+	eglDestroySyncKHR(_eglDisplay, slot->fence);
+	slot->fence = nullptr;
+
+	return slot;
+}
+
+void DisplayOmapDrmEgl::fenceRenderSlot(RenderSlot *slot) {
+	if (eglCreateSyncKHR == nullptr)
+		return;
+
+	slot->fence = eglCreateSyncKHR(_eglDisplay, EGL_SYNC_FENCE_KHR, nullptr);
+	if (slot->fence == EGL_NO_SYNC_KHR) {
+		log->printf("DisplayOmapDrmEgl::fenceRenderSlot(): failed create fence, error: %s\n", eglGetErrorStr(eglGetError()));
+		slot->fence = nullptr;
+	}
+}
+
+void DisplayOmapDrmEgl::fenceCurrentBuffer() {
+	if (eglCreateSyncKHR == nullptr)
+		return;
+
+	// same buffer drawn again, only last draw matters
+	if (_currentFence)
+		eglDestroySyncKHR(_eglDisplay, _currentFence);
+
+	_currentFence = eglCreateSyncKHR(_eglDisplay, EGL_SYNC_FENCE_KHR, nullptr);
+	if (_currentFence == EGL_NO_SYNC_KHR) {
+		log->printf("DisplayOmapDrmEgl::fenceCurrentBuffer(): failed create fence, error: %s\n", eglGetErrorStr(eglGetError()));
+		_currentFence = nullptr;
+	}
+}
+
+void DisplayOmapDrmEgl::retireCurrentBuffer() {
+	// only one buffer waits for gpu, older one is surely done by now
+	releaseRetiredBuffer(false);
+
+	_retiredBuffer = _currentBuffer;
+	_retiredFence = _currentFence;
+	_currentBuffer = nullptr;
+	_currentFence = nullptr;
+}
+
+void DisplayOmapDrmEgl::releaseRetiredBuffer(bool drawDone) {
+	if (_retiredBuffer == nullptr)
+		return;
+
+	if (_retiredFence) {
+		// after flip of next frame completed this does not block
+		if (eglClientWaitSyncKHR(_eglDisplay, _retiredFence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR,
+		                         EGL_FOREVER_KHR) == EGL_FALSE) {
+			log->printf("DisplayOmapDrmEgl::releaseRetiredBuffer(): failed wait for fence, error: %s\n", eglGetErrorStr(eglGetError()));
+		}
+		eglDestroySyncKHR(_eglDisplay, _retiredFence);
+		_retiredFence = nullptr;
+	} else if (!drawDone) {
+		// no fence, draw sampling the buffer is done only once gpu is idle
+		glFinish();
+	}
+
+	_retiredBuffer->locked.store(false, std::memory_order_release);
+	_retiredBuffer = nullptr;
+}
+
+void DisplayOmapDrmEgl::releaseRenderSlots() {
+	for (int i = 0; i < NUM_RENDER_SLOTS; i++) {
+		RenderSlot *slot = &_renderSlots[i];
+		if (slot->fence) {
+			eglClientWaitSyncKHR(_eglDisplay, slot->fence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+			eglDestroySyncKHR(_eglDisplay, slot->fence);
+		}
+		if (slot->planeTextures[0]) {
+			glDeleteTextures(NUM_YUV_PLANES, slot->planeTextures);
+		}
+		if (slot->renderTexture) {
+			releaseVideoBuffer(slot->renderTexture);
+		}
+		memset(slot, 0, sizeof(RenderSlot));
+	}
+	_renderSlot = 0;
+}
+
+STATUS DisplayOmapDrmEgl::uploadPlanes(RenderSlot *slot, VideoFrame *frame) {
+	if (slot->planeTextures[0] == 0) {
+		glGenTextures(NUM_YUV_PLANES, slot->planeTextures);
+	}
+
+	// GLES2 has no row length unpack, so textures are as wide as padded rows
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 0; i < NUM_YUV_PLANES; i++) {
+		U32 width = frame->stride[i];
+		U32 height = i == 0 ? frame->height : (frame->height + 1) / 2;
+
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, slot->planeTextures[i]);
+		if (width != slot->planeWidth[i] || height != slot->planeHeight[i]) {
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height, 0,
+			             GL_LUMINANCE, GL_UNSIGNED_BYTE, frame->data[i]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			slot->planeWidth[i] = width;
+			slot->planeHeight[i] = height;
 		} else {
-			log->printf("DisplayOmapDrm::putImage(): Not supported format!\n");
-			goto fail;
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+			                GL_LUMINANCE, GL_UNSIGNED_BYTE, frame->data[i]);
 		}
 	}
+	glActiveTexture(GL_TEXTURE0);
 
-	glDepthMask(GL_FALSE);
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_BLEND);
+	if (glGetError() != GL_NO_ERROR) {
+		log->printf("DisplayOmapDrmEgl::uploadPlanes(): failed upload planes!\n");
+		return S_FAIL;
+	}
 
-	glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return S_OK;
+}
 
-	glBindTexture(GL_TEXTURE_EXTERNAL_OES, renderTexture->glTexture);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+STATUS DisplayOmapDrmEgl::importPlanes(RenderTexture *renderTexture, int width, int height) {
+	EGLint widths[NUM_YUV_PLANES] = { width, width / 2, width / 2 };
+	EGLint heights[NUM_YUV_PLANES] = { height, height / 2, height / 2 };
+	EGLint offsets[NUM_YUV_PLANES] = { 0, width * height, width * height + (width / 2) * (height / 2) };
+
+	for (int i = 0; i < NUM_YUV_PLANES; i++) {
+		EGLint attr[] = {
+			EGL_WIDTH,                      widths[i],
+			EGL_HEIGHT,                     heights[i],
+			EGL_LINUX_DRM_FOURCC_EXT,       (EGLint)DRM_FORMAT_R8,
+			EGL_DMA_BUF_PLANE0_FD_EXT,      (EGLint)renderTexture->dmabuf,
+			EGL_DMA_BUF_PLANE0_OFFSET_EXT,  offsets[i],
+			EGL_DMA_BUF_PLANE0_PITCH_EXT,   widths[i],
+			EGL_NONE
+		};
 
-	glFlush();
+		renderTexture->planeImages[i] = eglCreateImageKHR(_eglDisplay, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, (EGLClientBuffer)0, attr);
+		if (renderTexture->planeImages[i] == EGL_NO_IMAGE_KHR) {
+			log->printf("DisplayOmapDrmEgl::importPlanes(): failed to create R8 image, error: %s\n", eglGetErrorStr(eglGetError()));
+			goto fail;
+		}
+
+		glGenTextures(1, &renderTexture->planeTextures[i]);
+		glBindTexture(GL_TEXTURE_EXTERNAL_OES, renderTexture->planeTextures[i]);
+		glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, renderTexture->planeImages[i]);
+		if (glGetError() != GL_NO_ERROR) {
+			log->printf("DisplayOmapDrmEgl::importPlanes(): failed update texture\n");
+			goto fail;
+		}
+	}
+
+	renderTexture->planar = true;
 
 	return S_OK;
 
 fail:
+
+	for (int i = 0; i < NUM_YUV_PLANES; i++) {
+		if (renderTexture->planeTextures[i])
+			glDeleteTextures(1, &renderTexture->planeTextures[i]);
+		if (renderTexture->planeImages[i] && renderTexture->planeImages[i] != EGL_NO_IMAGE_KHR)
+			eglDestroyImageKHR(_eglDisplay, renderTexture->planeImages[i]);
+		renderTexture->planeTextures[i] = 0;
+		renderTexture->planeImages[i] = nullptr;
+	}
+
 	return S_FAIL;
 }
 
 STATUS DisplayOmapDrmEgl::flip(bool skip) {
 	gbm_bo *gbmBo;
 	DrmFb *drmFb;
+	bool skipped = _flipSkipped;
 
 	if (!_initialized)
 		return S_FAIL;
 
+	_flipSkipped = skip;
 	if (skip)
 		return S_OK;
 
+	// rendering is queued already, gpu finishes it while previous flip completes
 	eglSwapBuffers(_eglDisplay, _eglSurface);
 
+	if (waitForFlip() == S_FAIL)
+		return S_FAIL;
+
+	// previous frame is on screen, so draw sampling replaced buffer is done,
+	// unless that draw was skipped and now goes out with this frame
+	if (!skipped)
+		releaseRetiredBuffer(true);
+
 	gbmBo = gbm_surface_lock_front_buffer(_gbmSurface);
+	if (gbmBo == nullptr) {
+		log->printf("DisplayOmapDrmEgl::flip(): failed lock front buffer\n");
+		return S_FAIL;
+	}
 	drmFb = getDrmFb(gbmBo);
-
-	if (drmModeSetPlane(_fd, _planeId, _crtcId,
-	                    drmFb->fbId, 0,
-	                    0, 0, _modeInfo.hdisplay, _modeInfo.vdisplay,
-	                    0, 0, _modeInfo.hdisplay << 16, _modeInfo.vdisplay << 16
-	                    )) {
-		log->printf("DisplayOmapDrmEgl::flip(): failed set plane: %s\n", strerror(errno));
+	if (drmFb == nullptr)
 		goto fail;
+
+	if (_frontBo == nullptr) {
+		// first frame replaces black primary buffer on crtc, later ones flip
+		if (drmModeSetCrtc(_fd, _crtcId, drmFb->fbId, 0, 0, &_connectorId, 1, &_modeInfo)) {
+			log->printf("DisplayOmapDrmEgl::flip(): failed set crtc: %s\n", strerror(errno));
+			goto fail;
+		}
+		_frontBo = gbmBo;
+	} else if (_pageFlip && drmModePageFlip(_fd, _crtcId, drmFb->fbId, DRM_MODE_PAGE_FLIP_EVENT, this) == 0) {
+		_pendingBo = gbmBo;
+		_flipPending = true;
+	} else {
+		if (_pageFlip) {
+			// overlay plane shows frames from now on, primary goes back to black buffer
+			log->printf("DisplayOmapDrmEgl::flip(): failed page flip: %s, using set plane\n", strerror(errno));
+			if (_primaryFbId || createPrimaryBuffer() == S_OK)
+				drmModeSetCrtc(_fd, _crtcId, _primaryFbId, 0, 0, &_connectorId, 1, &_modeInfo);
+			_pageFlip = false;
+		}
+		if (drmModeSetPlane(_fd, _planeId, _crtcId,
+		                    drmFb->fbId, 0,
+		                    0, 0, _modeInfo.hdisplay, _modeInfo.vdisplay,
+		                    0, 0, _modeInfo.hdisplay << 16, _modeInfo.vdisplay << 16
+		                    )) {
+			log->printf("DisplayOmapDrmEgl::flip(): failed set plane: %s\n", strerror(errno));
+			goto fail;
+		}
+		// set plane returns once new buffer is latched
+		_pendingBo = gbmBo;
+		completeFlip();
 	}
 
-	gbm_surface_release_buffer(_gbmSurface, gbmBo);
+	// with two buffers surface nothing is left to render next frame into
+	if (!gbm_surface_has_free_buffers(_gbmSurface))
+		waitForFlip();
 
 	return S_OK;
 
@@ -889,6 +1255,103 @@ fail:
 	return S_FAIL;
 }
 
+void DisplayOmapDrmEgl::pageFlipHandler(int fd, unsigned int frame, unsigned int sec, unsigned int usec, void *data) {
+	((DisplayOmapDrmEgl *)data)->completeFlip();
+}
+
+STATUS DisplayOmapDrmEgl::waitForFlip() {
+	drmEventContext eventContext{};
+	eventContext.version = 2;
+	eventContext.page_flip_handler = pageFlipHandler;
+
+	while (_flipPending) {
+		struct pollfd pfd = { _fd, POLLIN, 0 };
+		int ret = poll(&pfd, 1, DISPLAY_FLIP_TIMEOUT);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			// event is lost, assume flip is done to not stall playback
+			log->printf("DisplayOmapDrmEgl::waitForFlip(): Timeout waiting for flip event!\n");
+			completeFlip();
+			break;
+		}
+		if (drmHandleEvent(_fd, &eventContext)) {
+			log->printf("DisplayOmapDrmEgl::waitForFlip(): failed handle event: %s\n", strerror(errno));
+			return S_FAIL;
+		}
+	}
+
+	return S_OK;
+}
+
+void DisplayOmapDrmEgl::completeFlip() {
+	// pending buffer is on screen now, previous one can be rendered into again
+	if (_pendingBo) {
+		if (_frontBo)
+			gbm_surface_release_buffer(_gbmSurface, _frontBo);
+		_frontBo = _pendingBo;
+		_pendingBo = nullptr;
+	}
+	_flipPending = false;
+}
+
+STATUS DisplayOmapDrmEgl::getStats(DisplayStats *stats) {
+	if (!_initialized || stats == nullptr)
+		return S_FAIL;
+
+	*stats = _stats;
+
+	return S_OK;
+}
+
+U32 DisplayOmapDrmEgl::getVideoFormats(FORMAT_VIDEO *formats) {
+	U32 numFormats = 0;
+
+	if (!_initialized || formats == nullptr)
+		return 0;
+
+	// planar buffers are sampled as three R8 images by shader
+	if (_planarImport && _yuvExternalProgram.program)
+		formats[numFormats++] = FMT_YUV420P;
+	formats[numFormats++] = FMT_NV12;
+
+	return numFormats;
+}
+
+STATUS DisplayOmapDrmEgl::attachThread() {
+	if (!_initialized || _eglDisplay == nullptr)
+		return S_FAIL;
+
+	if (!eglMakeCurrent(_eglDisplay, _eglSurface, _eglSurface, _eglContext)) {
+		log->printf("DisplayOmapDrmEgl::attachThread(): failed make context current, error: %s\n", eglGetErrorStr(eglGetError()));
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+STATUS DisplayOmapDrmEgl::detachThread() {
+	if (!_initialized || _eglDisplay == nullptr)
+		return S_FAIL;
+
+	// context can be current on one thread only
+	glFinish();
+	if (!eglMakeCurrent(_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT)) {
+		log->printf("DisplayOmapDrmEgl::detachThread(): failed release context, error: %s\n", eglGetErrorStr(eglGetError()));
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+S64 DisplayOmapDrmEgl::getTime() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (S64)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
 STATUS DisplayOmapDrmEgl::getHandle(DisplayHandle *handle) {
 	if (!_initialized || handle == nullptr)
 		return S_FAIL;
@@ -901,6 +1364,10 @@ STATUS DisplayOmapDrmEgl::getHandle(DisplayHandle *handle) {
 DisplayOmapDrmEgl::RenderTexture *DisplayOmapDrmEgl::getVideoBuffer(FORMAT_VIDEO pixelfmt, int width, int height) {
 	DisplayVideoBuffer buffer;
 
+	// frames are copied in as NV12, planar import is only for decoder buffers
+	if (pixelfmt == FMT_YUV420P)
+		pixelfmt = FMT_NV12;
+
 	if (getDisplayVideoBuffer(&buffer, pixelfmt, width, height) != S_OK) {
 		return nullptr;
 	}
@@ -974,6 +1441,26 @@ STATUS DisplayOmapDrmEgl::getDisplayVideoBuffer(DisplayVideoBuffer *handle, FORM
 	renderTexture->mapSize = fbSize;
 	renderTexture->dmabuf = handle->dmaBuf;
 
+	if (pixelfmt == FMT_YUV420P && _planarImport && _yuvExternalProgram.program) {
+		// decoder writes planes directly, shader samples them without NV12 repack
+		if (importPlanes(renderTexture, width, height) == S_OK) {
+			renderTexture->db = handle;
+			handle->priv = renderTexture;
+			handle->pixelfmt = FMT_YUV420P;
+			handle->ptr = map;
+			handle->size = fbSize;
+			memset(handle->stride, 0, sizeof(handle->stride));
+			memset(handle->offset, 0, sizeof(handle->offset));
+			handle->stride[0] = width;
+			handle->stride[1] = handle->stride[2] = width / 2;
+			handle->offset[1] = width * height;
+			handle->offset[2] = width * height + (width / 2) * (height / 2);
+			return S_OK;
+		}
+		log->printf("DisplayOmapDrmEgl::getDisplayVideoBuffer(): Planar import not supported, using NV12\n");
+		_planarImport = false;
+	}
+
 	EGLint attr[] = {
 		EGL_WIDTH,                      (EGLint)width,
 		EGL_HEIGHT,                     (EGLint)height,
@@ -982,7 +1469,7 @@ STATUS DisplayOmapDrmEgl::getDisplayVideoBuffer(DisplayVideoBuffer *handle, FORM
 		EGL_DMA_BUF_PLANE0_OFFSET_EXT,  0,
 		EGL_DMA_BUF_PLANE0_PITCH_EXT,   (EGLint)stride,
 		EGL_DMA_BUF_PLANE1_FD_EXT,      (EGLint)renderTexture->dmabuf,
-		EGL_DMA_BUF_PLANE1_OFFSET_EXT,  0,
+		EGL_DMA_BUF_PLANE1_OFFSET_EXT,  (EGLint)(stride * height),
 		EGL_DMA_BUF_PLANE1_PITCH_EXT,   (EGLint)stride,
 		EGL_NONE
 	};
@@ -1008,6 +1495,13 @@ STATUS DisplayOmapDrmEgl::getDisplayVideoBuffer(DisplayVideoBuffer *handle, FORM
 
 	renderTexture->db = handle;
 	handle->priv = renderTexture;
+	handle->pixelfmt = FMT_NV12;
+	handle->ptr = map;
+	handle->size = fbSize;
+	memset(handle->stride, 0, sizeof(handle->stride));
+	memset(handle->offset, 0, sizeof(handle->offset));
+	handle->stride[0] = handle->stride[1] = stride;
+	handle->offset[1] = stride * height;
 
 	return S_OK;
 
@@ -1045,6 +1539,13 @@ STATUS DisplayOmapDrmEgl::releaseVideoBuffer(RenderTexture *texture) {
 		glDeleteTextures(1, &texture->glTexture);
 	}
 
+	for (int i = 0; i < NUM_YUV_PLANES; i++) {
+		if (texture->planeImages[i])
+			eglDestroyImageKHR(_eglDisplay, texture->planeImages[i]);
+		if (texture->planeTextures[i])
+			glDeleteTextures(1, &texture->planeTextures[i]);
+	}
+
 	if (texture->dmabuf)
 		close(texture->dmabuf);
 
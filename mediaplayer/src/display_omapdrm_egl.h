@@ -24,11 +24,6 @@
 
 #include "display_base.h"
 #include "basetypes.h"
-#ifdef __cplusplus
-extern "C" {
-	#include <libswscale/swscale.h>
-}
-#endif
 #include <cstdint>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -41,6 +36,9 @@ extern "C" {
 
 namespace MediaPLayer {
 
+#define NUM_YUV_PLANES      3
+#define NUM_RENDER_SLOTS    3
+
 class DisplayOmapDrmEgl : public Display {
 private:
 
@@ -57,12 +55,37 @@ private:
 		uint32_t       mapSize;
 		EGLImageKHR    image;
 		GLuint         glTexture;
+		bool           planar; // Y, U and V imported as separate R8 images
+		EGLImageKHR    planeImages[NUM_YUV_PLANES];
+		GLuint         planeTextures[NUM_YUV_PLANES];
 		DisplayVideoBuffer *db;
 	} RenderTexture;
 
+	// cpu writes next slot while gpu may still sample previous ones
+	typedef struct {
+		RenderTexture  *renderTexture; // NV12 copy target
+		GLuint         planeTextures[NUM_YUV_PLANES];
+		U32            planeWidth[NUM_YUV_PLANES], planeHeight[NUM_YUV_PLANES];
+		EGLSyncKHR     fence;          // signalled once draw sampling slot is done
+	} RenderSlot;
+
+	typedef struct {
+		GLuint         fragmentShader;
+		GLuint         program;
+		GLint          planeLoc[NUM_YUV_PLANES];
+		GLint          matrixLoc;
+		GLint          offsetLoc;
+		GLint          chromaScaleLoc;
+	} YUVProgram;
+
 	int                         _fd;
 	gbm_device                  *_gbmDevice;
 	gbm_surface                 *_gbmSurface;
+	gbm_bo                      *_frontBo;     // on screen, locked until next flip completes
+	gbm_bo                      *_pendingBo;   // queued by page flip
+	bool                        _flipPending;
+	bool                        _pageFlip;     // false if crtc refused page flips
+	bool                        _flipSkipped;  // last frame was drawn but not swapped
 
 	drmModeResPtr               _drmResources;
 	drmModePlaneResPtr          _drmPlaneResources;
@@ -84,13 +107,23 @@ private:
 	PFNEGLCREATEIMAGEKHRPROC    eglCreateImageKHR;
 	PFNEGLDESTROYIMAGEKHRPROC   eglDestroyImageKHR;
 	PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
+	PFNEGLCREATESYNCKHRPROC     eglCreateSyncKHR;
+	PFNEGLDESTROYSYNCKHRPROC    eglDestroySyncKHR;
+	PFNEGLCLIENTWAITSYNCKHRPROC eglClientWaitSyncKHR;
 	GLuint                      _vertexShader;
 	GLuint                      _fragmentShader;
 	GLuint                      _glProgram;
-	RenderTexture               *_renderTexture;
+	RenderSlot                  _renderSlots[NUM_RENDER_SLOTS];
+	int                         _renderSlot;
+	YUVProgram                  _yuvProgram;         // converts planes uploaded to luminance textures
+	YUVProgram                  _yuvExternalProgram; // converts planes imported from dma-buf
+	bool                        _planarImport;       // false once R8 dma-buf import failed
+	DisplayVideoBuffer          *_currentBuffer; // decoder buffer sampled by last draw
+	EGLSyncKHR                  _currentFence;  // signalled once last draw from it is done
+	DisplayVideoBuffer          *_retiredBuffer; // replaced buffer, gpu may still sample it
+	EGLSyncKHR                  _retiredFence;
 	U32                         _fbWidth, _fbHeight;
-
-	SwsContext                  *_scaleCtx;
+	DisplayStats                _stats;
 
 public:
 
@@ -99,12 +132,16 @@ public:
 
 	STATUS init(bool hwAccelDecode);
 	STATUS deinit();
-	STATUS configure(FORMAT_VIDEO videoFmt, int videoFps, int videoWidth, int videoHeight);
+	STATUS configure(FORMAT_VIDEO videoFmt, float videoFps, int videoWidth, int videoHeight);
 	STATUS putImage(VideoFrame *frame, bool skip);
 	STATUS flip(bool skip);
 	STATUS getHandle(DisplayHandle *handle);
 	STATUS getDisplayVideoBuffer(DisplayVideoBuffer *handle, FORMAT_VIDEO pixelfmt, int width, int height);
 	STATUS releaseDisplayVideoBuffer(DisplayVideoBuffer *handle);
+	STATUS getStats(DisplayStats *stats);
+	U32 getVideoFormats(FORMAT_VIDEO *formats);
+	STATUS attachThread();
+	STATUS detachThread();
 
 private:
 
@@ -113,8 +150,24 @@ private:
 	static void drmFbDestroyCallback(gbm_bo *gbmBo, void *data);
 	DrmFb *getDrmFb(gbm_bo *gbmBo);
 	const char* eglGetErrorStr(EGLint error);
+	static S64 getTime();
 	RenderTexture *getVideoBuffer(FORMAT_VIDEO pixelfmt, int width, int height);
 	STATUS releaseVideoBuffer(RenderTexture *texture);
+	STATUS createYUVProgram(YUVProgram *program, bool external);
+	void destroyYUVProgram(YUVProgram *program);
+	void useYUVProgram(YUVProgram *program, VideoFrame *frame, float chromaScaleX, float chromaScaleY);
+	RenderSlot *getRenderSlot();
+	void fenceRenderSlot(RenderSlot *slot);
+	void releaseRenderSlots();
+	void fenceCurrentBuffer();
+	void retireCurrentBuffer();
+	void releaseRetiredBuffer(bool drawDone);
+	STATUS uploadPlanes(RenderSlot *slot, VideoFrame *frame);
+	STATUS importPlanes(RenderTexture *renderTexture, int width, int height);
+	STATUS createPrimaryBuffer();
+	void releasePrimaryBuffer();
+	STATUS waitForFlip();
+	void completeFlip();
 	static void pageFlipHandler(int fd, unsigned int frame, unsigned int sec, unsigned int usec, void *data);
 };
 
@@ -0,0 +1,310 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "basetypes.h"
+#include "h264_sps.h"
+
+namespace MediaPLayer {
+
+#define H264_NAL_SPS  7
+
+typedef struct {
+	const U8 *data;
+	U32      size;  // in bits
+	U32      pos;   // in bits
+	bool     error;
+} BitReader;
+
+static U32 readBits(BitReader *br, int count) {
+	U32 value = 0;
+
+	for (int i = 0; i < count; i++) {
+		if (br->pos >= br->size) {
+			br->error = true;
+			return 0;
+		}
+		value = (value << 1) | ((br->data[br->pos >> 3] >> (7 - (br->pos & 7))) & 1);
+		br->pos++;
+	}
+
+	return value;
+}
+
+static U32 readUE(BitReader *br) {
+	int zeros = 0;
+
+	while (readBits(br, 1) == 0) {
+		if (br->error || ++zeros > 31) {
+			br->error = true;
+			return 0;
+		}
+	}
+
+	return ((1U << zeros) - 1) + readBits(br, zeros);
+}
+
+static S32 readSE(BitReader *br) {
+	U32 value = readUE(br);
+
+	return (value & 1) ? (S32)((value + 1) / 2) : -(S32)(value / 2);
+}
+
+static void skipScalingList(BitReader *br, int size) {
+	int lastScale = 8, nextScale = 8;
+
+	for (int i = 0; i < size && !br->error; i++) {
+		if (nextScale != 0) {
+			nextScale = (lastScale + readSE(br) + 256) % 256;
+		}
+		lastScale = (nextScale == 0) ? lastScale : nextScale;
+	}
+}
+
+static void skipHrdParameters(BitReader *br) {
+	U32 cpbCnt = readUE(br) + 1;
+
+	readBits(br, 4); // bit_rate_scale
+	readBits(br, 4); // cpb_size_scale
+	for (U32 i = 0; i < cpbCnt && !br->error; i++) {
+		readUE(br); // bit_rate_value_minus1
+		readUE(br); // cpb_size_value_minus1
+		readBits(br, 1); // cbr_flag
+	}
+	readBits(br, 5 * 4); // delay and time offset lengths
+}
+
+static void parseVui(BitReader *br, H264SpsInfo *info) {
+	if (readBits(br, 1)) { // aspect_ratio_info_present_flag
+		if (readBits(br, 8) == 255) // Extended_SAR
+			readBits(br, 32);
+	}
+	if (readBits(br, 1)) // overscan_info_present_flag
+		readBits(br, 1);
+	if (readBits(br, 1)) { // video_signal_type_present_flag
+		readBits(br, 4);
+		if (readBits(br, 1)) // colour_description_present_flag
+			readBits(br, 24);
+	}
+	if (readBits(br, 1)) { // chroma_loc_info_present_flag
+		readUE(br);
+		readUE(br);
+	}
+	if (readBits(br, 1)) { // timing_info_present_flag
+		readBits(br, 32);
+		readBits(br, 32);
+		readBits(br, 1);
+	}
+	bool nalHrd = readBits(br, 1);
+	if (nalHrd)
+		skipHrdParameters(br);
+	bool vclHrd = readBits(br, 1);
+	if (vclHrd)
+		skipHrdParameters(br);
+	if (nalHrd || vclHrd)
+		readBits(br, 1); // low_delay_hrd_flag
+	readBits(br, 1); // pic_struct_present_flag
+
+	if (readBits(br, 1)) { // bitstream_restriction_flag
+		readBits(br, 1); // motion_vectors_over_pic_boundaries_flag
+		readUE(br); // max_bytes_per_pic_denom
+		readUE(br); // max_bits_per_mb_denom
+		readUE(br); // log2_max_mv_length_horizontal
+		readUE(br); // log2_max_mv_length_vertical
+		info->maxNumReorderFrames = readUE(br);
+		info->maxDecFrameBuffering = readUE(br);
+		info->bitstreamRestriction = !br->error;
+	}
+}
+
+static STATUS parseSps(const U8 *nal, int size, H264SpsInfo *info) {
+	// strip emulation prevention bytes
+	U8 *rbsp = (U8 *)malloc(size);
+	if (rbsp == nullptr)
+		return S_FAIL;
+	int rbspSize = 0, zeros = 0;
+	for (int i = 1; i < size; i++) {
+		if (zeros >= 2 && nal[i] == 3) {
+			zeros = 0;
+			continue;
+		}
+		zeros = (nal[i] == 0) ? zeros + 1 : 0;
+		rbsp[rbspSize++] = nal[i];
+	}
+
+	BitReader br = { rbsp, (U32)rbspSize * 8, 0, false };
+	memset(info, 0, sizeof(H264SpsInfo));
+
+	info->profileIdc = readBits(&br, 8);
+	readBits(&br, 8); // constraint flags
+	info->levelIdc = readBits(&br, 8);
+	readUE(&br); // seq_parameter_set_id
+
+	switch (info->profileIdc) {
+	case 100: case 110: case 122: case 244: case 44:
+	case 83: case 86: case 118: case 128: case 138:
+	case 139: case 134: case 135: {
+		U32 chromaFormatIdc = readUE(&br);
+		if (chromaFormatIdc == 3)
+			readBits(&br, 1); // separate_colour_plane_flag
+		readUE(&br); // bit_depth_luma_minus8
+		readUE(&br); // bit_depth_chroma_minus8
+		readBits(&br, 1); // qpprime_y_zero_transform_bypass_flag
+		if (readBits(&br, 1)) { // seq_scaling_matrix_present_flag
+			for (int i = 0; i < (chromaFormatIdc != 3 ? 8 : 12); i++) {
+				if (readBits(&br, 1))
+					skipScalingList(&br, i < 6 ? 16 : 64);
+			}
+		}
+		break;
+	}
+	default:
+		break;
+	}
+
+	readUE(&br); // log2_max_frame_num_minus4
+	U32 pocType = readUE(&br);
+	if (pocType == 0) {
+		readUE(&br); // log2_max_pic_order_cnt_lsb_minus4
+	} else if (pocType == 1) {
+		readBits(&br, 1); // delta_pic_order_always_zero_flag
+		readSE(&br); // offset_for_non_ref_pic
+		readSE(&br); // offset_for_top_to_bottom_field
+		U32 numRefFramesInPocCycle = readUE(&br);
+		for (U32 i = 0; i < numRefFramesInPocCycle && !br.error; i++)
+			readSE(&br);
+	}
+
+	info->maxNumRefFrames = readUE(&br);
+	readBits(&br, 1); // gaps_in_frame_num_value_allowed_flag
+	info->widthInMbs = readUE(&br) + 1;
+	U32 heightInMapUnits = readUE(&br) + 1;
+	bool frameMbsOnly = readBits(&br, 1);
+	info->heightInMbs = frameMbsOnly ? heightInMapUnits : heightInMapUnits * 2;
+	if (!frameMbsOnly)
+		readBits(&br, 1); // mb_adaptive_frame_field_flag
+	readBits(&br, 1); // direct_8x8_inference_flag
+	if (readBits(&br, 1)) { // frame_cropping_flag
+		readUE(&br);
+		readUE(&br);
+		readUE(&br);
+		readUE(&br);
+	}
+	if (br.error) {
+		free(rbsp);
+		return S_FAIL;
+	}
+
+	// truncated VUI still leaves usable header fields
+	if (readBits(&br, 1)) // vui_parameters_present_flag
+		parseVui(&br, info);
+	if (br.error)
+		info->bitstreamRestriction = false;
+
+	free(rbsp);
+
+	return S_OK;
+}
+
+STATUS ParseH264Sps(const U8 *extradata, int size, H264SpsInfo *info) {
+	if (extradata == nullptr || size < 4 || info == nullptr)
+		return S_FAIL;
+
+	if (extradata[0] == 1) {
+		// avcC: 5 bytes header, sps count, then 16 bit length prefixed sps
+		if (size < 8 || (extradata[5] & 0x1f) == 0)
+			return S_FAIL;
+		int spsSize = (extradata[6] << 8) | extradata[7];
+		if (spsSize < 4 || 8 + spsSize > size)
+			return S_FAIL;
+		return parseSps(extradata + 8, spsSize, info);
+	}
+
+	// Annex B: find start code followed by sps nal
+	for (int i = 0; i + 3 < size; i++) {
+		if (extradata[i] != 0 || extradata[i + 1] != 0 || extradata[i + 2] != 1)
+			continue;
+		const U8 *nal = extradata + i + 3;
+		if ((nal[0] & 0x1f) != H264_NAL_SPS)
+			continue;
+		// following nals are never reached by parser
+		return parseSps(nal, size - (i + 3), info);
+	}
+
+	return S_FAIL;
+}
+
+U32 GetH264MaxDpbFrames(U32 levelIdc, U32 widthInMbs, U32 heightInMbs) {
+	U32 maxDpbMbs;
+
+	switch (levelIdc) {
+	case 9: // level 1b
+	case 10:
+		maxDpbMbs = 396;
+		break;
+	case 11:
+		maxDpbMbs = 900;
+		break;
+	case 12:
+	case 13:
+	case 20:
+		maxDpbMbs = 2376;
+		break;
+	case 21:
+		maxDpbMbs = 4752;
+		break;
+	case 22:
+	case 30:
+		maxDpbMbs = 8100;
+		break;
+	case 31:
+		maxDpbMbs = 18000;
+		break;
+	case 32:
+		maxDpbMbs = 20480;
+		break;
+	case 40:
+	case 41:
+		maxDpbMbs = 32768;
+		break;
+	case 42:
+		maxDpbMbs = 34816;
+		break;
+	case 50:
+		maxDpbMbs = 110400;
+		break;
+	case 51:
+	case 52:
+		maxDpbMbs = 184320;
+		break;
+	default:
+		return 0;
+	}
+
+	if (widthInMbs == 0 || heightInMbs == 0)
+		return 16;
+
+	return MIN(16, maxDpbMbs / (widthInMbs * heightInMbs));
+}
+
+} // namespace
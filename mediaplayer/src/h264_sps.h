@@ -0,0 +1,48 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef H264_SPS_H
+#define H264_SPS_H
+
+#include "basetypes.h"
+
+namespace MediaPLayer {
+
+typedef struct {
+	U32 profileIdc;
+	U32 levelIdc;
+	U32 widthInMbs;
+	U32 heightInMbs;           // frame height, both fields for interlaced
+	U32 maxNumRefFrames;
+	U32 maxNumReorderFrames;   // valid if bitstreamRestriction
+	U32 maxDecFrameBuffering;  // valid if bitstreamRestriction
+	bool bitstreamRestriction;
+} H264SpsInfo;
+
+// Parses first SPS found in avcC or Annex B extradata.
+STATUS ParseH264Sps(const U8 *extradata, int size, H264SpsInfo *info);
+
+// Returns MaxDpbFrames from level limits table, 0 for unknown levels.
+U32 GetH264MaxDpbFrames(U32 levelIdc, U32 widthInMbs, U32 heightInMbs);
+
+} // namespace
+
+#endif
@@ -21,8 +21,9 @@
 
 #include <unistd.h>
 #include <stdlib.h>
-#include <time.h>
-#include <sys/time.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
 
 #include "basetypes.h"
 #include "avtypes.h"
@@ -32,6 +33,9 @@
 #include "demuxer_base.h"
 #include "decoder_video_base.h"
 #include "decoder_audio_base.h"
+#include "pipeline.h"
+#include "scheduler.h"
+#include "benchmark.h"
 
 extern "C" {
 	#include <libavformat/avformat.h>
@@ -40,14 +44,33 @@ extern "C" {
 
 namespace MediaPLayer {
 
-static double getTime() {
-	struct timeval t;
+static const char *getDisplayName(DISPLAY_TYPE displayType) {
+	switch (displayType) {
+	case DISPLAY_FBDEV:
+		return "fbdev";
+	case DISPLAY_OMAPDRM:
+		return "omapdrm";
+	case DISPLAY_OMAPDRM_EGL:
+		return "omapdrm-egl";
+	case DISPLAY_NULL:
+		return "null";
+	default:
+		return "none";
+	}
+}
 
-	gettimeofday(&t, NULL);
+static bool parseNumber(const char *str, long min, long max, U32 *value) {
+	char *end;
 
-	return t.tv_sec * (double)1000000 + t.tv_usec;
-}
+	errno = 0;
+	long number = strtol(str, &end, 0);
+	if (errno != 0 || end == str || *end != '\0' || number < min || number > max)
+		return false;
 
+	*value = (U32)number;
+
+	return true;
+}
 
 int Player(int argc, char *argv[]) {
 	int option;
@@ -61,16 +84,103 @@ int Player(int argc, char *argv[]) {
 	bool hwAccel = false;
 	StreamFrame inputFrame{};
 	DISPLAY_TYPE prefferedDisplay = DISPLAY_OMAPDRM;
-	double deltaFrameTime;
-	double timeFrame = 0;
-	bool firstTimeFrame = true;
+	Scheduler scheduler;
+	SchedulerStats schedulerStats;
+	bool pipelineMode = false;
+	U32 packetQueueDepth = PIPELINE_DEFAULT_PACKET_QUEUE_DEPTH;
+	U32 frameQueueDepth = PIPELINE_DEFAULT_FRAME_QUEUE_DEPTH;
+	Pipeline *pipeline = nullptr;
+	U32 displayFlags = 0;
+	DISPLAY_TYPE displayType;
+	Benchmark benchmark;
+	bool benchmarkMode = false;
+	const char *benchmarkFile = BENCHMARK_DEFAULT_JSON;
+	DemuxerReadAheadConfig readAheadConfig{};
+	DemuxerReadAheadStats readAheadStats;
+	DecoderVideoStats decoderStats;
+	DisplayStats displayStats;
+	DecoderVideoThreadConfig threadConfig = { 0, DECODER_THREAD_FRAME | DECODER_THREAD_SLICE, 0 };
+	U32 convertWidth, convertHeight;
 
 	if (CreateLogs() == S_FAIL)
 		goto end;
 
-
-	while ((option = getopt(argc, argv, ":")) != -1) {
+	while ((option = getopt(argc, argv, ":pq:Q:ncLRBj:r:t:T:a:C:")) != -1) {
 		switch (option) {
+		case 'p':
+			pipelineMode = true;
+			break;
+		case 'q':
+			if (!parseNumber(optarg, 1, PIPELINE_MAX_QUEUE_DEPTH, &packetQueueDepth)) {
+				log->printf("Wrong packet queue depth, expected 1 to %d!\n", PIPELINE_MAX_QUEUE_DEPTH);
+				goto end;
+			}
+			break;
+		case 'Q':
+			if (!parseNumber(optarg, 1, PIPELINE_MAX_QUEUE_DEPTH, &frameQueueDepth)) {
+				log->printf("Wrong frame queue depth, expected 1 to %d!\n", PIPELINE_MAX_QUEUE_DEPTH);
+				goto end;
+			}
+			break;
+		case 'n':
+			prefferedDisplay = DISPLAY_NULL;
+			break;
+		case 'c':
+			displayFlags |= DISPLAY_FLAG_CHECKSUM;
+			break;
+		case 'L':
+			displayFlags |= DISPLAY_FLAG_LEGACY_KMS;
+			break;
+		case 'R':
+			displayFlags |= DISPLAY_FLAG_RGB565;
+			break;
+		case 'B':
+			benchmarkMode = true;
+			break;
+		case 'j':
+			benchmarkFile = optarg;
+			break;
+		case 'r':
+			readAheadConfig.maxBytes = DEMUXER_READAHEAD_DEFAULT_BYTES;
+			readAheadConfig.maxDuration = DEMUXER_READAHEAD_DEFAULT_DURATION;
+			readAheadConfig.lowWatermark = DEMUXER_READAHEAD_DEFAULT_LOW;
+			readAheadConfig.highWatermark = DEMUXER_READAHEAD_DEFAULT_HIGH;
+			if (sscanf(optarg, "%u:%u", &readAheadConfig.maxBytes, &readAheadConfig.maxDuration) < 1 ||
+			    readAheadConfig.maxBytes == 0) {
+				log->printf("Wrong read-ahead budget, expected <kbytes>[:<ms>]!\n");
+				goto end;
+			}
+			readAheadConfig.maxBytes *= 1024;
+			break;
+		case 't':
+			if (!parseNumber(optarg, 0, DECODER_MAX_THREADS, &threadConfig.threads)) {
+				log->printf("Wrong number of decoder threads, expected 0 to %d!\n", DECODER_MAX_THREADS);
+				goto end;
+			}
+			break;
+		case 'T':
+			if (strcmp(optarg, "frame") == 0) {
+				threadConfig.types = DECODER_THREAD_FRAME;
+			} else if (strcmp(optarg, "slice") == 0) {
+				threadConfig.types = DECODER_THREAD_SLICE;
+			} else if (strcmp(optarg, "auto") == 0) {
+				threadConfig.types = DECODER_THREAD_FRAME | DECODER_THREAD_SLICE;
+			} else {
+				log->printf("Wrong threading type, expected frame, slice or auto!\n");
+				goto end;
+			}
+			break;
+		case 'a':
+			threadConfig.cpuMask = strtoul(optarg, nullptr, 0);
+			break;
+		case 'C':
+			if (sscanf(optarg, "%ux%u", &convertWidth, &convertHeight) != 2 ||
+			    convertWidth == 0 || convertHeight == 0) {
+				log->printf("Wrong colour conversion benchmark size, expected <width>x<height>!\n");
+				goto end;
+			}
+			Benchmark::runColorConvert(convertWidth, convertHeight, BENCHMARK_COLOR_CONVERT_ITERATIONS);
+			goto end;
 		default:
 			break;
 		}
@@ -106,7 +216,14 @@ int Player(int argc, char *argv[]) {
 		goto end;
 	}
 
-	deltaFrameTime = 1000000.0 / info.fps;
+	if (readAheadConfig.maxBytes > 0 && demuxer->setReadAhead(&readAheadConfig) == S_FAIL) {
+		log->printf("Failed setup demuxer read-ahead!\n");
+		goto end;
+	}
+
+	if (!(info.fps > 0)) {
+		log->printf("Unknown frame rate, using %d fps for frames without timestamp\n", SCHEDULER_DEFAULT_FPS);
+	}
 
 	decoderVideo = CreateDecoderVideo(DECODER_LIBDCE);
 	if (decoderVideo == nullptr) {
@@ -131,29 +248,42 @@ int Player(int argc, char *argv[]) {
 		}
 	}
 
-	display = CreateDisplay(prefferedDisplay);
+	displayType = prefferedDisplay;
+	display = CreateDisplay(displayType);
 	if (display == nullptr) {
 		log->printf("Failed get handle to OAMP DRM display!\n");
 		goto end;
 	}
-	if (display->init(hwAccel) == S_FAIL) {
+	display->setFlags(displayFlags);
+	if (prefferedDisplay == DISPLAY_NULL) {
+		if (display->init(hwAccel) == S_FAIL) {
+			log->printf("Failed init null display!\n");
+			goto end;
+		}
+	} else if (display->init(hwAccel) == S_FAIL) {
 		log->printf("Failed init OMAP DRM display!\n");
 		delete display;
-		display = CreateDisplay(DISPLAY_FBDEV);
+		displayType = DISPLAY_FBDEV;
+		display = CreateDisplay(displayType);
 		if (display == nullptr) {
 			log->printf("Failed get handle to FBDEV display!\n");
 			goto end;
 		}
+		display->setFlags(displayFlags);
 		if (display->init(hwAccel) == S_FAIL) {
 			log->printf("Failed init FBDEV display!\n");
 			goto end;
 		}
 	}
-	if (display->configure(info.pixelfmt, 25, info.width, info.height) == S_FAIL) {
+	if (display->configure(info.pixelfmt, info.fps, info.width, info.height) == S_FAIL) {
 		log->printf("Failed configure display!\n");
 		goto end;
 	}
 
+	if (pipelineMode) {
+		decoderVideo->setOutputQueueDepth(frameQueueDepth);
+	}
+	decoderVideo->setThreadConfig(&threadConfig);
 	if (decoderVideo->init(demuxer, display) == S_FAIL) {
 		log->printf("Failed get init video decoder!\n");
 		goto end;
@@ -175,67 +305,131 @@ int Player(int argc, char *argv[]) {
 		goto end;
 	}
 
-	for (;;) {
-		double startT = getTime();
-		double nextFlip = timeFrame + deltaFrameTime;
+	scheduler.init(info.fps, display);
 
-		decoderVideo->getDemuxerBuffer(&inputFrame);
-		decoderAudio->getDemuxerBuffer(&inputFrame);
-		if (demuxer->readNextFrame(&inputFrame) != S_OK)
-			break;
+	if (pipelineMode) {
+		pipeline = new Pipeline();
+		if (pipeline->init(demuxer, decoderVideo, display, benchmarkMode ? nullptr : &scheduler,
+		                   &benchmark, hwAccel, packetQueueDepth, frameQueueDepth) == S_FAIL) {
+			log->printf("Failed init pipeline!\n");
+			goto end;
+		}
+		benchmark.start();
+		if (pipeline->run() == S_FAIL) {
+			log->printf("Pipeline playback failed!\n");
+		}
+		benchmark.stop();
+		goto stats;
+	}
 
+	benchmark.start();
+	for (bool endOfStream = false, failed = false; !failed;) {
+		S64 stageTime;
 		bool frameReady = false;
-		if (inputFrame.videoFrame.data != nullptr) {
-			if (decoderVideo->decodeFrame(frameReady, &inputFrame) != S_OK) {
-				log->printf("Failed decode frame!\n");
-				break;
+
+		if (!endOfStream) {
+			decoderVideo->getDemuxerBuffer(&inputFrame);
+			decoderAudio->getDemuxerBuffer(&inputFrame);
+			stageTime = Benchmark::getTime();
+			if (demuxer->readNextFrame(&inputFrame) != S_OK) {
+				endOfStream = true;
+				continue;
 			}
+			benchmark.addSample(BENCHMARK_STAGE_DEMUX, Benchmark::getTime() - stageTime);
+
+			if (inputFrame.videoFrame.data != nullptr) {
+				decoderVideo->commitDemuxerBuffer(&inputFrame);
+				stageTime = Benchmark::getTime();
+				if (decoderVideo->decodeFrame(frameReady, &inputFrame) != S_OK) {
+					log->printf("Failed decode frame!\n");
+					break;
+				}
+				benchmark.addSample(BENCHMARK_STAGE_DECODE, Benchmark::getTime() - stageTime);
+			}
+		} else {
+			// decoder may still hold delayed frames
+			if (decoderVideo->drain(frameReady) != S_OK || !frameReady)
+				break;
 		}
 
-		if (frameReady) {
+		while (frameReady) {
 			VideoFrame outputFrame{};
-			long timeToSleep;
+			bool skip = false;
 
+			failed = true;
+			stageTime = Benchmark::getTime();
 			if (decoderVideo->getVideoStreamOutputFrame(demuxer, &outputFrame) != S_OK) {
 				log->printf("Failed get decoded frame!\n");
 				break;
 			}
+			benchmark.addSample(BENCHMARK_STAGE_OUTPUT_FRAME, Benchmark::getTime() - stageTime);
 
+			stageTime = Benchmark::getTime();
 			if (display->putImage(&outputFrame, false) == S_FAIL) {
 				log->printf("Failed configure display!\n");
 				break;
 			}
+			benchmark.addSample(BENCHMARK_STAGE_PUT_IMAGE, Benchmark::getTime() - stageTime);
 
-			if (firstTimeFrame) {
-				timeToSleep = 0;
-			} else {
-				timeToSleep = nextFlip - getTime();
-			}
-			//printf("time to sleep %dus\n", (long)timeToSleep);
-			if (timeToSleep > 0) {
-				usleep(timeToSleep);
+			if (!benchmarkMode) {
+				scheduler.waitForFrame(outputFrame.pts, skip);
 			}
 
-			double s1 = getTime();
-			if (display->flip(timeToSleep < 0) == S_FAIL) {
+			stageTime = Benchmark::getTime();
+			if (display->flip(skip) == S_FAIL) {
 				log->printf("Failed flip display!\n");
 				break;
 			}
-			//printf("flip %dus\n", (long)(getTime() - s1));
+			benchmark.addSample(BENCHMARK_STAGE_FLIP, Benchmark::getTime() - stageTime);
+			benchmark.frameDone();
 
-			if (firstTimeFrame) {
-				timeFrame = getTime();
-				firstTimeFrame = false;
-			} else {
-				timeFrame = nextFlip;
+			if (!benchmarkMode) {
+				scheduler.framePresented(skip);
 			}
+			failed = false;
 
-			double endT = getTime();
-			//printf("delta time %dus\n", (long)(endT - startT));
+			frameReady = decoderVideo->hasPendingFrame();
 		}
 	}
+	benchmark.stop();
+
+stats:
+	if (demuxer->getReadAheadStats(&readAheadStats) == S_OK) {
+		log->printf("Read-ahead: packets %llu, throttles %llu, peak %u bytes, peak %lldms\n",
+		            readAheadStats.packetsRead, readAheadStats.throttles,
+		            readAheadStats.peakBytes, readAheadStats.peakDuration / 1000);
+		log->printf("Read-ahead: underruns %llu, waited %llums, max wait %llums\n",
+		            readAheadStats.underruns, readAheadStats.underrunTime / 1000,
+		            readAheadStats.maxUnderrunTime / 1000);
+	}
+
+	if (benchmarkMode) {
+		benchmark.report(hwAccel ? "libdce" : "libav", getDisplayName(displayType), &info,
+		                 decoderVideo->getStats(&decoderStats) == S_OK ? &decoderStats : nullptr,
+		                 benchmarkFile);
+		goto end;
+	}
+
+	scheduler.getStats(&schedulerStats);
+	log->printf("Frames: early %llu, on time %llu, late %llu, dropped %llu, resyncs %llu\n",
+	            schedulerStats.framesEarly, schedulerStats.framesOnTime, schedulerStats.framesLate,
+	            schedulerStats.framesDropped, schedulerStats.resyncs);
+	if (schedulerStats.framesPresented > 0) {
+		log->printf("Drift: last %lldus, avg %lldus, max %lldus\n", schedulerStats.lastDrift,
+		            schedulerStats.sumDrift / (S64)schedulerStats.framesPresented, schedulerStats.maxDrift);
+	}
+	if (schedulerStats.cadenceSeconds > 0) {
+		log->printf("Cadence: %llu seconds, %llu with errors, error %llu vblanks, max %llu vblanks per second\n",
+		            schedulerStats.cadenceSeconds, schedulerStats.cadenceErrorSeconds,
+		            schedulerStats.cadenceError, schedulerStats.maxCadenceError);
+	}
+	if (display->getStats(&displayStats) == S_OK && displayStats.framesUploaded > 0) {
+		log->printf("Display: uploads %llu, fence waits %llu, waited %lldus\n",
+		            displayStats.framesUploaded, displayStats.fenceWaits, displayStats.fenceWaitTime);
+	}
 
 end:
+	delete pipeline;
 	delete decoderAudio;
 	delete audio;
 	delete decoderVideo;
@@ -0,0 +1,332 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "osd.h"
+#include "logs.h"
+
+namespace MediaPLayer {
+
+// ASCII 0x20-0x7e, row per byte, bit 0 is leftmost pixel
+static const U8 osdFont[][OSD_FONT_HEIGHT] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+	{ 0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00 }, // '!'
+	{ 0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '"'
+	{ 0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00 }, // '#'
+	{ 0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00 }, // '$'
+	{ 0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00 }, // '%'
+	{ 0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00 }, // '&'
+	{ 0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '''
+	{ 0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00 }, // '('
+	{ 0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00 }, // ')'
+	{ 0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00 }, // '*'
+	{ 0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00 }, // '+'
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ','
+	{ 0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00 }, // '-'
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // '.'
+	{ 0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00 }, // '/'
+	{ 0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00 }, // '0'
+	{ 0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00 }, // '1'
+	{ 0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00 }, // '2'
+	{ 0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00 }, // '3'
+	{ 0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00 }, // '4'
+	{ 0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00 }, // '5'
+	{ 0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00 }, // '6'
+	{ 0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00 }, // '7'
+	{ 0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00 }, // '8'
+	{ 0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00 }, // '9'
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // ':'
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ';'
+	{ 0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00 }, // '<'
+	{ 0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00 }, // '='
+	{ 0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00 }, // '>'
+	{ 0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00 }, // '?'
+	{ 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00 }, // '@'
+	{ 0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00 }, // 'A'
+	{ 0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00 }, // 'B'
+	{ 0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00 }, // 'C'
+	{ 0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00 }, // 'D'
+	{ 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00 }, // 'E'
+	{ 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00 }, // 'F'
+	{ 0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00 }, // 'G'
+	{ 0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00 }, // 'H'
+	{ 0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'I'
+	{ 0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00 }, // 'J'
+	{ 0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00 }, // 'K'
+	{ 0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00 }, // 'L'
+	{ 0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00 }, // 'M'
+	{ 0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00 }, // 'N'
+	{ 0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00 }, // 'O'
+	{ 0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00 }, // 'P'
+	{ 0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00 }, // 'Q'
+	{ 0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00 }, // 'R'
+	{ 0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00 }, // 'S'
+	{ 0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'T'
+	{ 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00 }, // 'U'
+	{ 0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // 'V'
+	{ 0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00 }, // 'W'
+	{ 0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00 }, // 'X'
+	{ 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00 }, // 'Y'
+	{ 0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00 }, // 'Z'
+	{ 0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00 }, // '['
+	{ 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00 }, // '\'
+	{ 0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00 }, // ']'
+	{ 0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00 }, // '^'
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF }, // '_'
+	{ 0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '`'
+	{ 0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00 }, // 'a'
+	{ 0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00 }, // 'b'
+	{ 0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00 }, // 'c'
+	{ 0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00 }, // 'd'
+	{ 0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00 }, // 'e'
+	{ 0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00 }, // 'f'
+	{ 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // 'g'
+	{ 0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00 }, // 'h'
+	{ 0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'i'
+	{ 0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E }, // 'j'
+	{ 0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00 }, // 'k'
+	{ 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'l'
+	{ 0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00 }, // 'm'
+	{ 0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00 }, // 'n'
+	{ 0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00 }, // 'o'
+	{ 0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F }, // 'p'
+	{ 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78 }, // 'q'
+	{ 0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00 }, // 'r'
+	{ 0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00 }, // 's'
+	{ 0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00 }, // 't'
+	{ 0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00 }, // 'u'
+	{ 0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // 'v'
+	{ 0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00 }, // 'w'
+	{ 0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00 }, // 'x'
+	{ 0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // 'y'
+	{ 0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00 }, // 'z'
+	{ 0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00 }, // '{'
+	{ 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00 }, // '|'
+	{ 0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00 }, // '}'
+	{ 0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '~'
+};
+
+Osd::Osd() :
+		_canvas(nullptr), _width(0), _height(0), _numDirty(0), _empty(true) {
+}
+
+Osd::~Osd() {
+	free(_canvas);
+}
+
+void Osd::setSize(U32 width, U32 height) {
+	free(_canvas);
+	_canvas = nullptr;
+	_width = width;
+	_height = height;
+	_numDirty = 0;
+	_empty = true;
+}
+
+STATUS Osd::allocCanvas() {
+	if (_canvas)
+		return S_OK;
+
+	if (_width == 0 || _height == 0)
+		return S_FAIL;
+
+	_canvas = (U32 *)calloc(_width * _height, sizeof(U32));
+	if (_canvas == nullptr) {
+		log->printf("Osd::allocCanvas(): out of memory!\n");
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+bool Osd::clip(OsdRect *rect) {
+	S32 x0 = MAX(rect->x, 0);
+	S32 y0 = MAX(rect->y, 0);
+	S32 x1 = MIN(rect->x + rect->width, (S32)_width);
+	S32 y1 = MIN(rect->y + rect->height, (S32)_height);
+
+	if (x1 <= x0 || y1 <= y0)
+		return false;
+
+	rect->x = x0;
+	rect->y = y0;
+	rect->width = x1 - x0;
+	rect->height = y1 - y0;
+
+	return true;
+}
+
+void Osd::unionRect(OsdRect *dst, const OsdRect *rect) {
+	if (rect->width <= 0 || rect->height <= 0)
+		return;
+	if (dst->width <= 0 || dst->height <= 0) {
+		*dst = *rect;
+		return;
+	}
+
+	S32 x1 = MAX(dst->x + dst->width, rect->x + rect->width);
+	S32 y1 = MAX(dst->y + dst->height, rect->y + rect->height);
+	dst->x = MIN(dst->x, rect->x);
+	dst->y = MIN(dst->y, rect->y);
+	dst->width = x1 - dst->x;
+	dst->height = y1 - dst->y;
+}
+
+void Osd::addDirty(const OsdRect *rect) {
+	// touching or overlapping areas are merged, so typical updates stay one rect
+	for (U32 i = 0; i < _numDirty; i++) {
+		OsdRect *dirty = &_dirty[i];
+		if (rect->x <= dirty->x + dirty->width && dirty->x <= rect->x + rect->width &&
+		    rect->y <= dirty->y + dirty->height && dirty->y <= rect->y + rect->height) {
+			unionRect(dirty, rect);
+			return;
+		}
+	}
+
+	if (_numDirty < OSD_MAX_DIRTY_RECTS) {
+		_dirty[_numDirty++] = *rect;
+	} else {
+		unionRect(&_dirty[_numDirty - 1], rect);
+	}
+}
+
+U32 Osd::getDirtyRects(OsdRect *rects) {
+	memcpy(rects, _dirty, _numDirty * sizeof(OsdRect));
+
+	return _numDirty;
+}
+
+void Osd::clear() {
+	OsdRect rect = { 0, 0, (S32)_width, (S32)_height };
+
+	if (_empty)
+		return;
+
+	if (_canvas)
+		memset(_canvas, 0, _width * _height * sizeof(U32));
+	_numDirty = 0;
+	addDirty(&rect);
+	_empty = true;
+}
+
+STATUS Osd::fillRect(S32 x, S32 y, S32 width, S32 height, U32 color) {
+	OsdRect rect = { x, y, width, height };
+
+	if (!clip(&rect))
+		return S_OK;
+	if (allocCanvas() == S_FAIL)
+		return S_FAIL;
+
+	for (S32 row = 0; row < rect.height; row++) {
+		U32 *dst = _canvas + (rect.y + row) * _width + rect.x;
+		for (S32 i = 0; i < rect.width; i++) {
+			dst[i] = color;
+		}
+	}
+
+	addDirty(&rect);
+	_empty = false;
+
+	return S_OK;
+}
+
+STATUS Osd::blit(S32 x, S32 y, S32 width, S32 height, const U32 *pixels, U32 stride) {
+	OsdRect rect = { x, y, width, height };
+
+	if (pixels == nullptr)
+		return S_FAIL;
+	if (!clip(&rect))
+		return S_OK;
+	if (allocCanvas() == S_FAIL)
+		return S_FAIL;
+
+	// stride is in pixels
+	for (S32 row = 0; row < rect.height; row++) {
+		memcpy(_canvas + (rect.y + row) * _width + rect.x,
+		       pixels + (rect.y - y + row) * stride + (rect.x - x), rect.width * sizeof(U32));
+	}
+
+	addDirty(&rect);
+	_empty = false;
+
+	return S_OK;
+}
+
+STATUS Osd::drawText(S32 x, S32 y, const char *text, U32 color, U32 scale) {
+	S32 penX = x, penY = y;
+	OsdRect bounds = {};
+
+	if (text == nullptr || scale == 0)
+		return S_FAIL;
+	if (allocCanvas() == S_FAIL)
+		return S_FAIL;
+
+	for (; *text; text++) {
+		if (*text == '\n') {
+			penX = x;
+			penY += OSD_FONT_HEIGHT * scale;
+			continue;
+		}
+
+		U8 c = (U8)*text;
+		const U8 *glyph = osdFont[(c >= 0x20 && c <= 0x7e) ? c - 0x20 : '?' - 0x20];
+		OsdRect rect = { penX, penY, (S32)(OSD_FONT_WIDTH * scale), (S32)(OSD_FONT_HEIGHT * scale) };
+		penX += OSD_FONT_WIDTH * scale;
+		if (!clip(&rect))
+			continue;
+
+		for (S32 row = rect.y; row < rect.y + rect.height; row++) {
+			U8 bits = glyph[(row - penY) / scale];
+			U32 *dst = _canvas + row * _width;
+			for (S32 col = rect.x; col < rect.x + rect.width; col++) {
+				if (bits & (1 << ((col - (penX - OSD_FONT_WIDTH * scale)) / scale)))
+					dst[col] = color;
+			}
+		}
+		unionRect(&bounds, &rect);
+	}
+
+	if (bounds.width > 0) {
+		addDirty(&bounds);
+		_empty = false;
+	}
+
+	return S_OK;
+}
+
+void Osd::copyRect(const OsdRect *rect, U8 *dst, U32 dstStride) {
+	OsdRect area = *rect;
+
+	if (!clip(&area))
+		return;
+
+	for (S32 row = area.y; row < area.y + area.height; row++) {
+		U8 *line = dst + row * dstStride + area.x * sizeof(U32);
+		if (_canvas)
+			memcpy(line, _canvas + row * _width + area.x, area.width * sizeof(U32));
+		else
+			memset(line, 0, area.width * sizeof(U32));
+	}
+}
+
+} // namespace
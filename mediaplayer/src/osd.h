@@ -0,0 +1,87 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef OSD_H
+#define OSD_H
+
+#include "basetypes.h"
+
+namespace MediaPLayer {
+
+#define OSD_MAX_DIRTY_RECTS  8
+#define OSD_FONT_WIDTH       8
+#define OSD_FONT_HEIGHT      8
+
+typedef struct {
+	S32     x, y;
+	S32     width, height;
+} OsdRect;
+
+// ARGB8888 overlay canvas drawn by cpu. Nothing is allocated until first draw.
+// Changed areas are kept as dirty rectangles, so display copies only those
+// to scanout buffers and leaves its plane untouched while nothing changes.
+// Not thread safe, draw from thread calling display flip().
+class Osd {
+private:
+
+	U32                         *_canvas;
+	U32                         _width, _height;
+	OsdRect                     _dirty[OSD_MAX_DIRTY_RECTS];
+	U32                         _numDirty;
+	bool                        _empty;
+
+public:
+
+	Osd();
+	~Osd();
+
+	// drops canvas, display calls it on mode change
+	void setSize(U32 width, U32 height);
+	U32 getWidth() { return _width; }
+	U32 getHeight() { return _height; }
+
+	// everything transparent, display may turn its plane off then
+	void clear();
+	// colors are 0xAARRGGBB, pixels are replaced, not blended
+	STATUS fillRect(S32 x, S32 y, S32 width, S32 height, U32 color);
+	STATUS blit(S32 x, S32 y, S32 width, S32 height, const U32 *pixels, U32 stride);
+	// 8x8 font scaled by scale, only glyph pixels are drawn
+	STATUS drawText(S32 x, S32 y, const char *text, U32 color, U32 scale);
+
+	bool isDirty() { return _numDirty > 0; }
+	// true after clear() until something is drawn
+	bool isEmpty() { return _empty; }
+	U32 getDirtyRects(OsdRect *rects);
+	void clearDirty() { _numDirty = 0; }
+	void copyRect(const OsdRect *rect, U8 *dst, U32 dstStride);
+
+	static void unionRect(OsdRect *dst, const OsdRect *rect);
+
+private:
+
+	bool clip(OsdRect *rect);
+	STATUS allocCanvas();
+	void addDirty(const OsdRect *rect);
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,452 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "basetypes.h"
+#include "logs.h"
+#include "pipeline.h"
+
+namespace MediaPLayer {
+
+Pipeline::Pipeline() :
+		_demuxer(nullptr), _decoderVideo(nullptr), _display(nullptr), _scheduler(nullptr),
+		_benchmark(nullptr), _hwAccel(false), _packetQueueDepth(0), _frameQueueDepth(0),
+		_packetSlots(nullptr), _frameSlots(nullptr),
+		_abort(false), _failed(false), _initialized(false) {
+}
+
+Pipeline::~Pipeline() {
+	deinit();
+}
+
+STATUS Pipeline::init(Demuxer *demuxer, DecoderVideo *decoderVideo, Display *display, Scheduler *scheduler,
+                      Benchmark *benchmark, bool hwAccel, U32 packetQueueDepth, U32 frameQueueDepth) {
+	U32 numInputBuffers;
+
+	if (_initialized) {
+		log->printf("Pipeline::init(): already initialized!\n");
+		return S_FAIL;
+	}
+
+	if (demuxer == nullptr || decoderVideo == nullptr || display == nullptr ||
+	    benchmark == nullptr || packetQueueDepth == 0 || frameQueueDepth == 0) {
+		log->printf("Pipeline::init(): wrong arguments!\n");
+		return S_FAIL;
+	}
+
+	_demuxer = demuxer;
+	_decoderVideo = decoderVideo;
+	_display = display;
+	_scheduler = scheduler; // null when running unthrottled
+	_benchmark = benchmark;
+	_hwAccel = hwAccel;
+
+	// packets demuxed straight into decoder ring must not outnumber its buffers
+	numInputBuffers = decoderVideo->getNumDemuxerBuffers();
+	if (numInputBuffers > 0 && packetQueueDepth > numInputBuffers) {
+		log->printf("Pipeline::init(): packet queue depth limited to %u decoder input buffers\n", numInputBuffers);
+		packetQueueDepth = numInputBuffers;
+	}
+	_packetQueueDepth = packetQueueDepth;
+	_frameQueueDepth = frameQueueDepth;
+
+	_packetSlots = (PacketSlot *)calloc(_packetQueueDepth, sizeof(PacketSlot));
+	_frameSlots = (FrameSlot *)calloc(_frameQueueDepth, sizeof(FrameSlot));
+	if (_packetSlots == nullptr || _frameSlots == nullptr) {
+		log->printf("Pipeline::init(): out of memory!\n");
+		goto fail;
+	}
+
+	if (_packetQueue.init(_packetQueueDepth) != S_OK ||
+	    _packetFreeQueue.init(_packetQueueDepth) != S_OK ||
+	    _frameQueue.init(_frameQueueDepth) != S_OK ||
+	    _frameFreeQueue.init(_frameQueueDepth) != S_OK) {
+		log->printf("Pipeline::init(): failed create queues!\n");
+		goto fail;
+	}
+
+	for (U32 i = 0; i < _packetQueueDepth; i++) {
+		_packetFreeQueue.tryPush(&_packetSlots[i]);
+	}
+	for (U32 i = 0; i < _frameQueueDepth; i++) {
+		_frameFreeQueue.tryPush(&_frameSlots[i]);
+	}
+
+	_abort = false;
+	_failed = false;
+	_initialized = true;
+
+	return S_OK;
+
+fail:
+	_initialized = true;
+	deinit();
+
+	return S_FAIL;
+}
+
+STATUS Pipeline::deinit() {
+	if (!_initialized)
+		return S_OK;
+
+	if (_packetSlots) {
+		for (U32 i = 0; i < _packetQueueDepth; i++) {
+			_demuxer->unrefFrame(&_packetSlots[i].frame);
+		}
+		free(_packetSlots);
+		_packetSlots = nullptr;
+	}
+
+	if (_frameSlots) {
+		for (U32 i = 0; i < _frameQueueDepth; i++) {
+			free(_frameSlots[i].buffer);
+		}
+		free(_frameSlots);
+		_frameSlots = nullptr;
+	}
+
+	_packetQueue.deinit();
+	_packetFreeQueue.deinit();
+	_frameQueue.deinit();
+	_frameFreeQueue.deinit();
+
+	_initialized = false;
+
+	return S_OK;
+}
+
+STATUS Pipeline::run() {
+	if (!_initialized) {
+		log->printf("Pipeline::run(): not initialized!\n");
+		return S_FAIL;
+	}
+
+	// display is driven from present thread, it comes back here for deinit
+	if (_display->detachThread() == S_FAIL) {
+		log->printf("Pipeline::run(): failed detach display!\n");
+		return S_FAIL;
+	}
+
+	if (pthread_create(&_presentThread, nullptr, presentThreadFunc, this) != 0) {
+		log->printf("Pipeline::run(): failed create present thread!\n");
+		_display->attachThread();
+		return S_FAIL;
+	}
+	if (pthread_create(&_decodeThread, nullptr, decodeThreadFunc, this) != 0) {
+		log->printf("Pipeline::run(): failed create decode thread!\n");
+		abort();
+		pthread_join(_presentThread, nullptr);
+		_display->attachThread();
+		return S_FAIL;
+	}
+	if (pthread_create(&_demuxThread, nullptr, demuxThreadFunc, this) != 0) {
+		log->printf("Pipeline::run(): failed create demux thread!\n");
+		abort();
+		pthread_join(_decodeThread, nullptr);
+		pthread_join(_presentThread, nullptr);
+		_display->attachThread();
+		return S_FAIL;
+	}
+
+	pthread_join(_demuxThread, nullptr);
+	pthread_join(_decodeThread, nullptr);
+	pthread_join(_presentThread, nullptr);
+
+	if (_display->attachThread() == S_FAIL)
+		_failed = true;
+
+	return _failed ? S_FAIL : S_OK;
+}
+
+void *Pipeline::demuxThreadFunc(void *arg) {
+	static_cast<Pipeline *>(arg)->demuxLoop();
+	return nullptr;
+}
+
+void *Pipeline::decodeThreadFunc(void *arg) {
+	static_cast<Pipeline *>(arg)->decodeLoop();
+	return nullptr;
+}
+
+void *Pipeline::presentThreadFunc(void *arg) {
+	static_cast<Pipeline *>(arg)->presentLoop();
+	return nullptr;
+}
+
+void Pipeline::abort() {
+	_abort = true;
+	_packetQueue.close();
+	_packetFreeQueue.close();
+	_frameQueue.close();
+	_frameFreeQueue.close();
+}
+
+void Pipeline::demuxLoop() {
+	PacketSlot *slot = nullptr;
+
+	while (!_abort) {
+		if (slot == nullptr && !_packetFreeQueue.pop(slot))
+			break;
+
+		StreamFrame inputFrame{};
+		// external buffer comes from decoder ring, queue depth keeps it free
+		_decoderVideo->getDemuxerBuffer(&inputFrame);
+
+		S64 stageTime = Benchmark::getTime();
+		if (_demuxer->readNextFrame(&inputFrame) != S_OK) {
+			slot->endOfStream = true;
+			_packetQueue.push(slot);
+			break;
+		}
+		_benchmark->addSample(BENCHMARK_STAGE_DEMUX, Benchmark::getTime() - stageTime);
+
+		if (inputFrame.videoFrame.data == nullptr)
+			continue;
+
+		_decoderVideo->commitDemuxerBuffer(&inputFrame);
+
+		if (holdPacket(slot, &inputFrame) != S_OK) {
+			_failed = true;
+			abort();
+			break;
+		}
+
+		if (!_packetQueue.push(slot))
+			break;
+		slot = nullptr;
+	}
+}
+
+void Pipeline::decodeLoop() {
+	PacketSlot *slot;
+
+	while (!_abort && _packetQueue.pop(slot)) {
+		if (slot->endOfStream) {
+			FrameSlot *frameSlot;
+			bool frameReady;
+			// flush frames held back by decoder before signalling end
+			while (_decoderVideo->drain(frameReady) == S_OK && frameReady) {
+				if (outputFrames() != S_OK)
+					return;
+			}
+			if (_frameFreeQueue.pop(frameSlot)) {
+				frameSlot->endOfStream = true;
+				_frameQueue.push(frameSlot);
+			}
+			break;
+		}
+
+		StreamFrame inputFrame = slot->frame;
+
+		bool frameReady = false;
+		S64 stageTime = Benchmark::getTime();
+		STATUS status = _decoderVideo->decodeFrame(frameReady, &inputFrame);
+		_benchmark->addSample(BENCHMARK_STAGE_DECODE, Benchmark::getTime() - stageTime);
+		_demuxer->unrefFrame(&slot->frame);
+		_packetFreeQueue.push(slot);
+		if (status != S_OK) {
+			log->printf("Pipeline::decodeLoop(): Failed decode frame!\n");
+			_failed = true;
+			abort();
+			break;
+		}
+
+		if (frameReady && outputFrames() != S_OK)
+			break;
+	}
+}
+
+STATUS Pipeline::outputFrames() {
+	do {
+		VideoFrame outputFrame{};
+		FrameSlot *frameSlot;
+
+		S64 stageTime = Benchmark::getTime();
+		if (_decoderVideo->getVideoStreamOutputFrame(_demuxer, &outputFrame) != S_OK) {
+			log->printf("Pipeline::outputFrames(): Failed get decoded frame!\n");
+			_failed = true;
+			abort();
+			return S_FAIL;
+		}
+		_benchmark->addSample(BENCHMARK_STAGE_OUTPUT_FRAME, Benchmark::getTime() - stageTime);
+		if (!_frameFreeQueue.pop(frameSlot))
+			return S_FAIL;
+		if (holdFrame(frameSlot, &outputFrame) != S_OK) {
+			_failed = true;
+			abort();
+			return S_FAIL;
+		}
+		if (!_frameQueue.push(frameSlot))
+			return S_FAIL;
+	} while (_decoderVideo->hasPendingFrame());
+
+	return S_OK;
+}
+
+void Pipeline::presentLoop() {
+	FrameSlot *slot;
+
+	if (_display->attachThread() == S_FAIL) {
+		log->printf("Pipeline::presentLoop(): Failed attach display!\n");
+		_failed = true;
+		abort();
+		return;
+	}
+
+	while (!_abort && _frameQueue.pop(slot)) {
+		if (slot->endOfStream)
+			break;
+
+		S64 pts = slot->frame.pts;
+		bool skip = false;
+
+		S64 stageTime = Benchmark::getTime();
+		STATUS status = _display->putImage(&slot->frame, false);
+		_benchmark->addSample(BENCHMARK_STAGE_PUT_IMAGE, Benchmark::getTime() - stageTime);
+		releaseFrame(slot);
+		_frameFreeQueue.push(slot);
+		if (status == S_FAIL) {
+			log->printf("Pipeline::presentLoop(): Failed put image!\n");
+			_failed = true;
+			abort();
+			break;
+		}
+
+		if (_scheduler) {
+			_scheduler->waitForFrame(pts, skip);
+		}
+
+		stageTime = Benchmark::getTime();
+		if (_display->flip(skip) == S_FAIL) {
+			log->printf("Pipeline::presentLoop(): Failed flip display!\n");
+			_failed = true;
+			abort();
+			break;
+		}
+		_benchmark->addSample(BENCHMARK_STAGE_FLIP, Benchmark::getTime() - stageTime);
+		_benchmark->frameDone();
+
+		if (_scheduler) {
+			_scheduler->framePresented(skip);
+		}
+	}
+
+	_display->detachThread();
+
+	// unblock producers waiting for free slots
+	abort();
+}
+
+STATUS Pipeline::holdPacket(PacketSlot *slot, StreamFrame *frame) {
+	slot->frame = *frame;
+	slot->endOfStream = false;
+
+	if (frame->videoFrame.externalDataSize > 0) {
+		// payload lives in decoder input ring
+		slot->frame.priv = nullptr;
+		return S_OK;
+	}
+
+	// keep demuxer packet alive past next readNextFrame()
+	if (_demuxer->refFrame(&slot->frame) != S_OK) {
+		log->printf("Pipeline::holdPacket(): Failed reference packet!\n");
+		slot->frame.priv = nullptr;
+		return S_FAIL;
+	}
+
+	return S_OK;
+}
+
+STATUS Pipeline::holdFrame(FrameSlot *slot, VideoFrame *frame) {
+	slot->frame = *frame;
+	slot->endOfStream = false;
+
+	if (_hwAccel) {
+		// keep decoder from reusing buffer until display takes it over
+		DisplayVideoBuffer *db = (DisplayVideoBuffer *)frame->data[0];
+		db->locked = true;
+		return S_OK;
+	}
+
+	if (frame->displayBuffer) {
+		// software decoder rendered into display buffer, same as hardware one
+		DisplayVideoBuffer *db = (DisplayVideoBuffer *)frame->displayBuffer;
+		db->locked = true;
+		return S_OK;
+	}
+
+	// software decoder output is overwritten by next decodeFrame()
+	U32 planeHeight[4] = {};
+	switch (frame->pixelfmt) {
+	case FMT_YUV420P:
+		planeHeight[0] = frame->height;
+		planeHeight[1] = planeHeight[2] = (frame->height + 1) / 2;
+		break;
+	case FMT_NV12:
+		planeHeight[0] = frame->height;
+		planeHeight[1] = (frame->height + 1) / 2;
+		break;
+	case FMT_RGB24:
+	case FMT_ARGB:
+		planeHeight[0] = frame->height;
+		break;
+	default:
+		log->printf("Pipeline::holdFrame(): Not supported format!\n");
+		return S_FAIL;
+	}
+
+	U32 size = 0;
+	for (int i = 0; i < 4; i++) {
+		size += frame->stride[i] * planeHeight[i];
+	}
+	if (slot->bufferSize < size) {
+		free(slot->buffer);
+		slot->buffer = (U8 *)malloc(size);
+		if (slot->buffer == nullptr) {
+			log->printf("Pipeline::holdFrame(): out of memory!\n");
+			slot->bufferSize = 0;
+			return S_FAIL;
+		}
+		slot->bufferSize = size;
+	}
+
+	U8 *dst = slot->buffer;
+	for (int i = 0; i < 4; i++) {
+		if (planeHeight[i] == 0 || frame->data[i] == nullptr) {
+			slot->frame.data[i] = nullptr;
+			continue;
+		}
+		memcpy(dst, frame->data[i], frame->stride[i] * planeHeight[i]);
+		slot->frame.data[i] = dst;
+		dst += frame->stride[i] * planeHeight[i];
+	}
+
+	return S_OK;
+}
+
+void Pipeline::releaseFrame(FrameSlot *slot) {
+	// display sets its own lock on hardware buffers in putImage()
+	slot->frame = {};
+}
+
+} // namespace
@@ -0,0 +1,107 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <atomic>
+
+#include "basetypes.h"
+#include "demuxer_base.h"
+#include "decoder_video_base.h"
+#include "display_base.h"
+#include "spsc_queue.h"
+#include "scheduler.h"
+#include "benchmark.h"
+
+namespace MediaPLayer {
+
+#define PIPELINE_DEFAULT_PACKET_QUEUE_DEPTH   16
+#define PIPELINE_DEFAULT_FRAME_QUEUE_DEPTH    2
+#define PIPELINE_MAX_QUEUE_DEPTH              256
+
+class Pipeline {
+private:
+
+	typedef struct {
+		StreamFrame     frame;
+		bool            endOfStream;
+	} PacketSlot;
+
+	typedef struct {
+		VideoFrame      frame;
+		U8              *buffer;
+		U32             bufferSize;
+		bool            endOfStream;
+	} FrameSlot;
+
+	Demuxer                     *_demuxer;
+	DecoderVideo                *_decoderVideo;
+	Display                     *_display;
+	Scheduler                   *_scheduler;
+	Benchmark                   *_benchmark;
+	bool                        _hwAccel;
+
+	U32                         _packetQueueDepth;
+	U32                         _frameQueueDepth;
+	PacketSlot                  *_packetSlots;
+	FrameSlot                   *_frameSlots;
+	SpscQueue<PacketSlot *>     _packetQueue;
+	SpscQueue<PacketSlot *>     _packetFreeQueue;
+	SpscQueue<FrameSlot *>      _frameQueue;
+	SpscQueue<FrameSlot *>      _frameFreeQueue;
+
+	pthread_t                   _demuxThread;
+	pthread_t                   _decodeThread;
+	pthread_t                   _presentThread;
+	std::atomic<bool>           _abort;
+	std::atomic<bool>           _failed;
+	bool                        _initialized;
+
+public:
+
+	Pipeline();
+	~Pipeline();
+
+	STATUS init(Demuxer *demuxer, DecoderVideo *decoderVideo, Display *display, Scheduler *scheduler,
+	            Benchmark *benchmark, bool hwAccel, U32 packetQueueDepth, U32 frameQueueDepth);
+	STATUS deinit();
+	STATUS run();
+
+private:
+
+	static void *demuxThreadFunc(void *arg);
+	static void *decodeThreadFunc(void *arg);
+	static void *presentThreadFunc(void *arg);
+	void demuxLoop();
+	void decodeLoop();
+	STATUS outputFrames();
+	void presentLoop();
+	void abort();
+	STATUS holdPacket(PacketSlot *slot, StreamFrame *frame);
+	STATUS holdFrame(FrameSlot *slot, VideoFrame *frame);
+	void releaseFrame(FrameSlot *slot);
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,285 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "basetypes.h"
+#include "scheduler.h"
+#include "display_base.h"
+#include "logs.h"
+
+namespace MediaPLayer {
+
+Scheduler::Scheduler() :
+		_display(nullptr), _vblankMode(false), _vblankPeriod(0), _baseVblank(0),
+		_targetVblank(0), _pendingVblank(0), _pendingCheck(false),
+		_windowStart(0), _windowLength(0), _windowFrames(0), _windowError(0),
+		_frameDuration(1000000 / SCHEDULER_DEFAULT_FPS), _baseTime(0), _basePts(0),
+		_lastPts(0), _deadline(0), _started(false) {
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+void Scheduler::init(float fps, Display *display) {
+	DisplayVblank vblank;
+
+	if (!(fps > 0))
+		fps = SCHEDULER_DEFAULT_FPS;
+
+	_frameDuration = (S64)(1000000.0 / fps);
+
+	_display = display;
+	_vblankMode = display && display->getVblank(&vblank) == S_OK && vblank.refresh > 0;
+	if (_vblankMode) {
+		_vblankPeriod = 1000000.0 / vblank.refresh;
+		_windowLength = (U32)(vblank.refresh + 0.5);
+		logCadence(fps);
+	}
+
+	reset();
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+void Scheduler::reset() {
+	_baseTime = 0;
+	_basePts = 0;
+	_lastPts = 0;
+	_deadline = 0;
+	_started = false;
+	_baseVblank = 0;
+	_targetVblank = 0;
+	_pendingCheck = false;
+	_windowFrames = 0;
+	_windowError = 0;
+}
+
+S64 Scheduler::getMonotonicTime() {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (S64)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+void Scheduler::sleepUntil(S64 time) {
+	struct timespec t;
+
+	t.tv_sec = time / 1000000;
+	t.tv_nsec = (time % 1000000) * 1000;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, nullptr) == EINTR);
+}
+
+FRAME_TIMING Scheduler::waitForFrame(S64 pts, bool &skip) {
+	if (_vblankMode)
+		return waitForFrameVblank(pts, skip);
+
+	FRAME_TIMING timing;
+	S64 now = getMonotonicTime();
+
+	if (pts == PTS_NONE) {
+		pts = _started ? _lastPts + _frameDuration : 0;
+	}
+
+	if (!_started) {
+		_baseTime = now;
+		_basePts = pts;
+		_started = true;
+	}
+
+	S64 deadline = _baseTime + (pts - _basePts);
+	if (ABS(deadline - now) > SCHEDULER_RESYNC_THRESHOLD) {
+		// timestamp discontinuity or long stall, restart clock from this frame
+		_baseTime = now;
+		_basePts = pts;
+		deadline = now;
+		_stats.resyncs++;
+	}
+	_lastPts = pts;
+	_deadline = deadline;
+
+	skip = false;
+	if (now < deadline - SCHEDULER_TOLERANCE) {
+		timing = FRAME_TIMING_EARLY;
+		_stats.framesEarly++;
+		sleepUntil(deadline);
+	} else if (now <= deadline + SCHEDULER_TOLERANCE) {
+		timing = FRAME_TIMING_ON_TIME;
+		_stats.framesOnTime++;
+		if (now < deadline)
+			sleepUntil(deadline);
+	} else {
+		timing = FRAME_TIMING_LATE;
+		_stats.framesLate++;
+		// missed whole frame slot, let display drop it
+		skip = now > deadline + _frameDuration;
+	}
+
+	return timing;
+}
+
+FRAME_TIMING Scheduler::waitForFrameVblank(S64 pts, bool &skip) {
+	FRAME_TIMING timing;
+	DisplayVblank vblank;
+
+	if (_display->getVblank(&vblank) == S_FAIL) {
+		// counters are gone, continue with clock pacing
+		log->printf("Scheduler::waitForFrameVblank(): Failed get vblank, using clock pacing\n");
+		_vblankMode = false;
+		reset();
+		return waitForFrame(pts, skip);
+	}
+
+	if (pts == PTS_NONE) {
+		pts = _started ? _lastPts + _frameDuration : 0;
+	}
+
+	if (!_started) {
+		_basePts = pts;
+		_baseVblank = vblank.sequence + SCHEDULER_VBLANK_LEAD;
+		_windowStart = _baseVblank;
+		_started = true;
+	}
+
+	// frame goes to vblank nearest to its pts, which gives the cadence
+	U32 target = _baseVblank + (S32)floor((pts - _basePts) / _vblankPeriod + 0.5 + SCHEDULER_CADENCE_BIAS);
+	S32 ahead = (S32)(target - vblank.sequence);
+	if (ABS(ahead) * _vblankPeriod > SCHEDULER_RESYNC_THRESHOLD) {
+		// timestamp discontinuity or long stall, restart cadence from this frame
+		_baseVblank = vblank.sequence + SCHEDULER_VBLANK_LEAD;
+		_basePts = pts;
+		target = _baseVblank;
+		ahead = SCHEDULER_VBLANK_LEAD;
+		_stats.resyncs++;
+	}
+	_lastPts = pts;
+
+	skip = false;
+	if (ahead >= 1) {
+		// waiting for planned vblank is the normal case, frame is on time
+		timing = FRAME_TIMING_ON_TIME;
+		_stats.framesOnTime++;
+		// flip issued after vblank preceding target is latched at target
+		if (ahead > 1)
+			_display->waitForVblank(target - 1, &vblank);
+	} else {
+		timing = FRAME_TIMING_LATE;
+		_stats.framesLate++;
+		// missed whole frame slot, let display drop it
+		skip = -ahead * _vblankPeriod >= _frameDuration;
+		target = vblank.sequence + 1;
+	}
+	_targetVblank = target;
+	_deadline = vblank.time + (S64)((S32)(target - vblank.sequence) * _vblankPeriod);
+
+	return timing;
+}
+
+void Scheduler::checkCadence(U32 presented, U32 target) {
+	S32 error = ABS((S32)(presented - target));
+	S64 drift = (S64)((S32)(presented - target) * _vblankPeriod);
+
+	_stats.lastDrift = drift;
+	_stats.sumDrift += ABS(drift);
+	if (ABS(drift) > _stats.maxDrift)
+		_stats.maxDrift = ABS(drift);
+
+	_windowFrames++;
+	_windowError += error;
+	if ((S32)(presented - _windowStart) < (S32)_windowLength)
+		return;
+
+	_stats.cadenceSeconds++;
+	_stats.cadenceError += _windowError;
+	if (_windowError > _stats.maxCadenceError)
+		_stats.maxCadenceError = _windowError;
+	if (_windowError > 0) {
+		_stats.cadenceErrorSeconds++;
+		log->printf("Scheduler: second %llu, %u frames, cadence error %u vblanks\n",
+		            _stats.cadenceSeconds, _windowFrames, _windowError);
+	}
+
+	_windowStart += _windowLength;
+	if ((S32)(presented - _windowStart) >= (S32)_windowLength)
+		_windowStart = presented;
+	_windowFrames = 0;
+	_windowError = 0;
+}
+
+void Scheduler::logCadence(float fps) {
+	char pattern[SCHEDULER_MAX_CADENCE * 4 + 1];
+	double ratio = _frameDuration / _vblankPeriod;
+	S64 previous = 0;
+	int length = 0;
+
+	pattern[0] = 0;
+	for (int i = 1; i <= SCHEDULER_MAX_CADENCE && length < (int)sizeof(pattern); i++) {
+		double position = i * ratio;
+		S64 vblank = (S64)floor(position + 0.5 + SCHEDULER_CADENCE_BIAS);
+		length += snprintf(pattern + length, sizeof(pattern) - length, i > 1 ? ":%lld" : "%lld", vblank - previous);
+		previous = vblank;
+		// pattern repeats once frames and vblanks line up again
+		if (fabs(position - floor(position + 0.5)) < SCHEDULER_CADENCE_BIAS)
+			break;
+	}
+
+	log->printf("Scheduler: %.3f fps on %.3f Hz, %.3f vblanks per frame, cadence %s\n",
+	            fps, 1000000.0 / _vblankPeriod, ratio, pattern);
+}
+
+void Scheduler::framePresented(bool skipped) {
+	if (_vblankMode) {
+		DisplayVblank vblank;
+		// flip of this frame waited for previous one, so its vblank is known now
+		if (_pendingCheck && _display->getVblank(&vblank) == S_OK)
+			checkCadence(vblank.flipSequence, _pendingVblank);
+		_pendingCheck = !skipped;
+		_pendingVblank = _targetVblank;
+	}
+
+	if (skipped) {
+		_stats.framesDropped++;
+		return;
+	}
+
+	if (_vblankMode) {
+		// drift is known once flip completes
+		_stats.framesPresented++;
+		return;
+	}
+
+	S64 drift = getMonotonicTime() - _deadline;
+
+	_stats.framesPresented++;
+	_stats.lastDrift = drift;
+	_stats.sumDrift += ABS(drift);
+	if (ABS(drift) > _stats.maxDrift)
+		_stats.maxDrift = ABS(drift);
+}
+
+void Scheduler::getStats(SchedulerStats *stats) {
+	*stats = _stats;
+}
+
+} // namespace
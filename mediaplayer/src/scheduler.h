@@ -0,0 +1,113 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "basetypes.h"
+#include "avtypes.h"
+
+namespace MediaPLayer {
+
+#define SCHEDULER_DEFAULT_FPS        25
+#define SCHEDULER_TOLERANCE          2000    // us, window around deadline counted as on time
+#define SCHEDULER_RESYNC_THRESHOLD   1000000 // us, rebase clock when off by more
+#define SCHEDULER_VBLANK_LEAD        2       // vblanks between first frame and its presentation
+#define SCHEDULER_CADENCE_BIAS       0.01    // vblank, keeps rounding of half vblank offsets stable
+#define SCHEDULER_MAX_CADENCE        12      // frames of cadence pattern shown
+
+typedef enum _FRAME_TIMING {
+	FRAME_TIMING_EARLY,
+	FRAME_TIMING_ON_TIME,
+	FRAME_TIMING_LATE,
+} FRAME_TIMING;
+
+typedef struct {
+	U64 framesEarly;
+	U64 framesOnTime;
+	U64 framesLate;
+	U64 framesPresented;
+	U64 framesDropped;
+	U64 resyncs;
+	S64 lastDrift; // us, presentation time minus deadline
+	S64 maxDrift;  // us, largest absolute drift
+	S64 sumDrift;  // us, sum of absolute drift of presented frames
+	U64 cadenceSeconds;      // seconds of vblank paced playback
+	U64 cadenceErrorSeconds; // seconds where some frame missed its vblank
+	U64 cadenceError;        // vblanks, sum of distances from planned vblanks
+	U64 maxCadenceError;     // vblanks, worst one second
+} SchedulerStats;
+
+class Display;
+
+// Paces frames against absolute deadlines on CLOCK_MONOTONIC.
+// Deadline of frame is clock base plus its pts distance from first frame,
+// frames without pts are placed one frame duration after previous one.
+// With display providing vblank counters deadlines are vblank sequence
+// numbers instead, which gives steady cadence like 2:3:2:3:2 for 25 fps
+// on 60 Hz, and each second is checked against planned vblanks.
+class Scheduler {
+private:
+
+	Display         *_display;
+	bool            _vblankMode;
+	double          _vblankPeriod;    // us
+	U32             _baseVblank;
+	U32             _targetVblank;
+	U32             _pendingVblank;   // target of presented frame not yet checked
+	bool            _pendingCheck;
+	U32             _windowStart;
+	U32             _windowLength;    // vblanks in one second
+	U32             _windowFrames;
+	U32             _windowError;
+
+	S64             _frameDuration;
+	S64             _baseTime;
+	S64             _basePts;
+	S64             _lastPts;
+	S64             _deadline;
+	bool            _started;
+	SchedulerStats  _stats;
+
+public:
+
+	Scheduler();
+
+	void init(float fps, Display *display = nullptr);
+	void reset();
+	FRAME_TIMING waitForFrame(S64 pts, bool &skip);
+	void framePresented(bool skipped);
+	void getStats(SchedulerStats *stats);
+	S64 getFrameDuration() { return _frameDuration; }
+
+	static S64 getMonotonicTime();
+
+private:
+
+	void sleepUntil(S64 time);
+	FRAME_TIMING waitForFrameVblank(S64 pts, bool &skip);
+	void checkCadence(U32 presented, U32 target);
+	void logCadence(float fps);
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdlib.h>
+#include <semaphore.h>
+#include <errno.h>
+#include <atomic>
+
+#include "basetypes.h"
+
+namespace MediaPLayer {
+
+// Bounded single producer / single consumer ring.
+// Head and tail are only advanced with atomics, semaphores are used
+// just to park a thread when the ring is full or empty.
+template <typename T>
+class SpscQueue {
+private:
+
+	T                   *_items;
+	U32                  _capacity;
+	std::atomic<U32>     _head;
+	std::atomic<U32>     _tail;
+	std::atomic<bool>    _closed;
+	sem_t                _filled;
+	sem_t                _free;
+	bool                 _initialized;
+
+public:
+
+	SpscQueue() :
+			_items(nullptr), _capacity(0), _head(0), _tail(0),
+			_closed(false), _initialized(false) {}
+	~SpscQueue() { deinit(); }
+
+	STATUS init(U32 depth) {
+		if (_initialized || depth == 0)
+			return S_FAIL;
+
+		_items = new T[depth];
+		if (_items == nullptr)
+			return S_FAIL;
+
+		if (sem_init(&_filled, 0, 0) != 0) {
+			delete[] _items;
+			_items = nullptr;
+			return S_FAIL;
+		}
+		if (sem_init(&_free, 0, depth) != 0) {
+			sem_destroy(&_filled);
+			delete[] _items;
+			_items = nullptr;
+			return S_FAIL;
+		}
+
+		_capacity = depth;
+		_head = 0;
+		_tail = 0;
+		_closed = false;
+		_initialized = true;
+
+		return S_OK;
+	}
+
+	void deinit() {
+		if (!_initialized)
+			return;
+
+		sem_destroy(&_filled);
+		sem_destroy(&_free);
+		delete[] _items;
+		_items = nullptr;
+		_capacity = 0;
+		_initialized = false;
+	}
+
+	U32 getCapacity() { return _capacity; }
+
+	U32 getCount() {
+		return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+	}
+
+	// Wake up both sides, push() fails afterwards and pop() returns
+	// remaining items before failing.
+	void close() {
+		_closed.store(true, std::memory_order_release);
+		sem_post(&_filled);
+		sem_post(&_free);
+	}
+
+	bool isClosed() { return _closed.load(std::memory_order_acquire); }
+
+	bool tryPush(const T &item) {
+		if (isClosed() || sem_trywait(&_free) != 0)
+			return false;
+		put(item);
+		return true;
+	}
+
+	bool push(const T &item) {
+		while (sem_wait(&_free) != 0) {
+			if (errno != EINTR)
+				return false;
+		}
+		if (isClosed()) {
+			sem_post(&_free);
+			return false;
+		}
+		put(item);
+		return true;
+	}
+
+	bool tryPop(T &item) {
+		if (sem_trywait(&_filled) != 0)
+			return false;
+		return get(item);
+	}
+
+	bool pop(T &item) {
+		while (sem_wait(&_filled) != 0) {
+			if (errno != EINTR)
+				return false;
+		}
+		return get(item);
+	}
+
+private:
+
+	void put(const T &item) {
+		U32 tail = _tail.load(std::memory_order_relaxed);
+		_items[tail % _capacity] = item;
+		_tail.store(tail + 1, std::memory_order_release);
+		sem_post(&_filled);
+	}
+
+	bool get(T &item) {
+		U32 head = _head.load(std::memory_order_relaxed);
+		if (head == _tail.load(std::memory_order_acquire)) {
+			// woken up by close() on empty ring, keep it signalled
+			sem_post(&_filled);
+			return false;
+		}
+		item = _items[head % _capacity];
+		_head.store(head + 1, std::memory_order_release);
+		sem_post(&_free);
+		return true;
+	}
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <unistd.h>
+
+#include "workerpool.h"
+#include "logs.h"
+
+namespace MediaPLayer {
+
+WorkerPool::WorkerPool() :
+		_numThreads(1), _numWorkers(0), _job(nullptr), _arg(nullptr),
+		_numSlices(0), _nextSlice(0), _pendingSlices(0), _stop(false) {
+	pthread_mutex_init(&_lock, nullptr);
+	pthread_cond_init(&_start, nullptr);
+	pthread_cond_init(&_done, nullptr);
+}
+
+WorkerPool::~WorkerPool() {
+	deinit();
+	pthread_cond_destroy(&_done);
+	pthread_cond_destroy(&_start);
+	pthread_mutex_destroy(&_lock);
+}
+
+STATUS WorkerPool::init(U32 numThreads) {
+	deinit();
+
+	if (numThreads == 0)
+		numThreads = (U32)MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+	numThreads = MIN(numThreads, WORKER_POOL_MAX_THREADS);
+
+	_stop = false;
+	for (U32 i = 0; i < numThreads - 1; i++) {
+		if (pthread_create(&_threads[i], nullptr, workerThreadFunc, this) != 0) {
+			log->printf("WorkerPool::init(): failed create worker thread!\n");
+			break;
+		}
+		_numWorkers++;
+	}
+	_numThreads = _numWorkers + 1;
+
+	return _numThreads == numThreads ? S_OK : S_FAIL;
+}
+
+void WorkerPool::deinit() {
+	if (_numWorkers == 0)
+		return;
+
+	pthread_mutex_lock(&_lock);
+	_stop = true;
+	pthread_cond_broadcast(&_start);
+	pthread_mutex_unlock(&_lock);
+
+	for (U32 i = 0; i < _numWorkers; i++) {
+		pthread_join(_threads[i], nullptr);
+	}
+	_numWorkers = 0;
+	_numThreads = 1;
+}
+
+void WorkerPool::run(WorkerPoolJob job, void *arg, U32 numSlices) {
+	if (_numWorkers == 0 || numSlices < 2) {
+		for (U32 i = 0; i < numSlices; i++) {
+			job(arg, i, numSlices);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&_lock);
+	_job = job;
+	_arg = arg;
+	_numSlices = numSlices;
+	_nextSlice = 0;
+	_pendingSlices = numSlices;
+	pthread_cond_broadcast(&_start);
+
+	while (runSlice())
+		;
+
+	while (_pendingSlices > 0) {
+		pthread_cond_wait(&_done, &_lock);
+	}
+	_job = nullptr;
+	pthread_mutex_unlock(&_lock);
+}
+
+// Called and returns with lock held, false once no slice is left to take.
+bool WorkerPool::runSlice() {
+	if (_job == nullptr || _nextSlice >= _numSlices)
+		return false;
+
+	U32 slice = _nextSlice++;
+	WorkerPoolJob job = _job;
+	void *arg = _arg;
+	U32 numSlices = _numSlices;
+
+	pthread_mutex_unlock(&_lock);
+	job(arg, slice, numSlices);
+	pthread_mutex_lock(&_lock);
+
+	if (--_pendingSlices == 0)
+		pthread_cond_signal(&_done);
+
+	return true;
+}
+
+void *WorkerPool::workerThreadFunc(void *arg) {
+	((WorkerPool *)arg)->workerLoop();
+
+	return nullptr;
+}
+
+void WorkerPool::workerLoop() {
+	pthread_mutex_lock(&_lock);
+	while (!_stop) {
+		if (!runSlice())
+			pthread_cond_wait(&_start, &_lock);
+	}
+	pthread_mutex_unlock(&_lock);
+}
+
+static WorkerPool *sharedWorkerPool;
+static pthread_once_t sharedWorkerPoolOnce = PTHREAD_ONCE_INIT;
+
+static void createSharedWorkerPool() {
+	sharedWorkerPool = new WorkerPool();
+	sharedWorkerPool->init(0);
+}
+
+WorkerPool *GetWorkerPool() {
+	pthread_once(&sharedWorkerPoolOnce, createSharedWorkerPool);
+
+	return sharedWorkerPool;
+}
+
+} // namespace
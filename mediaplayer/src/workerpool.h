@@ -0,0 +1,77 @@
+/*
+ * MobiAqua Media Player
+ *
+ * Copyright (C) 2013-2020 Pawel Kolodziejski
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <pthread.h>
+
+#include "basetypes.h"
+
+namespace MediaPLayer {
+
+#define WORKER_POOL_MAX_THREADS 8
+
+// Runs job for slices 0..numSlices-1, slice order is not defined.
+typedef void (*WorkerPoolJob)(void *arg, U32 slice, U32 numSlices);
+
+// Persistent threads for splitting per frame pixel work. Calling thread takes
+// slices too, so pool of N threads starts N-1 workers.
+class WorkerPool {
+private:
+
+	pthread_t                   _threads[WORKER_POOL_MAX_THREADS];
+	U32                         _numThreads;
+	U32                         _numWorkers;
+	pthread_mutex_t             _lock;
+	pthread_cond_t              _start;
+	pthread_cond_t              _done;
+	WorkerPoolJob               _job;
+	void                        *_arg;
+	U32                         _numSlices;
+	U32                         _nextSlice;
+	U32                         _pendingSlices;
+	bool                        _stop;
+
+public:
+
+	WorkerPool();
+	~WorkerPool();
+
+	// 0 threads uses every online cpu
+	STATUS init(U32 numThreads);
+	void deinit();
+	U32 getNumThreads() { return _numThreads; }
+	void run(WorkerPoolJob job, void *arg, U32 numSlices);
+
+private:
+
+	static void *workerThreadFunc(void *arg);
+	void workerLoop();
+	bool runSlice();
+};
+
+// Pool shared by displays, created on first use with every online cpu.
+WorkerPool *GetWorkerPool();
+
+} // namespace
+
+#endif